@@ -1,61 +1,346 @@
 #include "convolver.hpp"
+#include <source/audio/simd.hpp>
+#include <source/audio/soundfile.hpp>
+#include <QtConcurrent>
 #include <QtDebug>
+#include <cstring>
 
-Convolver::Convolver() : m_ir(nullptr), m_convolver_l(nullptr), m_convolver_r(nullptr),
-    m_buffer(nullptr)
+// STAGE ---------------------------------------------------------------------------------------------
+
+ConvolverStage::ConvolverStage(ConvolverWorker& worker, ImpulseResponse const& ir, quint16 channel) :
+    m_worker(worker), m_has_tail(ir.tail(channel).nparts > 0), m_tail_size(ir.tail())
+{
+    m_head.init( &ir.head(channel) );
+    if ( !m_has_tail ) return;
+
+    m_tail.init( &ir.tail(channel) );
+
+    m_tail_input.fill           ( 0.f, m_tail_size );
+    m_tail_precalculated.fill   ( 0.f, m_tail_size );
+    m_background_input.fill     ( 0.f, m_tail_size );
+    m_background_output.fill    ( 0.f, m_tail_size );
+}
+
+ConvolverStage::~ConvolverStage()
+{
+    wait();
+}
+
+void ConvolverStage::wait()
+{
+    // the job has a whole tail block to complete,
+    // this only blocks if the worker fell that far behind
+    if ( !m_running ) return;
+
+    m_done.acquire();
+    m_running = false;
+}
+
+void ConvolverStage::process(const float* input, float* output, quint32 len)
+{
+    // covers the first two tail blocks of the response
+    m_head.process( input, output, len );
+    if ( !m_has_tail ) return;
+
+    quint32 done = 0;
+
+    while ( done < len )
+    {
+        quint32 n = qMin( len-done, m_tail_size-m_tail_fill );
+
+        simd::add( output+done, m_tail_precalculated.constData()+m_tail_fill, n );
+        memcpy( m_tail_input.data()+m_tail_fill, input+done, n*sizeof(float) );
+
+        m_tail_fill += n;
+        done        += n;
+
+        if ( m_tail_fill < m_tail_size ) continue;
+
+        // collect the previous job's output, to be played during
+        // the next tail block, and hand the one just filled over
+        wait();
+
+        m_tail_precalculated.swap   ( m_background_output );
+        m_tail_input.swap           ( m_background_input );
+        m_tail_fill = 0;
+
+        m_running = true;
+        m_worker.schedule( this );
+    }
+}
+
+void ConvolverStage::background()
+{
+    m_tail.process( m_background_input.constData(), m_background_output.data(), m_tail_size );
+    m_done.release();
+}
+
+// WORKER --------------------------------------------------------------------------------------------
+
+ConvolverWorker::~ConvolverWorker()
+{
+    stop();
+}
+
+void ConvolverWorker::stop()
+{
+    if ( !isRunning() ) return;
+
+    m_quit.store( true );
+    m_wake.release();
+    wait();
+}
+
+void ConvolverWorker::schedule(ConvolverStage* stage)
+{
+    // at most one job per stage is pending, the queue holds them all
+    m_queue.push( stage );
+    m_wake.release();
+}
+
+void ConvolverWorker::run()
+{
+    forever
+    {
+        m_wake.acquire();
+        if ( m_quit.load() ) return;
+
+        ConvolverStage* stage;
+        while ( m_queue.pop(stage) )
+            stage->background();
+    }
+}
+
+// ENGINE --------------------------------------------------------------------------------------------
+
+ConvolverEngine::ConvolverEngine(ConvolverWorker& worker, ImpulseResponsePtr response,
+                                 QVector<ConvolverRoute> const& layout) :
+    ir(response), routes(layout)
+{
+    for ( auto& route : routes )
+          route.stage = new ConvolverStage( worker, *ir, route.channel );
+}
+
+ConvolverEngine::~ConvolverEngine()
+{
+    // stages wait for their pending tail jobs
+    for ( auto& route : routes )
+          delete route.stage;
+}
+
+void ConvolverEngine::process(float** in, float** out, quint32 nsamples, float* scratch)
+{
+    for ( const auto& route : routes )
+    {
+        route.stage->process( in[route.input], scratch, nsamples );
+        simd::add( out[route.output], scratch, nsamples );
+    }
+}
+
+// CONVOLVER -----------------------------------------------------------------------------------------
+
+Convolver::Convolver()
 {
     SETN_IN     ( 2 );
     SETN_OUT    ( 2 );
     SETTYPE     ( StreamType::Effect );
+
+    m_reclaim.setInterval( 500 );
+
+    QObject::connect( &m_watcher, SIGNAL(finished()), this, SLOT(onIrLoaded()) );
+    QObject::connect( &m_reclaim, SIGNAL(timeout()), this, SLOT(onReclaim()) );
 }
 
 Convolver::~Convolver()
 {
-    delete m_ir;
-    delete m_convolver_l;
-    delete m_convolver_r;
+    m_watcher.waitForFinished();
+
+    // the worker has to be running while engines are deleted
+    delete m_engine;
+    delete m_fading;
+    delete m_next.load();
+    delete m_retired.load();
+
+    m_worker.stop();
+
+    StreamNode::deleteBuffer( m_fade_buffer, m_num_outputs, m_block );
+    delete [ ] m_scratch;
 }
 
 void Convolver::setIrPath(QString path)
 {
+    if ( path == m_ir_path ) return;
+
     m_ir_path = path;
+    emit irPathChanged();
+
+    // otherwise, loaded when initialized
+    if ( !m_block || m_layout.isEmpty() ) return;
+
+    m_watcher.setFuture( QtConcurrent::run(&ImpulseResponse::get, path,
+                         (quint32) m_block, (quint32) SAMPLERATE) );
+}
+
+void Convolver::setIrInputs(quint16 ninputs)
+{
+    m_ir_inputs = ninputs;
 }
 
 void Convolver::componentComplete()
 {
-    m_ir = new Soundfile( m_ir_path );
-    m_convolver_l = new FFTConvolver;
-    m_convolver_r = new FFTConvolver;
+    // only the header is read here, the response itself
+    // depends on the stream's block size and rate
+    Soundfile probe ( m_ir_path );
+    quint16 nch = probe.nchannels();
+
+    if ( !nch )
+    {
+        setActive( false );
+        return;
+    }
+
+    if ( !m_ir_inputs )
+    {
+        // a mono IR is applied to every input
+        quint16 n = nch == 1 ? qMax<quint16>( m_num_inputs, 1 ) : nch;
+
+        SETN_IN     ( n );
+        SETN_OUT    ( n );
+
+        for ( quint16 ch = 0; ch < n; ++ch )
+            m_layout << ConvolverRoute { ch, ch, quint16( nch == 1 ? 0 : ch ), nullptr };
+    }
+    else
+    {
+        if ( nch % m_ir_inputs )
+        {
+            qDebug() << "[CONVOLVER]" << m_ir_path << nch
+                     << "channels, not a multiple of" << m_ir_inputs << "inputs";
+            setActive( false );
+            return;
+        }
+
+        quint16 nout = nch/m_ir_inputs;
+
+        SETN_IN     ( m_ir_inputs );
+        SETN_OUT    ( nout );
+
+        for ( quint16 i = 0; i < m_ir_inputs; ++i )
+            for ( quint16 o = 0; o < nout; ++o )
+                m_layout << ConvolverRoute { i, o, quint16( i*nout+o ), nullptr };
+    }
 
-    auto nsamples = m_ir->nsamples();
+    m_ir_channels = nch;
 
-    StreamNode::allocateBuffer(m_buffer, m_ir->nchannels(), nsamples);
-    m_ir->buffer(m_buffer, 0, nsamples);
+    // jobs of the current, fading out and just retired engines
+    m_worker.allocate   ( m_layout.size()*3 );
+    m_worker.start      ( QThread::HighPriority );
+}
+
+ConvolverEngine* Convolver::build(ImpulseResponsePtr response)
+{
+    if ( response.isNull() || response->nchannels() != m_ir_channels )
+    {
+        qDebug() << "[CONVOLVER]" << m_ir_path
+                 << "could not be loaded, or doesn't have" << m_ir_channels << "channels";
+        return nullptr;
+    }
+
+    return new ConvolverEngine( m_worker, response, m_layout );
 }
 
 void Convolver::initialize(qint64 nsamples)
-{    
-    auto ns = m_ir->nsamples();
+{
+    if ( m_layout.isEmpty() ) return;
+
+    StreamNode::deleteBuffer( m_fade_buffer, m_num_outputs, m_block );
+    delete [ ] m_scratch;
 
-    m_convolver_l->init( CONVOLVER_BUFFER_SIZE, m_buffer[0], ns );
+    m_block = nsamples;
+    m_scratch = new float [ nsamples ]();
+    StreamNode::allocateBuffer( m_fade_buffer, m_num_outputs, nsamples );
 
-    if      ( m_ir->nchannels() == 1 )
-        m_convolver_r->init( CONVOLVER_BUFFER_SIZE, m_buffer[0], ns );
+    delete m_engine;
+    delete m_fading;
+    m_fading = nullptr;
 
-    else if ( m_ir->nchannels() == 2 )
-        m_convolver_r->init( CONVOLVER_BUFFER_SIZE, m_buffer[1], ns );
+    // identical responses (path, block size and rate)
+    // are transformed once, and shared
+    m_engine = build( ImpulseResponse::get(m_ir_path, nsamples, SAMPLERATE) );
 }
 
 float** Convolver::process(float** buf, qint64 nsamples)
 {
     auto nout   = m_num_outputs;
-    auto out    = m_out;   
+    auto out    = m_out;
 
     StreamNode::resetBuffer( m_out, nout, nsamples );
 
-    m_convolver_l->process( buf[ 0 ], out[ 0 ], nsamples );
-    m_convolver_r->process( buf[ 1 ], out[ 1 ], nsamples );
+    if ( nsamples > m_block ) return out;
+
+    // switch to a new response once the previous switch is over
+    if ( !m_fading && !m_retired.load() && m_next.load() )
+    {
+        m_switching.store( true );
+
+        m_fading    = m_engine;
+        m_engine    = m_next.exchange( nullptr );
+        m_fade      = 0;
+
+        // nothing to fade out from
+        if ( !m_fading ) m_switching.store( false );
+    }
+
+    if ( m_engine ) m_engine->process( buf, out, nsamples, m_scratch );
+    if ( !m_fading ) return out;
+
+    StreamNode::resetBuffer( m_fade_buffer, nout, nsamples );
+    m_fading->process( buf, m_fade_buffer, nsamples, m_scratch );
+
+    for ( quint16 ch = 0; ch < nout; ++ch )
+    {
+        float* dst          = out[ch];
+        const float* old    = m_fade_buffer[ch];
+
+        for ( qint64 s = 0; s < nsamples; ++s )
+        {
+            float g = qMin( 1.f, (float) (m_fade+s)/CONVOLVER_CROSSFADE );
+            dst[s]  = old[s]+g*(dst[s]-old[s]);
+        }
+    }
+
+    m_fade += nsamples;
+
+    if ( m_fade >= CONVOLVER_CROSSFADE )
+    {
+        // handed back to the control thread, for deletion
+        m_retired.store( m_fading );
+        m_switching.store( false );
+        m_fading = nullptr;
+    }
 
     return out;
 }
 
+void Convolver::onIrLoaded()
+{
+    auto engine = build( m_watcher.result() );
+    if ( !engine ) return;
+
+    // a response that wasn't picked up yet is simply replaced
+    delete m_next.exchange( engine );
+    m_reclaim.start();
+}
+
+void Convolver::onReclaim()
+{
+    // the audio thread flags a switch before taking the
+    // new engine, and retires the old one before clearing it
+    bool pending    = m_next.load();
+    bool switching  = m_switching.load();
+
+    delete m_retired.exchange( nullptr );
+
+    if ( !pending && !switching )
+         m_reclaim.stop();
+}
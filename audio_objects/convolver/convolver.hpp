@@ -2,17 +2,115 @@
 #define CONVOLVER_HPP
 
 #include <source/audio/audio.hpp>
-#include <source/audio/soundfile.hpp>
-#include <external/fftconvolver/FFTConvolver.h>
+#include <source/audio/ringbuffer.hpp>
+#include <audio_objects/convolver/impulseresponse.hpp>
+#include <QThread>
+#include <QSemaphore>
+#include <QFutureWatcher>
+#include <QTimer>
+#include <atomic>
 
-using namespace fftconvolver;
-#define CONVOLVER_BUFFER_SIZE 1024
+#define CONVOLVER_CROSSFADE 4096
+// in samples, when switching to another impulse response
+
+class ConvolverWorker;
+
+// non-uniformly partitioned convolution of one IR channel:
+// head partitions (block size) on the audio thread, tail partitions
+// scheduled on the node's worker, one tail block ahead of their output
+class ConvolverStage
+{
+    public:
+    ConvolverStage ( ConvolverWorker& worker, ImpulseResponse const& ir, quint16 channel );
+    ~ConvolverStage ( );
+
+    ConvolverStage ( ConvolverStage const& ) = delete;
+    ConvolverStage& operator= ( ConvolverStage const& ) = delete;
+
+    // audio thread, overwrites output
+    void process ( const float* input, float* output, quint32 len );
+
+    // worker thread
+    void background ( );
+
+    private:
+    void wait ( );
+
+    ConvolverWorker& m_worker;
+    PartitionedConvolver m_head;
+    PartitionedConvolver m_tail;
+    bool m_has_tail;
+
+    quint32 m_tail_size;
+    quint32 m_tail_fill = 0;
+    QVector<float> m_tail_input;
+    QVector<float> m_tail_precalculated;
+
+    // shared with the worker while a job runs
+    QVector<float> m_background_input;
+    QVector<float> m_background_output;
+    QSemaphore m_done;
+    bool m_running = false;
+};
+
+class ConvolverWorker : public QThread
+{
+    public:
+    ~ConvolverWorker ( ) override;
+
+    void allocate   ( quint32 nstages ) { m_queue.allocate(nstages); }
+    void stop       ( );
+
+    // audio thread
+    void schedule   ( ConvolverStage* stage );
+
+    protected:
+    void run ( ) override;
+
+    private:
+    Ringbuffer<ConvolverStage*> m_queue;
+    QSemaphore m_wake;
+    std::atomic<bool> m_quit { false };
+};
+
+struct ConvolverRoute
+{
+    quint16 input;
+    quint16 output;
+    quint16 channel;
+    ConvolverStage* stage;
+};
+
+// a transformed IR and the convolution state of each of its routes,
+// built on the control thread and handed over to the audio thread
+struct ConvolverEngine
+{
+    ConvolverEngine ( ConvolverWorker& worker, ImpulseResponsePtr response,
+                      QVector<ConvolverRoute> const& layout );
+    ~ConvolverEngine ( );
+
+    // adds the routes' outputs to 'out'
+    void process ( float** in, float** out, quint32 nsamples, float* scratch );
+
+    ImpulseResponsePtr ir;
+    QVector<ConvolverRoute> routes;
+};
+
+// the impulse response is either:
+// - diagonal ('irInputs' 0): one IR channel per input (a mono IR is
+//   shared by all inputs), each input convolved to its own output
+// - a matrix of 'irInputs' x M channels, input i reaching output o
+//   through channel i*M+o, e.g. true stereo (2 x 2, LL LR RL RR)
+//   or a mono source to B-format (1 x 4)
+// changing 'irPath' once running prepares the new IR in the background,
+// and crossfades to it. it has to have the same number of channels
 
 class Convolver : public StreamNode
 {
     Q_OBJECT
 
-    Q_PROPERTY  ( QString irPath READ irPath WRITE setIrPath )
+    Q_PROPERTY  ( QString irPath READ irPath WRITE setIrPath NOTIFY irPathChanged )
+    Q_PROPERTY  ( int irInputs READ irInputs WRITE setIrInputs )
 
     public:
     Convolver();
@@ -26,12 +124,42 @@ class Convolver : public StreamNode
     QString irPath() const { return m_ir_path; }
     void setIrPath(QString path);
 
+    quint16 irInputs() const { return m_ir_inputs; }
+    void setIrInputs(quint16 ninputs);
+
+    signals:
+    void irPathChanged();
+
+    protected slots:
+    void onIrLoaded ( );
+    void onReclaim  ( );
+
     private:
-    FFTConvolver* m_convolver_l;
-    FFTConvolver* m_convolver_r;
-    float** m_buffer;
-    Soundfile* m_ir;
+    ConvolverEngine* build ( ImpulseResponsePtr response );
+
+    ConvolverWorker m_worker;
+    QVector<ConvolverRoute> m_layout;
+    quint16 m_ir_channels = 0;
+
+    // audio thread
+    ConvolverEngine* m_engine = nullptr;
+    ConvolverEngine* m_fading = nullptr;
+    quint32 m_fade = 0;
+
+    // control thread -> audio thread -> control thread
+    std::atomic<ConvolverEngine*> m_next { nullptr };
+    std::atomic<ConvolverEngine*> m_retired { nullptr };
+    std::atomic<bool> m_switching { false };
+
+    QFutureWatcher<ImpulseResponsePtr> m_watcher;
+    QTimer m_reclaim;
+
+    float* m_scratch = nullptr;
+    float** m_fade_buffer = nullptr;
+    qint64 m_block = 0;
+
     QString m_ir_path;
+    quint16 m_ir_inputs = 0;
 };
 
 #endif // CONVOLVER_HPP
@@ -0,0 +1,245 @@
+#include "impulseresponse.hpp"
+#include <source/audio/soundfile.hpp>
+#include <source/audio/resampler.hpp>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QtDebug>
+#include <cstring>
+
+static QMutex g_mutex;
+static QHash<QString, QWeakPointer<ImpulseResponse>> g_responses;
+
+// PARTITIONS ----------------------------------------------------------------------------------------
+
+void IrPartitions::build(const float* ir, quint64 len, quint32 size)
+{
+    block   = size;
+    nbins   = audiofft::AudioFFT::ComplexSize( 2*block );
+    nparts  = (len+block-1)/block;
+
+    re.fill( 0.f, nparts*nbins );
+    im.fill( 0.f, nparts*nbins );
+
+    audiofft::AudioFFT fft;
+    fft.init( 2*block );
+
+    QVector<float> buffer ( 2*block );
+
+    for ( quint32 p = 0; p < nparts; ++p )
+    {
+        quint64 n = qMin<quint64>( block, len-(quint64)p*block );
+
+        buffer.fill( 0.f );
+        memcpy( buffer.data(), ir+(quint64)p*block, n*sizeof(float) );
+
+        fft.fft( buffer.constData(), re.data()+p*nbins, im.data()+p*nbins );
+    }
+}
+
+// RESPONSE ------------------------------------------------------------------------------------------
+
+quint32 ImpulseResponse::headSize(quint32 block)
+{
+    quint32 size = 1;
+    while ( size < block ) size <<= 1;
+    return size;
+}
+
+quint32 ImpulseResponse::tailSize(quint32 block)
+{
+    // much larger than the head, and whatever its size,
+    // at least a few blocks for the worker to catch up
+    return qMax<quint32>( CONVOLVER_TAIL_SIZE, headSize(block)*8 );
+}
+
+ImpulseResponsePtr ImpulseResponse::get(QString path, quint32 block, quint32 rate)
+{
+    QString key = QString("%1|%2|%3").arg(path).arg(headSize(block)).arg(rate);
+
+    {
+        QMutexLocker lock ( &g_mutex );
+        ImpulseResponsePtr response = g_responses.value(key).toStrongRef();
+        if ( !response.isNull() ) return response;
+    }
+
+    auto response = ImpulseResponsePtr( new ImpulseResponse );
+    if ( !response->load(path, block, rate) ) return ImpulseResponsePtr();
+
+    QMutexLocker lock ( &g_mutex );
+    g_responses.insert( key, response.toWeakRef() );
+
+    return response;
+}
+
+bool ImpulseResponse::load(QString path, quint32 block, quint32 rate)
+{
+    Soundfile soundfile ( path );
+
+    quint16 nch     = soundfile.nchannels();
+    quint64 nframes = soundfile.nsamples(); // per channel
+
+    if ( !nch || !nframes ) return false;
+
+    QVector<QVector<float>> channels ( nch, QVector<float>(nframes) );
+    QVector<float*> pointers;
+
+    for ( auto& channel : channels )
+          pointers << channel.data();
+
+    soundfile.buffer( pointers.data(), 0, nframes );
+
+    if ( rate && soundfile.sampleRate() != rate )
+    {
+        // the IR has to match the stream's rate
+        QVector<float> interleaved ( nframes*nch );
+
+        for ( quint64 f = 0; f < nframes; ++f )
+            for ( quint16 ch = 0; ch < nch; ++ch )
+                interleaved[f*nch+ch] = channels[ch][f];
+
+        auto source = SampleBufferPtr( new SampleBuffer(nch, nframes, soundfile.sampleRate()) );
+        source->encode( 0, nframes, interleaved.constData() );
+
+        auto converted = Resampler::convert( source, rate, Interpolation::Best );
+        nframes = converted->nframes();
+
+        interleaved.resize( nframes*nch );
+        converted->decode( 0, nframes, interleaved.data() );
+
+        for ( quint16 ch = 0; ch < nch; ++ch )
+        {
+            channels[ch].resize( nframes );
+
+            for ( quint64 f = 0; f < nframes; ++f )
+                channels[ch][f] = interleaved[f*nch+ch];
+        }
+    }
+
+    m_nframes   = nframes;
+    m_head_size = headSize( block );
+    m_tail_size = tailSize( block );
+
+    m_head.resize( nch );
+    m_tail.resize( nch );
+
+    quint64 split = qMin<quint64>( nframes, 2*m_tail_size );
+
+    for ( quint16 ch = 0; ch < nch; ++ch )
+    {
+        m_head[ch].build( channels[ch].constData(), split, m_head_size );
+
+        if ( nframes > split )
+             m_tail[ch].build( channels[ch].constData()+split, nframes-split, m_tail_size );
+    }
+
+    return true;
+}
+
+// CONVOLVER -----------------------------------------------------------------------------------------
+
+void PartitionedConvolver::init(const IrPartitions* ir)
+{
+    m_ir = ir && ir->nparts ? ir : nullptr;
+    if ( !m_ir ) return;
+
+    quint32 block = m_ir->block;
+    quint32 nbins = m_ir->nbins;
+
+    m_fft.init( 2*block );
+
+    m_segments_re.fill  ( 0.f, m_ir->nparts*nbins );
+    m_segments_im.fill  ( 0.f, m_ir->nparts*nbins );
+    m_pre_re.fill       ( 0.f, nbins );
+    m_pre_im.fill       ( 0.f, nbins );
+    m_conv_re.fill      ( 0.f, nbins );
+    m_conv_im.fill      ( 0.f, nbins );
+    m_fft_buffer.fill   ( 0.f, 2*block );
+    m_input.fill        ( 0.f, block );
+    m_overlap.fill      ( 0.f, block );
+
+    m_current   = 0;
+    m_fill      = 0;
+}
+
+inline void complex_madd(float* re, float* im, const float* are, const float* aim,
+                         const float* bre, const float* bim, quint32 n)
+{
+    for ( quint32 k = 0; k < n; ++k )
+    {
+        re[k] += are[k]*bre[k]-aim[k]*bim[k];
+        im[k] += are[k]*bim[k]+aim[k]*bre[k];
+    }
+}
+
+void PartitionedConvolver::process(const float* input, float* output, quint32 len)
+{
+    if ( !m_ir )
+    {
+        memset( output, 0, len*sizeof(float) );
+        return;
+    }
+
+    quint32 block   = m_ir->block;
+    quint32 nbins   = m_ir->nbins;
+    quint32 nparts  = m_ir->nparts;
+    quint32 done    = 0;
+
+    while ( done < len )
+    {
+        bool fresh  = m_fill == 0;
+        quint32 pos = m_fill;
+        quint32 n   = qMin( len-done, block-m_fill );
+
+        memcpy( m_input.data()+pos, input+done, n*sizeof(float) );
+
+        // spectrum of the current (partial) input block
+        memcpy( m_fft_buffer.data(), m_input.constData(), block*sizeof(float) );
+        memset( m_fft_buffer.data()+block, 0, block*sizeof(float) );
+
+        float* seg_re = m_segments_re.data()+m_current*nbins;
+        float* seg_im = m_segments_im.data()+m_current*nbins;
+        m_fft.fft( m_fft_buffer.constData(), seg_re, seg_im );
+
+        // older segments don't change during a block
+        if ( fresh )
+        {
+            m_pre_re.fill( 0.f );
+            m_pre_im.fill( 0.f );
+
+            for ( quint32 p = 1; p < nparts; ++p )
+            {
+                quint32 s = (m_current+p)%nparts;
+
+                complex_madd( m_pre_re.data(), m_pre_im.data(),
+                              m_segments_re.constData()+s*nbins, m_segments_im.constData()+s*nbins,
+                              m_ir->re.constData()+p*nbins, m_ir->im.constData()+p*nbins, nbins );
+            }
+        }
+
+        memcpy( m_conv_re.data(), m_pre_re.constData(), nbins*sizeof(float) );
+        memcpy( m_conv_im.data(), m_pre_im.constData(), nbins*sizeof(float) );
+
+        complex_madd( m_conv_re.data(), m_conv_im.data(), seg_re, seg_im,
+                      m_ir->re.constData(), m_ir->im.constData(), nbins );
+
+        m_fft.ifft( m_fft_buffer.data(), m_conv_re.constData(), m_conv_im.constData() );
+
+        for ( quint32 k = 0; k < n; ++k )
+            output[done+k] = m_fft_buffer[pos+k]+m_overlap[pos+k];
+
+        m_fill += n;
+
+        if ( m_fill == block )
+        {
+            // next block: keep the overlap, shift the delay line
+            m_input.fill( 0.f );
+            m_fill = 0;
+
+            memcpy( m_overlap.data(), m_fft_buffer.constData()+block, block*sizeof(float) );
+            m_current = m_current > 0 ? m_current-1 : nparts-1;
+        }
+
+        done += n;
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef IMPULSERESPONSE_HPP
+#define IMPULSERESPONSE_HPP
+
+#include <QVector>
+#include <QString>
+#include <QSharedPointer>
+#include <external/fftconvolver/AudioFFT.h>
+
+#define CONVOLVER_TAIL_SIZE 4096
+// in samples, minimum partition size of the impulse response's tail,
+// convolved on a background thread. the head is partitioned
+// by the stream's block size, and is the only latency-bound stage
+
+// spectra of a segment of one IR channel, cut in partitions
+// of 'block' samples (each zero-padded to an fft of 2*block)
+struct IrPartitions
+{
+    quint32 block   = 0;
+    quint32 nparts  = 0;
+    quint32 nbins   = 0;
+
+    // [part*nbins+bin]
+    QVector<float> re;
+    QVector<float> im;
+
+    void build ( const float* ir, quint64 len, quint32 block );
+};
+
+// an impulse response, resampled to the stream's rate and transformed
+// for a given head block size: [0, 2*tail[ in head-sized partitions,
+// the rest in tail-sized ones. shared (read-only) by every convolver
+// using the same file with the same block size and rate
+
+class ImpulseResponse
+{
+    public:
+    // blocking, loads and transforms the file unless someone holds it already
+    static QSharedPointer<ImpulseResponse> get ( QString path, quint32 block, quint32 rate );
+
+    static quint32 headSize ( quint32 block );
+    static quint32 tailSize ( quint32 block );
+
+    quint16 nchannels   ( ) const { return m_head.size(); }
+    quint64 nframes     ( ) const { return m_nframes; }
+    quint32 head        ( ) const { return m_head_size; }
+    quint32 tail        ( ) const { return m_tail_size; }
+
+    const IrPartitions& head ( quint16 channel ) const { return m_head[channel]; }
+    const IrPartitions& tail ( quint16 channel ) const { return m_tail[channel]; }
+
+    private:
+    bool load ( QString path, quint32 block, quint32 rate );
+
+    quint64 m_nframes       = 0;
+    quint32 m_head_size     = 0;
+    quint32 m_tail_size     = 0;
+    QVector<IrPartitions> m_head;
+    QVector<IrPartitions> m_tail;
+};
+
+typedef QSharedPointer<ImpulseResponse> ImpulseResponsePtr;
+
+// uniformly partitioned, zero-latency convolution with shared partitions.
+// input spectra are kept in a frequency-domain delay line, the products
+// with all but the current partition are summed once per block only
+
+class PartitionedConvolver
+{
+    public:
+    void init       ( const IrPartitions* ir );
+    void process    ( const float* input, float* output, quint32 len );
+
+    private:
+    const IrPartitions* m_ir = nullptr;
+    audiofft::AudioFFT m_fft;
+
+    // input spectra, [segment*nbins+bin]
+    QVector<float> m_segments_re;
+    QVector<float> m_segments_im;
+    quint32 m_current = 0;
+
+    QVector<float> m_pre_re;
+    QVector<float> m_pre_im;
+    QVector<float> m_conv_re;
+    QVector<float> m_conv_im;
+
+    QVector<float> m_fft_buffer;
+    QVector<float> m_input;
+    QVector<float> m_overlap;
+    quint32 m_fill = 0;
+};
+
+#endif // IMPULSERESPONSE_HPP
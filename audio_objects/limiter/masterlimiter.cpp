@@ -1,5 +1,7 @@
 #include "masterlimiter.hpp"
+#include <source/audio/simd.hpp>
 #include <math.h>
+#include <cstring>
 
 MasterLimiter::MasterLimiter()
 {
@@ -9,67 +11,144 @@ MasterLimiter::MasterLimiter()
 void MasterLimiter::setThreshold(qreal threshold)
 {
     m_threshold = threshold;
+    update();
 }
 
-
 void MasterLimiter::setRelease(qreal release)
 {
     m_release = release;
+    update();
 }
 
 void MasterLimiter::setLimit(qreal limit)
 {
     m_limit = limit;
+    update();
+}
+
+void MasterLimiter::setLookahead(qreal lookahead)
+{
+    m_lookahead = lookahead;
+}
+
+void MasterLimiter::setTruePeak(bool true_peak)
+{
+    m_true_peak = true_peak;
+}
+
+void MasterLimiter::update()
+{
+    m_thresh = pow( 10, m_threshold/20.f );
+    m_volume = pow( 10, m_limit/20.f )/m_thresh;
+
+    if ( !SAMPLERATE ) return;
+
+    float release = m_release/1000.f;
+    m_coeff = exp( -3/(SAMPLERATE*qMax(release, 0.05f)) );
 }
 
 void MasterLimiter::initialize(qint64 nsamples)
 {
-    holdtime = m_stream_properties.sample_rate/128.f;
-    r1timer = 0;
-    r2timer = holdtime/2.f;
+    update();
+
+    m_window        = qMax<quint32>( 1, qRound(m_lookahead*SAMPLERATE/1000.f) );
+    m_oversample    = m_true_peak;
+
+    // the audio runs a whole window behind the detector,
+    // which itself may run behind the input
+    m_delay = m_window-1+(m_oversample ? TRUEPEAK_DELAY : 0);
+
+    if ( m_oversample )
+         m_detector.allocate( m_num_outputs, nsamples );
+
+    m_lines.fill    ( QVector<float>(m_delay+nsamples, 0.f), m_num_outputs );
+    m_peaks.fill    ( 0.f, nsamples );
+    m_gains.fill    ( 0.f, nsamples );
+
+    m_deque_peaks.fill  ( 0.f, m_window );
+    m_deque_index.fill  ( 0, m_window );
+    m_front = 0;
+    m_size  = 0;
+    m_index = 0;
+
+    m_env = 1.f;
+    m_ring.fill( 1.f, m_window );
+    m_ring_pos = 0;
+    m_sum = m_window;
+
+    setLatency( m_delay );
 }
 
 float** MasterLimiter::process(float** in, qint64 nsamples)
 {
     auto out        = m_out;
     auto nout       = m_num_outputs;
+    auto peaks      = m_peaks.data();
+    auto gains      = m_gains.data();
+    quint32 window  = m_window;
+
+    memset( peaks, 0, nsamples*sizeof(float) );
 
-    float thresh    = pow( 10, m_threshold/20.f );
-    float ceiling   = pow( 10, m_limit/20.f );
-    float volume    = ceiling/thresh;
-    float release   = m_release/1000.f;
+    // linked detection, over all channels
+    if ( m_oversample )
+         m_detector.process( in, nout, peaks, nsamples );
 
-    float r = exp(-3/( SAMPLERATE*qMax( release , 0.05f) ));
+    for ( quint16 ch = 0; ch < nout; ++ch )
+    {
+        memcpy( m_lines[ch].data()+m_delay, in[ch], nsamples*sizeof(float) );
+
+        if ( !m_oversample )
+             simd::max_abs( peaks, in[ch], nsamples );
+    }
 
-    for ( qint64 s = 0; s < nsamples; ++s )
+    for ( qint64 s = 0; s < nsamples; ++s, ++m_index )
     {
-        for ( quint16 ch = 0; ch < nout; ++ch )
+        // expire the oldest entry first, so that the ring
+        // never holds more than the window
+        if ( m_size && m_deque_index[m_front]+window <= m_index )
         {
-            float maxspl = fabs( in[ch][s] );
+            m_front = (m_front+1)%window;
+            --m_size;
+        }
 
-            if ( r1timer++ > holdtime )
-            {
-                r1timer     = 0;
-                max1block   = 0;
-            }
+        // smaller or equal peaks can't be the maximum anymore
+        float pk = peaks[s];
 
-            if ( r2timer++ > holdtime )
-            {
-                r2timer     = 0;
-                max2block   = 0;
-            }
+        while ( m_size && m_deque_peaks[(m_front+m_size-1)%window] <= pk )
+            --m_size;
 
-            max1block  = qMax ( max1block, maxspl );
-            float envt = qMax ( max1block, max2block );
+        quint32 back = (m_front+m_size)%window;
+        m_deque_peaks[back] = pk;
+        m_deque_index[back] = m_index;
+        ++m_size;
 
-            float env = env < envt ? envt : envt+r*(env-envt);
+        float target = m_thresh/qMax( m_deque_peaks[m_front], m_thresh );
+        m_env = target < m_env ? target : target+m_coeff*(m_env-target);
 
-            if ( env > thresh )
-                 gain = thresh/env*volume;
-            else gain = volume;
+        // a window-long average of the held gain
+        // reaches it before the peak gets out of the delay
+        m_sum += m_env-m_ring[m_ring_pos];
+        m_ring[m_ring_pos] = m_env;
 
-            out[ch][s] = in[ch][s]*gain;
+        if ( ++m_ring_pos == window )
+        {
+            // drops the rounding errors of the running sum
+            m_ring_pos = 0;
+            m_sum = 0;
+
+            for ( const auto& g : m_ring )
+                  m_sum += g;
         }
+
+        gains[s] = m_sum/window*m_volume;
+    }
+
+    for ( quint16 ch = 0; ch < nout; ++ch )
+    {
+        float* line = m_lines[ch].data();
+
+        simd::mul( out[ch], line, gains, nsamples );
+        memmove( line, line+nsamples, m_delay*sizeof(float) );
     }
 
     return out;
@@ -2,6 +2,13 @@
 #define MASTERLIMITER_HPP
 
 #include <source/audio/audio.hpp>
+#include <source/audio/truepeak.hpp>
+
+// linked lookahead limiter: the loudest channel drives a single gain,
+// held over the lookahead window (sliding maximum), released, then
+// averaged over the window so that it reaches its target before the
+// (delayed) peak does. lookahead and truePeak apply on initialization,
+// the resulting delay is reported as the node's latency
 
 class MasterLimiter : public StreamNode
 {
@@ -10,6 +17,8 @@ class MasterLimiter : public StreamNode
     Q_PROPERTY  ( qreal threshold READ threshold WRITE setThreshold )
     Q_PROPERTY  ( qreal release READ release WRITE setRelease )
     Q_PROPERTY  ( qreal limit READ limit WRITE setLimit )
+    Q_PROPERTY  ( qreal lookahead READ lookahead WRITE setLookahead )
+    Q_PROPERTY  ( bool truePeak READ truePeak WRITE setTruePeak )
 
     public:
     MasterLimiter();
@@ -20,22 +29,51 @@ class MasterLimiter : public StreamNode
     qreal threshold() const { return m_threshold; }
     qreal release() const { return m_release; }
     qreal limit() const { return m_limit; }
+    qreal lookahead() const { return m_lookahead; }
+    bool truePeak() const { return m_true_peak; }
 
     void setThreshold(qreal threshold);
     void setRelease(qreal release);
     void setLimit(qreal limit);
+    void setLookahead(qreal lookahead);
+    void setTruePeak(bool true_peak);
 
     private:
+    void update();
+
     qreal m_threshold  = -0.1;
     qreal m_release    = 200;
     qreal m_limit      = -0.1;
+    qreal m_lookahead  = 2;
+    bool m_true_peak   = false;
+
+    // linear, updated with the properties
+    float m_thresh     = 1.f;
+    float m_volume     = 1.f;
+    float m_coeff      = 0.f;
+
+    quint32 m_window   = 1;
+    quint32 m_delay    = 0;
+    bool m_oversample  = false;
+
+    // sliding maximum, monotonic deque of (peak, index) on a ring
+    QVector<float> m_deque_peaks;
+    QVector<quint64> m_deque_index;
+    quint32 m_front    = 0;
+    quint32 m_size     = 0;
+    quint64 m_index    = 0;
+
+    // released gain, and its moving average
+    float m_env        = 1.f;
+    QVector<float> m_ring;
+    quint32 m_ring_pos = 0;
+    double m_sum       = 0;
 
-    float holdtime = 0.f;
-    float r1timer = 0.f;
-    float r2timer = 0.f;
-    float max1block = 0.f;
-    float max2block = 0.f;
-    float gain = 0.f;
+    // per channel, delay followed by the current block
+    QVector<QVector<float>> m_lines;
+    QVector<float> m_peaks;
+    QVector<float> m_gains;
+    TruePeak m_detector;
 };
 
 #endif // MASTERLIMITER_HPP
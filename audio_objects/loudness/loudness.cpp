@@ -0,0 +1,410 @@
+#include "loudness.hpp"
+#include <source/audio/simd.hpp>
+#include <QMutexLocker>
+#include <math.h>
+#include <cstring>
+
+inline qreal lufs(double energy)
+{
+    return energy > 0 ? qMax<qreal>( -0.691+10*std::log10(energy), LOUDNESS_FLOOR ) : LOUDNESS_FLOOR;
+}
+
+inline quint32 bin_index(qreal loudness)
+{
+    return qBound<qint32>( 0, std::floor((loudness-LOUDNESS_GATE)*10), LOUDNESS_BINS-1 );
+}
+
+// WORKER --------------------------------------------------------------------------------------------
+
+LoudnessWorker::LoudnessWorker(LoudnessMeter& meter) : m_meter(meter)
+{
+    // 6.4s of sub-blocks
+    m_queue.allocate( 64 );
+    clear();
+}
+
+LoudnessWorker::~LoudnessWorker()
+{
+    stop();
+}
+
+void LoudnessWorker::stop()
+{
+    if ( !isRunning() ) return;
+
+    m_quit.store( true );
+    m_wake.release();
+    wait();
+}
+
+void LoudnessWorker::reset()
+{
+    m_reset.store( true );
+    m_wake.release();
+}
+
+void LoudnessWorker::push(LoudnessBlock const& block)
+{
+    // dropped if the worker fell seconds behind
+    if ( m_queue.push(block) )
+         m_wake.release();
+}
+
+LoudnessValues LoudnessWorker::values()
+{
+    QMutexLocker lock ( &m_mutex );
+    return m_values;
+}
+
+void LoudnessWorker::run()
+{
+    forever
+    {
+        m_wake.acquire();
+        if ( m_quit.load() ) return;
+
+        bool changed = m_reset.exchange( false );
+        if ( changed ) clear();
+
+        LoudnessBlock block;
+        while ( m_queue.pop(block) )
+        {
+            measure( block );
+            changed = true;
+        }
+
+        if ( !changed ) continue;
+
+        publish();
+        QMetaObject::invokeMethod( &m_meter, "onMeasured", Qt::QueuedConnection );
+    }
+}
+
+void LoudnessWorker::clear()
+{
+    memset( m_recent, 0, sizeof(m_recent) );
+    memset( m_blocks, 0, sizeof(m_blocks) );
+    memset( m_short_terms, 0, sizeof(m_short_terms) );
+
+    m_nblocks   = 0;
+    m_peak      = 0;
+}
+
+void LoudnessWorker::insert(Bin* histogram, double energy)
+{
+    auto& bin = histogram[ bin_index(lufs(energy)) ];
+
+    bin.count++;
+    bin.energy += energy;
+}
+
+double LoudnessWorker::gated(Bin const* histogram, qreal threshold)
+{
+    quint64 count   = 0;
+    double energy   = 0;
+
+    for ( quint32 b = bin_index(threshold); b < LOUDNESS_BINS; ++b )
+    {
+        count  += histogram[b].count;
+        energy += histogram[b].energy;
+    }
+
+    return count ? energy/count : 0;
+}
+
+qreal LoudnessWorker::percentile(Bin const* histogram, quint32 from, quint64 rank)
+{
+    quint64 count = 0;
+
+    for ( quint32 b = from; b < LOUDNESS_BINS; ++b )
+    {
+        count += histogram[b].count;
+        if ( count > rank ) return LOUDNESS_GATE+(b+0.5)/10;
+    }
+
+    return LOUDNESS_GATE+LOUDNESS_BINS/10;
+}
+
+void LoudnessWorker::measure(LoudnessBlock const& block)
+{
+    m_peak = qMax( m_peak, block.peak );
+    m_recent[ m_nblocks++%30 ] = block.energy;
+
+    // 400ms gating blocks, overlapping by 75%,
+    // and 3s short-term windows, both every 100ms
+    if ( m_nblocks >= 4 )
+    {
+        double momentary = 0;
+        for ( quint64 b = m_nblocks-4; b < m_nblocks; ++b )
+              momentary += m_recent[b%30];
+
+        momentary /= 4;
+        if ( lufs(momentary) >= LOUDNESS_GATE )
+             insert( m_blocks, momentary );
+    }
+
+    if ( m_nblocks >= 30 )
+    {
+        double short_term = 0;
+        for ( const auto& energy : m_recent )
+              short_term += energy;
+
+        short_term /= 30;
+        if ( lufs(short_term) >= LOUDNESS_GATE )
+             insert( m_short_terms, short_term );
+    }
+}
+
+void LoudnessWorker::publish()
+{
+    LoudnessValues values;
+
+    quint64 nrecent = qMin<quint64>( m_nblocks, 30 );
+    double momentary = 0, short_term = 0;
+
+    for ( quint64 b = m_nblocks-nrecent; b < m_nblocks; ++b )
+    {
+        short_term += m_recent[b%30];
+        if ( b+4 >= m_nblocks ) momentary += m_recent[b%30];
+    }
+
+    if ( nrecent )
+    {
+        values.momentary    = lufs( momentary/qMin<quint64>(nrecent, 4) );
+        values.short_term   = lufs( short_term/nrecent );
+    }
+
+    // relative gates: 10 LU below the absolute-gated blocks,
+    // 20 LU below the absolute-gated short-term values for the range
+    double absolute = gated( m_blocks, LOUDNESS_GATE );
+
+    if ( absolute > 0 )
+         values.integrated = lufs( gated(m_blocks, lufs(absolute)-10) );
+
+    absolute = gated( m_short_terms, LOUDNESS_GATE );
+
+    if ( absolute > 0 )
+    {
+        quint32 from    = bin_index( lufs(absolute)-20 );
+        quint64 count   = 0;
+
+        for ( quint32 b = from; b < LOUDNESS_BINS; ++b )
+              count += m_short_terms[b].count;
+
+        if ( count )
+             values.range = percentile( m_short_terms, from, 0.95*(count-1) )-
+                            percentile( m_short_terms, from, 0.10*(count-1) );
+    }
+
+    if ( m_peak > 0 )
+         values.true_peak = qMax<qreal>( 20*std::log10(m_peak), LOUDNESS_FLOOR );
+
+    QMutexLocker lock ( &m_mutex );
+    m_values = values;
+}
+
+// METER ---------------------------------------------------------------------------------------------
+
+LoudnessMeter::LoudnessMeter() : m_worker(*this)
+{
+    SETTYPE ( StreamType::Effect );
+}
+
+LoudnessMeter::~LoudnessMeter()
+{
+    m_worker.stop();
+}
+
+void LoudnessMeter::componentComplete()
+{
+    m_worker.start( QThread::LowPriority );
+}
+
+void LoudnessMeter::setWeights(QVariantList weights)
+{
+    m_weights = weights;
+    updateWeights();
+}
+
+void LoudnessMeter::updateWeights()
+{
+    // sized once initialized, lanes past the last channel stay silent
+    auto nch = m_num_outputs;
+
+    for ( int c = 0; c < m_channel_weights.size(); ++c )
+    {
+        if ( c >= nch ) m_channel_weights[c] = 0;
+        else m_channel_weights[c] = c < m_weights.size() ? m_weights[c].toFloat() : 1.f;
+    }
+}
+
+void LoudnessMeter::reset()
+{
+    m_worker.reset();
+}
+
+void LoudnessMeter::onMeasured()
+{
+    m_values = m_worker.values();
+    emit loudnessChanged();
+}
+
+void LoudnessMeter::initialize(qint64 nsamples)
+{
+    // BS.1770 K-weighting, designed for the stream's rate
+    double K    = tan( M_PI*1681.974450955533/SAMPLERATE );
+    double Q    = 0.7071752369554196;
+    double Vh   = pow( 10, 3.999843853973347/20 );
+    double Vb   = pow( Vh, 0.4996667741545416 );
+    double a0   = 1+K/Q+K*K;
+
+    m_shelf[0] = (Vh+Vb*K/Q+K*K)/a0;
+    m_shelf[1] = 2*(K*K-Vh)/a0;
+    m_shelf[2] = (Vh-Vb*K/Q+K*K)/a0;
+    m_shelf[3] = 2*(K*K-1)/a0;
+    m_shelf[4] = (1-K/Q+K*K)/a0;
+
+    K   = tan( M_PI*38.13547087602444/SAMPLERATE );
+    Q   = 0.5003270373238773;
+    a0  = 1+K/Q+K*K;
+
+    m_highpass[0] = 1;
+    m_highpass[1] = -2;
+    m_highpass[2] = 1;
+    m_highpass[3] = 2*(K*K-1)/a0;
+    m_highpass[4] = (1-K/Q+K*K)/a0;
+
+    auto nch  = m_num_outputs;
+    m_ngroups = (nch+3)/4;
+
+    m_channel_weights.fill  ( 0.f, m_ngroups*4 );
+    m_state.fill            ( 0.f, m_ngroups*16 );
+    m_energy.fill           ( 0.f, m_ngroups*4 );
+    m_zeros.fill            ( 0.f, nsamples );
+    m_peaks.fill            ( 0.f, nsamples );
+
+    updateWeights();
+    m_detector.allocate( nch, nsamples );
+
+    m_subblock  = SAMPLERATE/10;
+    m_pos       = 0;
+    m_peak      = 0;
+
+    m_worker.reset();
+}
+
+// filters four channels at once, one per lane,
+// and sums the squared output into 'energy'
+static void kweight(const float* const* lanes, quint32 n, const float* shelf,
+                    const float* highpass, float* state, float* energy)
+{
+#ifdef WPN114_SSE
+    __m128 sb0 = _mm_set1_ps(shelf[0]), sb1 = _mm_set1_ps(shelf[1]), sb2 = _mm_set1_ps(shelf[2]);
+    __m128 sa1 = _mm_set1_ps(shelf[3]), sa2 = _mm_set1_ps(shelf[4]);
+    __m128 hb0 = _mm_set1_ps(highpass[0]), hb1 = _mm_set1_ps(highpass[1]), hb2 = _mm_set1_ps(highpass[2]);
+    __m128 ha1 = _mm_set1_ps(highpass[3]), ha2 = _mm_set1_ps(highpass[4]);
+
+    __m128 s1   = _mm_loadu_ps(state),   s2 = _mm_loadu_ps(state+4);
+    __m128 h1   = _mm_loadu_ps(state+8), h2 = _mm_loadu_ps(state+12);
+    __m128 acc  = _mm_loadu_ps(energy);
+
+    for ( quint32 s = 0; s < n; ++s )
+    {
+        __m128 x = _mm_setr_ps(lanes[0][s], lanes[1][s], lanes[2][s], lanes[3][s]);
+
+        __m128 y = _mm_add_ps(_mm_mul_ps(sb0, x), s1);
+        s1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(sb1, x), _mm_mul_ps(sa1, y)), s2);
+        s2 = _mm_sub_ps(_mm_mul_ps(sb2, x), _mm_mul_ps(sa2, y));
+
+        __m128 z = _mm_add_ps(_mm_mul_ps(hb0, y), h1);
+        h1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(hb1, y), _mm_mul_ps(ha1, z)), h2);
+        h2 = _mm_sub_ps(_mm_mul_ps(hb2, y), _mm_mul_ps(ha2, z));
+
+        acc = _mm_add_ps(acc, _mm_mul_ps(z, z));
+    }
+
+    _mm_storeu_ps(state, s1);   _mm_storeu_ps(state+4, s2);
+    _mm_storeu_ps(state+8, h1); _mm_storeu_ps(state+12, h2);
+    _mm_storeu_ps(energy, acc);
+#else
+    for ( quint16 l = 0; l < 4; ++l )
+    {
+        float s1 = state[l], s2 = state[4+l], h1 = state[8+l], h2 = state[12+l];
+        float acc = energy[l];
+
+        for ( quint32 s = 0; s < n; ++s )
+        {
+            float x = lanes[l][s];
+
+            float y = shelf[0]*x+s1;
+            s1 = shelf[1]*x-shelf[3]*y+s2;
+            s2 = shelf[2]*x-shelf[4]*y;
+
+            float z = highpass[0]*y+h1;
+            h1 = highpass[1]*y-highpass[3]*z+h2;
+            h2 = highpass[2]*y-highpass[4]*z;
+
+            acc += z*z;
+        }
+
+        state[l] = s1; state[4+l] = s2; state[8+l] = h1; state[12+l] = h2;
+        energy[l] = acc;
+    }
+#endif
+    // decaying states would end up denormal in silence
+    for ( quint16 i = 0; i < 16; ++i )
+        if ( std::fabs(state[i]) < 1e-20f ) state[i] = 0;
+}
+
+float** LoudnessMeter::process(float** in, qint64 nsamples)
+{
+    auto nch    = qMin<quint16>( m_num_outputs, m_ngroups*4 );
+    auto peaks  = m_peaks.data();
+
+    if ( !m_subblock ) return in;
+
+    memset( peaks, 0, nsamples*sizeof(float) );
+    m_detector.process( in, nch, peaks, nsamples );
+
+    qint64 done = 0;
+
+    while ( done < nsamples )
+    {
+        quint32 n = qMin<qint64>( nsamples-done, m_subblock-m_pos );
+
+        for ( quint16 g = 0; g < m_ngroups; ++g )
+        {
+            const float* lanes[4];
+
+            for ( quint16 l = 0; l < 4; ++l )
+            {
+                quint16 c = g*4+l;
+                lanes[l] = c < nch ? in[c]+done : m_zeros.constData();
+            }
+
+            kweight( lanes, n, m_shelf, m_highpass, m_state.data()+g*16, m_energy.data()+g*4 );
+        }
+
+        m_peak = qMax( m_peak, simd::peak(peaks+done, n) );
+
+        done  += n;
+        m_pos += n;
+
+        if ( m_pos < m_subblock ) continue;
+
+        double energy = 0;
+
+        for ( int c = 0; c < m_energy.size(); ++c )
+        {
+            energy += m_channel_weights[c]*m_energy[c];
+            m_energy[c] = 0;
+        }
+
+        m_worker.push( LoudnessBlock { energy/m_subblock, m_peak } );
+
+        m_peak  = 0;
+        m_pos   = 0;
+    }
+
+    return in;
+}
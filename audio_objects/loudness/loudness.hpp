@@ -0,0 +1,160 @@
+#ifndef LOUDNESS_HPP
+#define LOUDNESS_HPP
+
+#include <source/audio/audio.hpp>
+#include <source/audio/ringbuffer.hpp>
+#include <source/audio/truepeak.hpp>
+#include <QThread>
+#include <QSemaphore>
+#include <QMutex>
+#include <atomic>
+
+#define LOUDNESS_FLOOR -120
+// in LUFS/dB, reported for silence
+
+#define LOUDNESS_GATE -70
+#define LOUDNESS_BINS 800
+// gating histograms, 0.1 LU bins from LOUDNESS_GATE up
+
+class LoudnessMeter;
+
+// K-weighted energy and true peak of a 100ms sub-block,
+// sent from the audio thread to the worker
+struct LoudnessBlock
+{
+    double energy;
+    float peak;
+};
+
+struct LoudnessValues
+{
+    qreal momentary     = LOUDNESS_FLOOR;
+    qreal short_term    = LOUDNESS_FLOOR;
+    qreal integrated    = LOUDNESS_FLOOR;
+    qreal range         = 0;
+    qreal true_peak     = LOUDNESS_FLOOR;
+};
+
+// gating and statistics, woken by the audio thread for each sub-block
+class LoudnessWorker : public QThread
+{
+    public:
+    LoudnessWorker ( LoudnessMeter& meter );
+    ~LoudnessWorker ( ) override;
+
+    void stop   ( );
+    void reset  ( );
+
+    // audio thread
+    void push   ( LoudnessBlock const& block );
+
+    LoudnessValues values ( );
+
+    protected:
+    void run ( ) override;
+
+    private:
+    struct Bin
+    {
+        quint64 count;
+        double energy;
+    };
+
+    void clear      ( );
+    void measure    ( LoudnessBlock const& block );
+    void publish    ( );
+
+    static void insert      ( Bin* histogram, double energy );
+    static double gated     ( Bin const* histogram, qreal threshold );
+    static qreal percentile ( Bin const* histogram, quint32 from, quint64 rank );
+
+    LoudnessMeter& m_meter;
+
+    Ringbuffer<LoudnessBlock> m_queue;
+    QSemaphore m_wake;
+    std::atomic<bool> m_quit { false };
+    std::atomic<bool> m_reset { false };
+
+    // last 3s of sub-blocks
+    double m_recent[30];
+    quint64 m_nblocks = 0;
+
+    Bin m_blocks[LOUDNESS_BINS];
+    Bin m_short_terms[LOUDNESS_BINS];
+    float m_peak = 0;
+
+    QMutex m_mutex;
+    LoudnessValues m_values;
+};
+
+// ITU-R BS.1770 / EBU R128 loudness of the node's input, passed through:
+// momentary (400ms), short-term (3s) and integrated (gated) loudness in LUFS,
+// loudness range (EBU Tech 3342) in LU and maximum true peak in dBTP,
+// updated every 100ms. 'weights' sets each channel's weighting,
+// defaulting to 1 (e.g. 1.41 for surround channels, 0 for an LFE).
+// the audio thread only filters and sums, in groups of four channels
+
+class LoudnessMeter : public StreamNode
+{
+    Q_OBJECT
+
+    Q_PROPERTY  ( QVariantList weights READ weights WRITE setWeights )
+    Q_PROPERTY  ( qreal momentary READ momentary NOTIFY loudnessChanged )
+    Q_PROPERTY  ( qreal shortTerm READ shortTerm NOTIFY loudnessChanged )
+    Q_PROPERTY  ( qreal integrated READ integrated NOTIFY loudnessChanged )
+    Q_PROPERTY  ( qreal range READ range NOTIFY loudnessChanged )
+    Q_PROPERTY  ( qreal truePeak READ truePeak NOTIFY loudnessChanged )
+
+    public:
+    LoudnessMeter();
+    ~LoudnessMeter();
+
+    virtual void componentComplete() override;
+    virtual void initialize(qint64) override;
+    virtual float** process(float**, qint64) override;
+
+    QVariantList weights ( ) const { return m_weights; }
+    void setWeights ( QVariantList weights );
+
+    qreal momentary     ( ) const { return m_values.momentary; }
+    qreal shortTerm     ( ) const { return m_values.short_term; }
+    qreal integrated    ( ) const { return m_values.integrated; }
+    qreal range         ( ) const { return m_values.range; }
+    qreal truePeak      ( ) const { return m_values.true_peak; }
+
+    // starts a new integration
+    Q_INVOKABLE void reset ( );
+
+    signals:
+    void loudnessChanged ( );
+
+    protected slots:
+    void onMeasured ( );
+
+    private:
+    void updateWeights ( );
+
+    LoudnessWorker m_worker;
+    LoudnessValues m_values;
+    QVariantList m_weights;
+
+    // K-weighting, pre-filter then RLB high-pass: b0, b1, b2, a1, a2
+    float m_shelf[5];
+    float m_highpass[5];
+
+    // [group*4+lane], lane = channel%4
+    QVector<float> m_channel_weights;
+    QVector<float> m_state;     // [group*16+stage*4+lane], two states per filter
+    QVector<float> m_energy;
+    QVector<float> m_zeros;
+    quint16 m_ngroups = 0;
+
+    QVector<float> m_peaks;
+    TruePeak m_detector;
+    float m_peak = 0;
+
+    quint32 m_subblock = 0;
+    quint32 m_pos = 0;
+};
+
+#endif // LOUDNESS_HPP
@@ -1,30 +1,47 @@
 #include "multisampler.hpp"
+#include <QtDebug>
 #include <cstdlib>
 
-Urn::Urn(quint16 size) : m_size(size) { }
+Urn::Urn(quint32 size) : m_size(size)
+{
+    m_deck.resize(size);
+    for ( quint32 i = 0; i < size; ++i )
+        m_deck[i] = i;
+
+    shuffle();
+}
 
-inline quint16 Urn::get()
+void Urn::shuffle()
 {
-    float rand = (float) std::rand()/RAND_MAX;
-    quint16 srand = m_size*rand;
+    // fisher-yates
+    for ( quint32 i = m_size; i > 1; --i )
+    {
+        quint32 j = std::rand() % i;
+        qSwap( m_deck[i-1], m_deck[j] );
+    }
 
-    return srand;
+    m_pos = 0;
 }
 
-quint16 Urn::draw()
+quint32 Urn::draw()
 {
-    if ( m_draws.size() == m_size )
-        m_draws.clear();
+    if ( !m_size ) return 0;
+
+    if ( m_pos == m_size )
+    {
+        auto last = m_deck[m_size-1];
+        shuffle();
 
-    auto draw = get();
-    while ( m_draws.contains(draw))
-        draw = get();
+        // avoid drawing the same index twice in a row
+        // across two cycles
+        if ( m_size > 1 && m_deck[0] == last )
+             qSwap( m_deck[0], m_deck[1+std::rand()%(m_size-1)] );
+    }
 
-    m_draws.push_back(draw);
-    return draw;
+    return m_deck[m_pos++];
 }
 
-MultiSampler::MultiSampler() : m_dir(nullptr)
+MultiSampler::MultiSampler() : m_dir(nullptr), m_triggers(MULTISAMPLER_MAX_TRIGGERS)
 {
     SETN_IN     ( 0 );
     SETN_OUT    ( 0 );
@@ -45,15 +62,38 @@ void MultiSampler::setPath(QString path)
     if ( m_dir ) delete m_dir;
 
     m_dir = new QDir(path);
-    m_dir->setNameFilters(QStringList{"*.wav"});
 
-    m_files = m_dir->entryList();
+    // headers come from the directory's index,
+    // only new or modified files are opened here
+    m_infos.clear();
+    m_files.clear();
+    m_index.clear();
+
+    for ( const auto& info : SampleIndex::scan(path, SampleIndex::filters(), m_analyze) )
+    {
+        // unreadable or unsupported files are left out
+        if ( !info.nchannels || !info.sample_rate )
+        {
+            qDebug() << "[MULTISAMPLER] skipping" << info.name;
+            continue;
+        }
+
+        m_infos << info;
+    }
+
+    m_index.reserve(m_infos.size());
 
-    for ( const auto& file : m_files )
+    for ( const auto& info : m_infos )
     {
+        const auto& file = info.name;
+        m_files << file;
+        m_index.insert(file, m_samplers.size());
+
         Sampler* sampler = new Sampler;
 
         sampler->setPath(m_path+"/"+file);
+        sampler->setStorage(m_storage);
+        sampler->setInfo(info);
         sampler->componentComplete();
         sampler->setActive(true);
 
@@ -63,10 +103,36 @@ void MultiSampler::setPath(QString path)
     }
 
     m_urn = Urn(m_files.size());
+    m_voices.reserve(m_samplers.size());
+    m_voiced.fill(false, m_samplers.size());
 
     emit filesChanged();
 }
 
+QVariantMap MultiSampler::info(QVariant file) const
+{
+    qint32 idx = -1;
+
+    if ( file.type() == QMetaType::Int )
+        idx = file.toInt();
+
+    else if ( file.type() == QMetaType::QString )
+        idx = m_index.value(file.toString(), -1);
+
+    if ( idx < 0 || idx >= m_infos.size() ) return QVariantMap();
+    return m_infos[idx].toMap();
+}
+
+void MultiSampler::setStorage(SampleFormat::Values storage)
+{
+    // set before 'path' to load directly in compact form,
+    // already loaded samplers are converted at initialization
+    m_storage = storage;
+
+    for ( const auto& sampler : m_samplers )
+          sampler->setStorage(storage);
+}
+
 void MultiSampler::initialize(qint64 nsamples)
 {
     for ( const auto& sampler : m_samplers )
@@ -74,6 +140,9 @@ void MultiSampler::initialize(qint64 nsamples)
         sampler->setActive(false);
         sampler->preinitialize(m_stream_properties);
     }
+
+    m_voices.clear();
+    m_voiced.fill(false, m_samplers.size());
 }
 
 void MultiSampler::expose(WPNNode* node)
@@ -100,50 +169,81 @@ void MultiSampler::expose(WPNNode* node)
 
 float** MultiSampler::process(float** buf, qint64 nsamples)
 {
-    auto out = m_out;
-    auto nout = m_num_outputs;
+    auto out    = m_out;
+    auto nout   = m_num_outputs;
+    qint32 index;
 
     StreamNode::resetBuffer(out, nout, nsamples);
 
-    for ( const auto& sampler : m_samplers )
+    // collect samplers that have been triggered since last block
+    while ( m_triggers.pop(index) )
+    {
+        if ( m_voiced[index] ) continue;
+        m_voiced[index] = true;
+        m_voices.push_back(index);
+    }
+
+    for ( qint32 v = 0; v < m_voices.size(); )
     {
-        if ( !sampler->active() ) continue;
+        auto sampler = m_samplers[m_voices[v]];
 
-        StreamNode::mergeBuffers( out, sampler->preprocess(nullptr, nsamples),
-                                 nout, sampler->numOutputs(), nsamples );
+        if ( sampler->active() )
+             StreamNode::mergeBuffers( out, sampler->preprocess(nullptr, nsamples),
+                                       nout, sampler->numOutputs(), nsamples );
+
+        if ( sampler->active() ) { ++v; continue; }
+
+        // voice has ended, swap-remove it from the list
+        m_voiced[m_voices[v]] = false;
+        m_voices[v] = m_voices.last();
+        m_voices.removeLast();
     }
 
     return out;
 }
 
+void MultiSampler::trigger(qint32 index)
+{
+    if ( index < 0 || index >= m_samplers.size() ) return;
+
+    // the trigger is dropped if the queue is full, rather than leaving
+    // a playing sampler that the audio thread doesn't know of.
+    // this is the only writer, so room can't be taken in between
+    if ( !m_triggers.writeAvailable() )
+    {
+        qDebug() << "[MULTISAMPLER] trigger queue full, dropping" << index;
+        return;
+    }
+
+    // started before being queued, so that it's active once popped
+    m_samplers[index]->play();
+    m_triggers.push(index);
+}
+
 void MultiSampler::play(QVariant variant)
 {
     if ( variant.type() == QMetaType::Int )
-        m_samplers[variant.toInt()]->play();
+        trigger(variant.toInt());
 
     else if ( variant.type() == QMetaType::QString )
-    {
-        auto idx = m_files.indexOf(variant.toString());
-        if ( idx < 0 ) return;
-        m_samplers[idx]->play();
-    }
+        trigger(m_index.value(variant.toString(), -1));
 }
 
 void MultiSampler::playRandom()
 {
-    play(m_urn.draw());
+    trigger(m_urn.draw());
 }
 
 void MultiSampler::stop(QVariant variant)
 {
+    qint32 idx = -1;
+
     if ( variant.type() == QMetaType::Int )
-        m_samplers[variant.toInt()]->stop();
+        idx = variant.toInt();
 
     else if ( variant.type() == QMetaType::QString )
-    {
-        auto idx = m_files.indexOf(variant.toString());
-        if ( idx < 0 ) return;
-        m_samplers[idx]->stop();
-    }
-}
+        idx = m_index.value(variant.toString(), -1);
 
+    if ( idx < 0 || idx >= m_samplers.size() ) return;
+    m_samplers[idx]->stop();
+}
@@ -3,19 +3,27 @@
 
 #include <source/audio/audio.hpp>
 #include <audio_objects/sampler/sampler.hpp>
+#include <source/audio/ringbuffer.hpp>
+#include <source/audio/sampleindex.hpp>
 #include <QDir>
+#include <QHash>
+
+#define MULTISAMPLER_MAX_TRIGGERS 512
 
 class Urn
 {
+    // shuffled deck: every index is drawn once per cycle,
+    // each draw is O(1), reshuffling once the deck is exhausted
     public:
     Urn() {}
-    Urn(quint16 size);
-    quint16 draw();
+    Urn(quint32 size);
+    quint32 draw();
 
     private:
-    quint16 get();
-    quint16 m_size;
-    QVector<quint16> m_draws;
+    void shuffle();
+    quint32 m_size  = 0;
+    quint32 m_pos   = 0;
+    QVector<quint32> m_deck;
 };
 
 class MultiSampler : public StreamNode
@@ -24,6 +32,8 @@ class MultiSampler : public StreamNode
 
     Q_PROPERTY  ( QString path READ path WRITE setPath )
     Q_PROPERTY  ( QStringList files READ files NOTIFY filesChanged )
+    Q_PROPERTY  ( SampleFormat::Values storage READ storage WRITE setStorage )
+    Q_PROPERTY  ( bool analyze READ analyze WRITE setAnalyze )
 
     public:
     MultiSampler();   
@@ -38,20 +48,43 @@ class MultiSampler : public StreamNode
 
     Q_INVOKABLE void stop(QVariant var);
 
+    // duration, channels, rate, format (and peak/loudness if analyzed)
+    // of a file, by index or name
+    Q_INVOKABLE QVariantMap info(QVariant file) const;
+
     QString path    ( ) const { return m_path; }
     void setPath    ( QString path );
 
     QStringList files() const { return m_files; }
 
+    SampleFormat::Values storage ( ) const { return m_storage; }
+    void setStorage ( SampleFormat::Values storage );
+
+    // set before 'path': peak and loudness are added to the index
+    bool analyze    ( ) const { return m_analyze; }
+    void setAnalyze ( bool analyze ) { m_analyze = analyze; }
+
     signals:
     void filesChanged();
 
     private:
+    void trigger(qint32 index);
+
     Urn m_urn;
     QDir* m_dir;
     QString m_path;
     QStringList m_files;
+    QHash<QString, qint32> m_index;
+    QVector<SampleInfo> m_infos;
+    bool m_analyze = false;
     QVector<Sampler*> m_samplers;
+    SampleFormat::Values m_storage = SampleFormat::Float32;
+
+    // audio thread only: indexes of the samplers currently playing,
+    // only these are visited by process()
+    QVector<qint32> m_voices;
+    QVector<bool> m_voiced;
+    Ringbuffer<qint32> m_triggers;
 };
 
 #endif // MULTISAMPLER_HPP
@@ -1,12 +1,11 @@
 #include "peakrms.hpp"
-#include <math.h>
+#include <source/audio/simd.hpp>
 #include <cmath>
-#include <QtDebug>
 
 PeakRMS::PeakRMS()
 {
     SETTYPE   ( StreamType::Effect );
-    qRegisterMetaType<QVector<float>>();
+    QObject::connect( &m_timer, SIGNAL(timeout()), this, SLOT(poll()) );
 }
 
 void PeakRMS::setSource(StreamNode* source)
@@ -17,92 +16,81 @@ void PeakRMS::setSource(StreamNode* source)
 void PeakRMS::setRefreshRate(qreal rate)
 {
     m_refresh_rate = rate;
+    m_timer.setInterval( 1000/qMax(rate, 1.0) );
 }
 
 void PeakRMS::componentComplete()
-{    
+{
+    m_timer.start( 1000/qMax(m_refresh_rate, 1.0) );
 }
 
 void PeakRMS::initialize(qint64 nsamples)
 {
-    m_block_size = SAMPLERATE/m_refresh_rate;
-    StreamNode::allocateBuffer(m_block, m_num_inputs, m_block_size);
-}
+    Q_UNUSED ( nsamples );
 
-void PeakRMS::bufferComplete()
-{
-    auto nout   = m_num_outputs;
-    auto pos    = m_pos;
-    auto block  = m_block;
-    auto bsize  = m_block_size;
+    auto nout = m_num_outputs;
+    m_ready.store( false );
 
-    QVector<float> max;
-    QVector<float> mean;
-    QVariantList peakvl;
-    QVariantList meanvl;
+    m_peaks.fill            ( 0, nout );
+    m_sums.fill             ( 0, nout );
+    m_mailbox_peaks.fill    ( 0, nout );
+    m_mailbox_sums.fill     ( 0, nout );
+    m_count = 0;
+}
 
-    max.fill   ( 0, nout );
-    mean.fill  ( 0, nout );
+float** PeakRMS::process(float** in, qint64 nsamples)
+{
+    auto nout = qMin<quint16>( m_num_outputs, m_peaks.size() );
 
     for ( quint16 ch = 0; ch < nout; ++ch )
     {
-        for ( quint16 s = 0; s < bsize; ++s )
-        {
-            max  [ ch ] = qMax  ( max[ch], block[ch][s] );
-            mean [ ch ] += pow  ( block[ch][s], 2 );
-        }
+        m_peaks [ ch ] = qMax( m_peaks[ch], simd::peak(in[ch], nsamples) );
+        m_sums  [ ch ] += simd::dot( in[ch], in[ch], nsamples );
+    }
 
-        mean[ch] = sqrt( 1.0/bsize*mean[ch] );
+    m_count += nsamples;
 
-        max  [ ch ]  = std::log10( max[ch]  ) *20.f;
-        mean [ ch ]  = std::log10( mean[ch] ) *20.f;
+    // the poller hasn't taken the previous values yet,
+    // keep accumulating until it does
+    if ( m_ready.load(std::memory_order_acquire) )
+        return in;
 
-        peakvl << max[ch];
-        meanvl << mean[ch];
+    for ( quint16 ch = 0; ch < nout; ++ch )
+    {
+        m_mailbox_peaks [ ch ] = m_peaks[ch];
+        m_mailbox_sums  [ ch ] = m_sums[ch];
+        m_peaks         [ ch ] = 0;
+        m_sums          [ ch ] = 0;
     }
 
-    emit peak ( peakvl );
-    emit rms  ( meanvl );
+    m_mailbox_count = m_count;
+    m_count = 0;
 
+    m_ready.store( true, std::memory_order_release );
+    return in;
 }
 
-float** PeakRMS::process(float** in, qint64 nsamples)
+inline qreal decibels(qreal value)
 {
-    auto nout   = m_num_outputs;
-    auto pos    = m_pos;
-    auto block  = m_block;
-    auto bsize  = m_block_size;
-
-    qint32 rest = bsize-(pos+nsamples);
+    return value > 0 ? qMax<qreal>( 20*std::log10(value), PEAKRMS_FLOOR ) : PEAKRMS_FLOOR;
+}
 
-    if ( rest > 0 )
-    {
-        for ( quint16 ch = 0; ch < nout; ++ch )
-            for ( quint32 s = 0; s < nsamples; ++s )
-                m_block[ch][m_pos+s] = in[ch][s];
+void PeakRMS::poll()
+{
+    if ( !m_ready.load(std::memory_order_acquire) )
+         return;
 
-        m_pos += nsamples;
-    }
+    QVariantList peakvl;
+    QVariantList meanvl;
 
-    else
+    for ( int ch = 0; ch < m_mailbox_peaks.size(); ++ch )
     {
-        for ( quint16 ch = 0; ch < nout; ++ch )
-            for ( quint32 s = 0; s < nsamples+rest; ++s )
-                m_block[ch][m_pos+s] = in[ch][s];
-
-        // dispatch buffer
-        bufferComplete();
-
-        // reset buffer and start filling again
-        // with the rest of the current block
-        StreamNode::resetBuffer(block, nout, bsize);
-
-        for ( quint16 ch = 0; ch < nout; ++ch )
-            for ( quint32 s = 0; s < -rest; ++s )
-                m_block[ch][s] = in[ch][nsamples+rest+s];
-
-        m_pos = -rest;
+        peakvl << decibels( m_mailbox_peaks[ch] );
+        meanvl << decibels( std::sqrt(m_mailbox_sums[ch]/qMax<quint64>(m_mailbox_count, 1)) );
     }
 
-    return in;
+    m_ready.store( false, std::memory_order_release );
+
+    emit peak ( peakvl );
+    emit rms  ( meanvl );
 }
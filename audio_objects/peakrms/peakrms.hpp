@@ -2,6 +2,17 @@
 #define PEAKRMS_HPP
 
 #include <source/audio/audio.hpp>
+#include <QTimer>
+#include <atomic>
+
+#define PEAKRMS_FLOOR -120
+// in dB, reported for silence
+
+// the audio thread only reduces each block to a peak and a sum of
+// squares per channel, and hands them over through a mailbox whenever
+// the previous values were taken. 'peak' and 'rms' (dB, one value
+// per channel) are emitted from the object's thread, 'refreshRate'
+// times per second, over everything since the previous emission
 
 class PeakRMS : public StreamNode
 {
@@ -27,15 +38,25 @@ class PeakRMS : public StreamNode
     void rms  ( QVariant value );
     void peak ( QVariant value );
 
-    protected:
-    void bufferComplete();
+    protected slots:
+    void poll();
 
     private:
     StreamNode* m_source = nullptr;
     qreal m_refresh_rate = 20;
-    quint32 m_block_size = 0;
-    float** m_block = nullptr;
-    quint32 m_pos = 0;
+    QTimer m_timer;
+
+    // audio thread
+    QVector<float> m_peaks;
+    QVector<double> m_sums;
+    quint64 m_count = 0;
+
+    // written by the audio thread while 'm_ready' is false,
+    // read by the poller while it is true
+    QVector<float> m_mailbox_peaks;
+    QVector<double> m_mailbox_sums;
+    quint64 m_mailbox_count = 0;
+    std::atomic<bool> m_ready { false };
 };
 
 #endif // PEAKRMS_HPP
@@ -0,0 +1,357 @@
+#include "recorder.hpp"
+#include <source/audio/simd.hpp>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QtDebug>
+#include <qendian.h>
+
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#endif
+
+RecorderWriter::RecorderWriter(Recorder& recorder) : m_recorder(recorder)
+{
+
+}
+
+RecorderWriter::~RecorderWriter()
+{
+    delete m_file;
+}
+
+// previous takes are never overwritten: name-1.wav, name-2.wav...
+inline QString take_path(QString path)
+{
+    QFileInfo info ( path );
+    if ( !info.exists() ) return path;
+
+    QString base    = info.completeBaseName();
+    QString suffix  = info.suffix().isEmpty() ? QString() : "."+info.suffix();
+
+    for ( quint32 n = 1;; ++n )
+    {
+        QString candidate = info.dir().filePath( QString("%1-%2%3").arg(base).arg(n).arg(suffix) );
+        if ( !QFileInfo::exists(candidate) ) return candidate;
+    }
+}
+
+void RecorderWriter::start(QString path, quint16 nchannels, quint32 sample_rate, int format)
+{
+    if ( m_file ) stop();
+
+    path    = take_path( path );
+    m_file  = new QFile(path);
+
+    if ( !m_file->open(QIODevice::WriteOnly) )
+    {
+        qDebug() << "[RECORDER]" << path << m_file->errorString();
+        delete m_file;
+        m_file = nullptr;
+        return;
+    }
+
+    if ( !m_timer )
+    {
+        m_timer = new QTimer(this);
+        QObject::connect(m_timer, SIGNAL(timeout()), this, SLOT(drain()));
+    }
+
+    m_nchannels     = nchannels;
+    m_sample_rate   = sample_rate;
+    m_format        = format;
+    m_data_bytes    = 0;
+    m_allocated     = 0;
+    m_last_header   = QDateTime::currentMSecsSinceEpoch();
+    m_samples.resize( 8192*nchannels );
+
+    // discard what may remain from a previous take
+    auto& ring = m_recorder.m_ring;
+    while ( ring.pop(m_samples.data(), m_samples.size()) );
+    m_recorder.m_dropped.store(0);
+
+    reserve     ( 0 );
+    writeHeader ( );
+
+    m_timer->start( RECORDER_DRAIN_INTERVAL );
+    m_recorder.m_armed.store( true, std::memory_order_release );
+
+    qDebug() << "[RECORDER] recording to" << path;
+}
+
+void RecorderWriter::stop()
+{
+    if ( !m_file ) return;
+
+    m_timer->stop();
+    drain();
+
+    // trim the preallocated extent, chunks are padded to an even size
+    if ( m_data_bytes & 1 )
+    {
+        m_file->seek( RECORDER_HEADER_SIZE+m_data_bytes );
+        m_file->write( "\0", 1 );
+    }
+
+    writeHeader();
+    m_file->resize( RECORDER_HEADER_SIZE+m_data_bytes+(m_data_bytes & 1) );
+    m_file->close();
+
+    delete m_file;
+    m_file = nullptr;
+
+    quint64 frame_bytes = m_nchannels*(m_format == (int) Recorder::Format::Int24 ? 3 : 4);
+    emit progress( m_data_bytes/frame_bytes, m_recorder.m_dropped.load() );
+}
+
+void RecorderWriter::drain()
+{
+    if ( !m_file ) return;
+
+    auto& ring          = m_recorder.m_ring;
+    bool int24          = m_format == (int) Recorder::Format::Int24;
+    quint64 frame_bytes = m_nchannels*(int24 ? 3 : 4);
+    quint64 n;
+
+    while ( (n = ring.pop(m_samples.data(), m_samples.size())) )
+    {
+        const char* data;
+        quint64 nbytes;
+
+        if ( int24 )
+        {
+            m_bytes.resize( n*3 );
+            simd::to_int24( (quint8*) m_bytes.data(), m_samples.constData(), n );
+            data    = m_bytes.constData();
+            nbytes  = n*3;
+        }
+        else
+        {
+            data    = (const char*) m_samples.constData();
+            nbytes  = n*sizeof(float);
+        }
+
+        reserve( m_data_bytes+nbytes );
+        m_file->seek( RECORDER_HEADER_SIZE+m_data_bytes );
+        m_file->write( data, nbytes );
+        m_data_bytes += nbytes;
+    }
+
+    auto now = QDateTime::currentMSecsSinceEpoch();
+
+    if ( now-m_last_header >= RECORDER_HEADER_INTERVAL )
+    {
+        writeHeader();
+        m_last_header = now;
+        emit progress( m_data_bytes/frame_bytes, m_recorder.m_dropped.load() );
+    }
+}
+
+void RecorderWriter::reserve(quint64 nbytes)
+{
+    quint64 needed = RECORDER_HEADER_SIZE+nbytes;
+    if ( needed <= m_allocated ) return;
+
+    quint64 size = (needed/RECORDER_EXTENT+1)*RECORDER_EXTENT;
+
+#ifdef Q_OS_LINUX
+    // actually allocate the blocks, so that writes
+    // don't have to wait for the filesystem to find room
+    m_file->flush();
+    if ( posix_fallocate(m_file->handle(), m_allocated, size-m_allocated) != 0 )
+         m_file->resize( size );
+#else
+    m_file->resize( size );
+#endif
+
+    m_allocated = size;
+}
+
+inline void put16(char* dst, quint16 v) { qToLittleEndian<quint16>(v, (uchar*) dst); }
+inline void put32(char* dst, quint32 v) { qToLittleEndian<quint32>(v, (uchar*) dst); }
+inline void put64(char* dst, quint64 v) { qToLittleEndian<quint64>(v, (uchar*) dst); }
+
+void RecorderWriter::writeHeader()
+{
+    // the header has a fixed size: JUNK is turned into ds64
+    // once the file doesn't fit in a RIFF anymore
+    bool int24          = m_format == (int) Recorder::Format::Int24;
+    quint16 bits        = int24 ? 24 : 32;
+    quint16 align       = m_nchannels*bits/8;
+    quint64 riff_size   = RECORDER_HEADER_SIZE-8+m_data_bytes+(m_data_bytes & 1);
+    bool rf64           = riff_size > 0xffffffff;
+
+    QByteArray header ( RECORDER_HEADER_SIZE, 0 );
+    char* h = header.data();
+
+    memcpy  ( h, rf64 ? "RF64" : "RIFF", 4 );
+    put32   ( h+4, rf64 ? 0xffffffff : riff_size );
+    memcpy  ( h+8, "WAVE", 4 );
+
+    memcpy  ( h+12, rf64 ? "ds64" : "JUNK", 4 );
+    put32   ( h+16, 28 );
+
+    if ( rf64 )
+    {
+        put64 ( h+20, riff_size );
+        put64 ( h+28, m_data_bytes );
+        put64 ( h+36, m_data_bytes/align );
+    }
+
+    // WAVE_FORMAT_EXTENSIBLE
+    memcpy  ( h+48, "fmt ", 4 );
+    put32   ( h+52, 40 );
+    put16   ( h+56, 0xfffe );
+    put16   ( h+58, m_nchannels );
+    put32   ( h+60, m_sample_rate );
+    put32   ( h+64, m_sample_rate*align );
+    put16   ( h+68, align );
+    put16   ( h+70, bits );
+    put16   ( h+72, 22 );
+    put16   ( h+74, bits );
+    put32   ( h+76, 0 );
+    put16   ( h+80, int24 ? 0x0001 : 0x0003 );
+    memcpy  ( h+82, "\x00\x00\x00\x00\x10\x00\x80\x00\x00\xAA\x00\x38\x9B\x71", 14 );
+
+    memcpy  ( h+96, "data", 4 );
+    put32   ( h+100, rf64 ? 0xffffffff : m_data_bytes );
+
+    m_file->seek  ( 0 );
+    m_file->write ( header );
+    m_file->flush ( );
+}
+
+//-------------------------------------------------------------------------------------------------
+
+Recorder::Recorder() : StreamNode()
+{
+    SETTYPE( StreamType::Effect );
+}
+
+Recorder::~Recorder()
+{
+    m_armed.store(false);
+
+    if ( m_writer && m_writer_thread.isRunning() )
+         QMetaObject::invokeMethod( m_writer, "stop", Qt::BlockingQueuedConnection );
+
+    m_writer_thread.quit();
+    m_writer_thread.wait();
+
+    delete m_writer;
+    delete [ ] m_interleaved;
+}
+
+void Recorder::componentComplete()
+{
+    m_writer = new RecorderWriter(*this);
+    m_writer->moveToThread(&m_writer_thread);
+
+    QObject::connect(this, SIGNAL(startWriter(QString,quint16,quint32,int)),
+                     m_writer, SLOT(start(QString,quint16,quint32,int)));
+    QObject::connect(this, SIGNAL(stopWriter()), m_writer, SLOT(stop()));
+    QObject::connect(m_writer, SIGNAL(progress(quint64,quint64)),
+                     this, SLOT(onProgress(quint64,quint64)));
+
+    m_writer_thread.start( QThread::LowPriority );
+}
+
+void Recorder::preinitialize(StreamProperties properties)
+{
+    // unless specified, record as many channels as the node it is inserted into
+    if ( !m_num_inputs )
+    {
+        if ( auto parent = qobject_cast<StreamNode*>(QObject::parent()) )
+             SETN_IN( parent->numOutputs() );
+    }
+
+    SETN_OUT ( m_num_inputs );
+    StreamNode::preinitialize(properties);
+}
+
+void Recorder::initialize(qint64 nsamples)
+{
+    m_armed.store(false);
+
+    // the writer may still be draining the ring:
+    // the current take is closed before the ring is reallocated
+    if ( m_writer && m_writer_thread.isRunning() )
+         QMetaObject::invokeMethod( m_writer, "stop", Qt::BlockingQueuedConnection );
+
+    m_ring.allocate( (quint64) m_buffer*SAMPLERATE/1000*m_num_inputs );
+
+    delete [ ] m_interleaved;
+    m_interleaved = new float[ nsamples*m_num_inputs ]();
+
+    if ( m_recording )
+         emit startWriter( m_path, m_num_inputs, SAMPLERATE, (int) m_format );
+}
+
+float** Recorder::process(float** in, qint64 le)
+{
+    // pass-through, the block is copied only when the writer is ready
+    if ( !m_armed.load(std::memory_order_acquire) )
+         return in;
+
+    auto nch = m_num_inputs;
+    auto dst = m_interleaved;
+
+    for ( qint64 s = 0; s < le; ++s )
+        for ( quint16 ch = 0; ch < nch; ++ch )
+            *dst++ = in[ch][s];
+
+    if ( !m_ring.push(m_interleaved, le*nch) )
+         m_dropped.fetch_add(1, std::memory_order_relaxed);
+
+    return in;
+}
+
+void Recorder::setPath(QString path)
+{
+    m_path = path;
+}
+
+void Recorder::setFormat(Format format)
+{
+    m_format = format;
+}
+
+void Recorder::setBuffer(quint32 buffer)
+{
+    // takes effect when the stream is (re)initialized
+    m_buffer = qMax<quint32>(100, buffer);
+}
+
+void Recorder::setRecording(bool recording)
+{
+    if ( recording == m_recording ) return;
+
+    m_recording = recording;
+    emit recordingChanged();
+
+    // not initialized yet: writer will be started from initialize()
+    if ( !SAMPLERATE ) return;
+
+    if ( recording )
+         emit startWriter( m_path, m_num_inputs, SAMPLERATE, (int) m_format );
+    else
+    {
+        m_armed.store(false, std::memory_order_release);
+        emit stopWriter();
+    }
+}
+
+void Recorder::onProgress(quint64 nframes, quint64 dropped)
+{
+    if ( SAMPLERATE )
+    {
+        m_duration = (qreal) nframes/SAMPLERATE;
+        emit durationChanged();
+    }
+
+    if ( dropped != m_dropped_blocks )
+    {
+        m_dropped_blocks = dropped;
+        emit droppedChanged();
+    }
+}
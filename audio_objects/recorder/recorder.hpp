@@ -0,0 +1,136 @@
+#ifndef RECORDER_HPP
+#define RECORDER_HPP
+
+#include <source/audio/audio.hpp>
+#include <source/audio/ringbuffer.hpp>
+#include <QFile>
+#include <QThread>
+#include <QTimer>
+#include <atomic>
+#include <climits>
+
+#define RECORDER_BUFFER_DEFAULT 2000
+// in milliseconds, amount of audio the ring can hold before dropping blocks
+#define RECORDER_DRAIN_INTERVAL 20
+#define RECORDER_HEADER_INTERVAL 1000
+// in milliseconds
+#define RECORDER_EXTENT 67108864
+// in bytes, file is grown by preallocated extents
+#define RECORDER_HEADER_SIZE 104
+// RIFF + JUNK/ds64 + extensible 'fmt ' + 'data' header
+
+class Recorder;
+
+// drains the recorder's ring from its own thread,
+// the file is written as RIFF/WAVE and switched to RF64
+// when it grows past 4GB. header is rewritten periodically
+// so that the file stays readable if the program crashes.
+// an existing file is never overwritten, the take is numbered instead
+
+class RecorderWriter : public QObject
+{
+    Q_OBJECT
+
+    public:
+    RecorderWriter ( Recorder& recorder );
+    ~RecorderWriter ( );
+
+    public slots:
+    void start  ( QString path, quint16 nchannels, quint32 sample_rate, int format );
+    void stop   ( );
+    void drain  ( );
+
+    signals:
+    void progress ( quint64 nframes, quint64 dropped );
+
+    private:
+    void writeHeader ( );
+    void reserve     ( quint64 nbytes );
+
+    Recorder& m_recorder;
+    QFile* m_file       = nullptr;
+    QTimer* m_timer     = nullptr;
+    QVector<float> m_samples;
+    QByteArray m_bytes;
+
+    quint16 m_nchannels     = 0;
+    quint32 m_sample_rate   = 0;
+    int m_format            = 0;
+    quint64 m_data_bytes    = 0;
+    quint64 m_allocated     = 0;
+    qint64 m_last_header    = 0;
+};
+
+class Recorder : public StreamNode
+{
+    Q_OBJECT
+
+    Q_PROPERTY  ( QString path READ path WRITE setPath )
+    Q_PROPERTY  ( Format format READ format WRITE setFormat )
+    Q_PROPERTY  ( int buffer READ buffer WRITE setBuffer )
+    Q_PROPERTY  ( bool recording READ recording WRITE setRecording NOTIFY recordingChanged )
+    Q_PROPERTY  ( qreal duration READ duration NOTIFY durationChanged )
+    Q_PROPERTY  ( int dropped READ dropped NOTIFY droppedChanged )
+
+    friend class RecorderWriter;
+
+    public:
+    Recorder();
+    ~Recorder() override;
+
+    enum class Format
+    {
+        Float32     = 0,
+        Int24       = 1
+    };
+
+    Q_ENUM ( Format )
+
+    virtual void componentComplete() override;
+    virtual void preinitialize ( StreamProperties properties ) override;
+    virtual void initialize ( qint64 ) override;
+    virtual float** process ( float**, qint64 le ) override;
+
+    QString path        ( ) const { return m_path; }
+    Format format       ( ) const { return m_format; }
+    quint32 buffer      ( ) const { return m_buffer; }
+    bool recording      ( ) const { return m_recording; }
+    qreal duration      ( ) const { return m_duration; }
+    int dropped         ( ) const { return qMin<quint64>( m_dropped_blocks, INT_MAX ); }
+
+    void setPath        ( QString path );
+    void setFormat      ( Format format );
+    void setBuffer      ( quint32 buffer );
+    void setRecording   ( bool recording );
+
+    signals:
+    void recordingChanged   ( );
+    void durationChanged    ( );
+    void droppedChanged     ( );
+
+    void startWriter    ( QString path, quint16 nchannels, quint32 sample_rate, int format );
+    void stopWriter     ( );
+
+    public slots:
+    void onProgress ( quint64 nframes, quint64 dropped );
+
+    private:
+    RecorderWriter* m_writer = nullptr;
+    QThread m_writer_thread;
+
+    // audio thread -> writer thread
+    Ringbuffer<float> m_ring;
+    float* m_interleaved = nullptr;
+    std::atomic<bool> m_armed { false };
+    std::atomic<quint64> m_dropped { 0 };
+
+    // properties
+    QString m_path;
+    Format m_format         = Format::Float32;
+    quint32 m_buffer        = RECORDER_BUFFER_DEFAULT;
+    bool m_recording        = false;
+    qreal m_duration        = 0;
+    quint64 m_dropped_blocks = 0;
+};
+
+#endif // RECORDER_HPP
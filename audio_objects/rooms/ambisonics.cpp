@@ -0,0 +1,200 @@
+#include "ambisonics.hpp"
+#include <cmath>
+
+// associated legendre functions P_n^m(x), without the condon-shortley phase,
+// for n <= order and 0 <= m <= n, stored at [n*(order+1)+m]
+static void legendre(quint16 order, double x, double* p)
+{
+    double s = std::sqrt( qMax(0.0, 1.0-x*x) );
+    quint16 stride = order+1;
+
+    double pmm = 1.0;
+
+    for ( quint16 m = 0; m <= order; ++m )
+    {
+        if ( m > 0 ) pmm *= (2*m-1)*s;
+        p[m*stride+m] = pmm;
+
+        if ( m+1 <= order )
+             p[(m+1)*stride+m] = x*(2*m+1)*pmm;
+
+        for ( quint16 n = m+2; n <= order; ++n )
+            p[n*stride+m] = ((2*n-1)*x*p[(n-1)*stride+m]-(n+m-1)*p[(n-2)*stride+m])/(n-m);
+    }
+}
+
+static double factorial(quint16 n)
+{
+    double f = 1.0;
+    for ( quint16 i = 2; i <= n; ++i ) f *= i;
+    return f;
+}
+
+// real SN3D harmonics of a direction, ACN ordering
+static void harmonics(quint16 order, QVector3D direction, double* y)
+{
+    double p [ (HOA_MAX_ORDER+1)*(HOA_MAX_ORDER+1) ];
+
+    // +y is the front, as in SpeakerRing, +z is up
+    double azimuth      = std::atan2( -direction.x(), direction.y() );
+    double elevation    = std::atan2( direction.z(), std::hypot(direction.x(), direction.y()) );
+
+    legendre( order, std::sin(elevation), p );
+
+    for ( qint16 n = 0; n <= order; ++n )
+    {
+        for ( qint16 m = -n; m <= n; ++m )
+        {
+            quint16 am  = std::abs(m);
+            double norm = std::sqrt( (m ? 2.0 : 1.0)*factorial(n-am)/factorial(n+am) );
+            double trig = m >= 0 ? std::cos(am*azimuth) : std::sin(am*azimuth);
+
+            y[n*n+n+m] = norm*p[n*(order+1)+am]*trig;
+        }
+    }
+}
+
+void hoa::encode(quint16 order, QVector3D direction, float spread, float* coeffs)
+{
+    quint16 nch = nchannels(order);
+
+    if ( direction.lengthSquared() < 1e-12f )
+    {
+        // at the center: omnidirectional
+        coeffs[0] = 1.f;
+        for ( quint16 k = 1; k < nch; ++k ) coeffs[k] = 0.f;
+        return;
+    }
+
+    double y [ (HOA_MAX_ORDER+1)*(HOA_MAX_ORDER+1) ];
+    harmonics( order, direction, y );
+
+    double keep = 1.0-qBound(0.f, spread, 1.f);
+    double w    = 1.0;
+
+    for ( quint16 n = 0; n <= order; ++n, w *= keep )
+        for ( quint16 k = n*n; k < (n+1)*(n+1); ++k )
+            coeffs[k] = y[k]*w;
+}
+
+// in-place gauss-jordan inversion of a square matrix, partial pivoting
+static bool invert(QVector<double>& a, quint16 n)
+{
+    QVector<double> inv ( n*n, 0.0 );
+    for ( quint16 i = 0; i < n; ++i ) inv[i*n+i] = 1.0;
+
+    for ( quint16 col = 0; col < n; ++col )
+    {
+        quint16 pivot = col;
+        for ( quint16 r = col+1; r < n; ++r )
+            if ( std::fabs(a[r*n+col]) > std::fabs(a[pivot*n+col]) ) pivot = r;
+
+        if ( std::fabs(a[pivot*n+col]) < 1e-12 ) return false;
+
+        for ( quint16 c = 0; c < n; ++c )
+        {
+            qSwap( a[col*n+c], a[pivot*n+c] );
+            qSwap( inv[col*n+c], inv[pivot*n+c] );
+        }
+
+        double d = a[col*n+col];
+
+        for ( quint16 c = 0; c < n; ++c )
+        {
+            a[col*n+c]   /= d;
+            inv[col*n+c] /= d;
+        }
+
+        for ( quint16 r = 0; r < n; ++r )
+        {
+            if ( r == col ) continue;
+            double f = a[r*n+col];
+            if ( f == 0.0 ) continue;
+
+            for ( quint16 c = 0; c < n; ++c )
+            {
+                a[r*n+c]   -= f*a[col*n+c];
+                inv[r*n+c] -= f*inv[col*n+c];
+            }
+        }
+    }
+
+    a = inv;
+    return true;
+}
+
+QVector<float> hoa::decoder(quint16 order, QVector<QVector3D> const& speakers)
+{
+    quint16 nch = nchannels(order);
+    quint16 nspk = speakers.size();
+
+    // Y: nch x nspk, harmonics of each speaker's direction
+    QVector<double> y ( nch*nspk );
+    double h [ (HOA_MAX_ORDER+1)*(HOA_MAX_ORDER+1) ];
+
+    for ( quint16 l = 0; l < nspk; ++l )
+    {
+        harmonics( order, speakers[l], h );
+        for ( quint16 k = 0; k < nch; ++k ) y[k*nspk+l] = h[k];
+    }
+
+    // D = Y^T (Y Y^T + lambda I)^-1, regularized for irregular
+    // or incomplete (e.g. horizontal only) layouts
+    QVector<double> g ( nch*nch, 0.0 );
+    double trace = 0;
+
+    for ( quint16 i = 0; i < nch; ++i )
+    {
+        for ( quint16 j = 0; j < nch; ++j )
+        {
+            double sum = 0;
+            for ( quint16 l = 0; l < nspk; ++l ) sum += y[i*nspk+l]*y[j*nspk+l];
+            g[i*nch+j] = sum;
+        }
+
+        trace += g[i*nch+i];
+    }
+
+    double lambda = 1e-2*trace/nch+1e-9;
+    for ( quint16 i = 0; i < nch; ++i ) g[i*nch+i] += lambda;
+
+    QVector<float> d ( nspk*nch, 0.f );
+    if ( !nspk || !invert(g, nch) ) return d;
+
+    // max-rE weights, per order
+    double p [ (HOA_MAX_ORDER+1)*(HOA_MAX_ORDER+1) ];
+    legendre( order, std::cos(137.9*M_PI/180.0/(order+1.51)), p );
+
+    for ( quint16 l = 0; l < nspk; ++l )
+    {
+        for ( quint16 k = 0; k < nch; ++k )
+        {
+            double sum = 0;
+            for ( quint16 j = 0; j < nch; ++j ) sum += y[j*nspk+l]*g[j*nch+k];
+
+            quint16 n = std::sqrt(k);
+            d[l*nch+k] = sum*p[n*(order+1)];
+        }
+    }
+
+    // unit energy, on average, for sources in the speakers' directions
+    double energy = 0;
+
+    for ( quint16 src = 0; src < nspk; ++src )
+    {
+        for ( quint16 l = 0; l < nspk; ++l )
+        {
+            double gain = 0;
+            for ( quint16 k = 0; k < nch; ++k ) gain += d[l*nch+k]*y[k*nspk+src];
+            energy += gain*gain;
+        }
+    }
+
+    if ( energy > 0 )
+    {
+        float scale = std::sqrt( nspk/energy );
+        for ( auto& coeff : d ) coeff *= scale;
+    }
+
+    return d;
+}
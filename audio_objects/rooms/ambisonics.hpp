@@ -0,0 +1,28 @@
+#ifndef AMBISONICS_HPP
+#define AMBISONICS_HPP
+
+#include <QVector>
+#include <QVector3D>
+
+#define HOA_MAX_ORDER 5
+
+// real spherical harmonics, ACN channel ordering, SN3D normalization.
+// directions are given as vectors from the listener (room's center),
+// only their orientation matters
+
+namespace hoa
+{
+
+inline quint16 nchannels(quint16 order) { return (order+1)*(order+1); }
+
+// fills the nchannels(order) encoding gains of a source in 'direction'.
+// 'spread' in [0, 1] attenuates the higher orders, 1 is omnidirectional
+void encode ( quint16 order, QVector3D direction, float spread, float* coeffs );
+
+// mode-matching decoder (regularized pseudo-inverse) with max-rE weighting,
+// returns a nspeakers x nchannels(order) matrix, row-major
+QVector<float> decoder ( quint16 order, QVector<QVector3D> const& speakers );
+
+}
+
+#endif // AMBISONICS_HPP
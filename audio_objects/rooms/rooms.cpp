@@ -1,6 +1,17 @@
 #include "rooms.hpp"
+#include "ambisonics.hpp"
+#include <source/audio/simd.hpp>
 #include <cmath>
+#include <cfloat>
 #include <QtDebug>
+#include <QMutex>
+#include <QMutexLocker>
+
+// coefficients have a single producer at a time: the object's thread
+// (sources and speakers moving) or the stream's initialization,
+// which also covers the speaker and gain grids they share.
+// recursive, as computeCoeffs is also called from initialize
+static QMutex g_control ( QMutex::Recursive );
 
 SpeakerArea::SpeakerArea()
 {
@@ -79,7 +90,9 @@ Speaker::~Speaker()
     delete m_vertical_area;
 }
 
-Speaker::Speaker(QVector3D position) : m_position(position)
+Speaker::Speaker(QVector3D position) : m_position(position),
+    m_horizontal_area(new SpeakerArea),
+    m_vertical_area(new SpeakerArea)
 {
 
 }
@@ -367,10 +380,242 @@ RoomSetup::~RoomSetup()
           delete node;
 }
 
+void RoomSetup::onSpeakerChanged()
+{
+    QMutexLocker lock ( &g_control );
+    m_grid.invalidate();
+    m_gains.invalidate();
+
+    emit speakersChanged();
+}
+
 void RoomSetup::componentComplete()
 {
     for ( const auto& node : m_nodes )
         m_speakers.append(node->getSpeakers());
+
+    // speaker grid is rebuilt once one of them moves or changes its influence
+    for ( const auto& speaker : m_speakers )
+    {
+        QObject::connect( speaker, SIGNAL(positionChanged()), this, SLOT(onSpeakerChanged()) );
+        QObject::connect( speaker, SIGNAL(xChanged()), this, SLOT(onSpeakerChanged()) );
+        QObject::connect( speaker, SIGNAL(yChanged()), this, SLOT(onSpeakerChanged()) );
+        QObject::connect( speaker, SIGNAL(zChanged()), this, SLOT(onSpeakerChanged()) );
+        QObject::connect( speaker->horizontalArea(), SIGNAL(radiusChanged()), this, SLOT(onSpeakerChanged()) );
+        QObject::connect( speaker->verticalArea(), SIGNAL(radiusChanged()), this, SLOT(onSpeakerChanged()) );
+    }
+
+    QMutexLocker lock ( &g_control );
+    m_grid.setSpeakers(m_speakers);
+    m_gains.setSpeakers(m_speakers);
+    m_gains.refresh();
+}
+
+void RoomSetup::setGainResolution(quint16 resolution)
+{
+    resolution = qMin<quint16>( resolution, ROOMS_GAINS_MAX_RES );
+    if ( resolution == m_gains.resolution() ) return;
+
+    {
+        QMutexLocker lock ( &g_control );
+        m_gains.setResolution( resolution );
+    }
+
+    emit gainResolutionChanged();
+
+    // sources are given gains from the new lattice right away
+    emit speakersChanged();
+}
+
+//---------------------------------------------------------------------------------------------------------
+
+void SpeakerGrid::setSpeakers(QVector<Speaker*> const& speakers)
+{
+    m_speakers  = speakers;
+    m_dirty     = true;
+}
+
+inline int grid_cell(float v, float min, float scale, int res)
+{
+    return qBound( 0, (int) std::floor((v-min)*scale), res-1 );
+}
+
+void SpeakerGrid::refresh()
+{
+    if ( !m_dirty ) return;
+    m_dirty = false;
+
+    m_cells.fill( QVector<quint16>(), ROOMS_GRID_RES*ROOMS_GRID_RES*ROOMS_GRID_RES_Z );
+    if ( m_speakers.isEmpty() ) return;
+
+    // bounds of the influence boxes
+    m_min = QVector3D(  FLT_MAX,  FLT_MAX,  FLT_MAX );
+    m_max = QVector3D( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+
+    for ( const auto& speaker : m_speakers )
+    {
+        float rh = speaker->horizontalArea()->radius();
+        float rv = speaker->verticalArea()->radius();
+        QVector3D reach ( rh, rh, rv );
+
+        auto lo = speaker->position()-reach;
+        auto hi = speaker->position()+reach;
+
+        m_min = QVector3D( qMin(m_min.x(), lo.x()), qMin(m_min.y(), lo.y()), qMin(m_min.z(), lo.z()) );
+        m_max = QVector3D( qMax(m_max.x(), hi.x()), qMax(m_max.y(), hi.y()), qMax(m_max.z(), hi.z()) );
+    }
+
+    auto extent = m_max-m_min;
+    m_scale = QVector3D( extent.x() > 0 ? ROOMS_GRID_RES/extent.x() : 0,
+                         extent.y() > 0 ? ROOMS_GRID_RES/extent.y() : 0,
+                         extent.z() > 0 ? ROOMS_GRID_RES_Z/extent.z() : 0 );
+
+    for ( quint16 spk = 0; spk < m_speakers.size(); ++spk )
+    {
+        auto speaker = m_speakers[spk];
+        float rh = speaker->horizontalArea()->radius();
+        float rv = speaker->verticalArea()->radius();
+        auto p   = speaker->position();
+
+        int x0 = grid_cell( p.x()-rh, m_min.x(), m_scale.x(), ROOMS_GRID_RES );
+        int x1 = grid_cell( p.x()+rh, m_min.x(), m_scale.x(), ROOMS_GRID_RES );
+        int y0 = grid_cell( p.y()-rh, m_min.y(), m_scale.y(), ROOMS_GRID_RES );
+        int y1 = grid_cell( p.y()+rh, m_min.y(), m_scale.y(), ROOMS_GRID_RES );
+        int z0 = grid_cell( p.z()-rv, m_min.z(), m_scale.z(), ROOMS_GRID_RES_Z );
+        int z1 = grid_cell( p.z()+rv, m_min.z(), m_scale.z(), ROOMS_GRID_RES_Z );
+
+        for ( int z = z0; z <= z1; ++z )
+            for ( int y = y0; y <= y1; ++y )
+                for ( int x = x0; x <= x1; ++x )
+                    m_cells[(z*ROOMS_GRID_RES+y)*ROOMS_GRID_RES+x] << spk;
+    }
+}
+
+const QVector<quint16>& SpeakerGrid::candidates(QVector3D const& point) const
+{
+    // out of every speaker's reach
+    if ( m_cells.isEmpty() ||
+         point.x() < m_min.x() || point.y() < m_min.y() || point.z() < m_min.z() ||
+         point.x() > m_max.x() || point.y() > m_max.y() || point.z() > m_max.z() )
+         return m_none;
+
+    int x = grid_cell( point.x(), m_min.x(), m_scale.x(), ROOMS_GRID_RES );
+    int y = grid_cell( point.y(), m_min.y(), m_scale.y(), ROOMS_GRID_RES );
+    int z = grid_cell( point.z(), m_min.z(), m_scale.z(), ROOMS_GRID_RES_Z );
+
+    return m_cells[(z*ROOMS_GRID_RES+y)*ROOMS_GRID_RES+x];
+}
+
+//---------------------------------------------------------------------------------------------------------
+
+void GainGrid::setSpeakers(QVector<Speaker*> const& speakers)
+{
+    m_speakers  = speakers;
+    m_dirty     = true;
+}
+
+void GainGrid::setResolution(quint16 resolution)
+{
+    m_resolution    = resolution;
+    m_dirty         = true;
+}
+
+void GainGrid::refresh()
+{
+    if ( !m_dirty ) return;
+    m_dirty = false;
+
+    m_offsets.clear();
+    m_entries.clear();
+
+    if ( !enabled() ) return;
+
+    // bounds of the influence boxes, out of which all gains are zero
+    m_min = QVector3D(  FLT_MAX,  FLT_MAX,  FLT_MAX );
+    m_max = QVector3D( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+
+    for ( const auto& speaker : m_speakers )
+    {
+        float rh = speaker->horizontalArea()->radius();
+        float rv = speaker->verticalArea()->radius();
+        QVector3D reach ( rh, rh, rv );
+
+        auto lo = speaker->position()-reach;
+        auto hi = speaker->position()+reach;
+
+        m_min = QVector3D( qMin(m_min.x(), lo.x()), qMin(m_min.y(), lo.y()), qMin(m_min.z(), lo.z()) );
+        m_max = QVector3D( qMax(m_max.x(), hi.x()), qMax(m_max.y(), hi.y()), qMax(m_max.z(), hi.z()) );
+    }
+
+    auto extent = m_max-m_min;
+    quint16 res = m_resolution;
+
+    m_scale = QVector3D( extent.x() > 0 ? res/extent.x() : 0,
+                         extent.y() > 0 ? res/extent.y() : 0,
+                         extent.z() > 0 ? res/extent.z() : 0 );
+
+    m_offsets.reserve( (res+1)*(res+1)*(res+1)+1 );
+
+    for ( quint16 z = 0; z <= res; ++z )
+    for ( quint16 y = 0; y <= res; ++y )
+    for ( quint16 x = 0; x <= res; ++x )
+    {
+        QVector3D vertex ( m_min.x()+extent.x()*x/res,
+                           m_min.y()+extent.y()*y/res,
+                           m_min.z()+extent.z()*z/res );
+
+        m_offsets << m_entries.size();
+
+        for ( quint16 spk = 0; spk < m_speakers.size(); ++spk )
+        {
+            float gain = RoomChannel::spgain( vertex, *m_speakers[spk] );
+            if ( gain > 0 ) m_entries << Entry { spk, gain };
+        }
+    }
+
+    m_offsets << m_entries.size();
+}
+
+inline void lattice_cell(float v, float min, float scale, quint16 res, quint16& cell, float& t)
+{
+    float f = qBound<float>( 0, (v-min)*scale, res );
+    cell    = qMin<quint16>( std::floor(f), res-1 );
+    t       = f-cell;
+}
+
+void GainGrid::interpolate(QVector3D const& point, float* gains, quint16* touched, quint16& ntouched) const
+{
+    if ( m_offsets.isEmpty() ||
+         point.x() < m_min.x() || point.y() < m_min.y() || point.z() < m_min.z() ||
+         point.x() > m_max.x() || point.y() > m_max.y() || point.z() > m_max.z() )
+         return;
+
+    quint16 res = m_resolution, x, y, z;
+    float tx, ty, tz;
+
+    lattice_cell( point.x(), m_min.x(), m_scale.x(), res, x, tx );
+    lattice_cell( point.y(), m_min.y(), m_scale.y(), res, y, ty );
+    lattice_cell( point.z(), m_min.z(), m_scale.z(), res, z, tz );
+
+    for ( quint8 corner = 0; corner < 8; ++corner )
+    {
+        quint8 dx = corner & 1, dy = (corner >> 1) & 1, dz = corner >> 2;
+
+        float weight = ( dx ? tx : 1-tx )*( dy ? ty : 1-ty )*( dz ? tz : 1-tz );
+        if ( weight <= 0 ) continue;
+
+        quint32 v = ((z+dz)*(res+1)+(y+dy))*(res+1)+(x+dx);
+
+        for ( quint32 e = m_offsets[v]; e < m_offsets[v+1]; ++e )
+        {
+            const Entry& entry = m_entries[e];
+
+            if ( gains[entry.speaker] == 0.f )
+                 touched[ntouched++] = entry.speaker;
+
+            gains[entry.speaker] += weight*entry.gain;
+        }
+    }
 }
 
 QVariantList RoomSetup::speakerList() const
@@ -482,6 +727,15 @@ void RoomSource::setZ(qreal z)
 void RoomSource::setFixed(bool fixed)
 {
     m_fixed = fixed;
+
+    // fixed sources don't need the gain lattice's approximation
+    {
+        QMutexLocker lock ( &g_control );
+        for ( quint16 ch = 0; ch < nchannels(); ++ch )
+            channel(ch).exact = fixed;
+    }
+
+    update();
 }
 
 void RoomSource::initialize(qint64 nsamples)
@@ -542,27 +796,227 @@ qreal RoomChannel::spgain(const QVector3D &src, const Speaker &ls)
     else return ((1-dh/lrh)*(1-dz/lrv));
 }
 
+RoomChannel::~RoomChannel()
+{
+    for ( auto& slot : slots )
+    {
+        delete [ ] slot.coeffs;
+        delete [ ] slot.routes;
+    }
+
+    delete [ ] gains;
+    delete [ ] mix;
+    delete [ ] scratch;
+    delete [ ] touched;
+}
+
+void RoomChannel::allocate(QVector<Speaker*> const& speakerset, qint16 hoa_order)
+{
+    order   = hoa_order;
+    ncoeffs = order < 0 ? speakerset.size() : hoa::nchannels(order);
+
+    for ( auto& slot : slots )
+    {
+        delete [ ] slot.coeffs;
+        delete [ ] slot.routes;
+
+        slot.coeffs     = new float[ ncoeffs ]();
+        slot.routes     = new quint16[ ncoeffs ]();
+        slot.nroutes    = 0;
+    }
+
+    delete [ ] gains;
+    delete [ ] mix;
+    delete [ ] scratch;
+    delete [ ] touched;
+
+    gains       = new float[ ncoeffs ]();
+    mix         = new quint16[ ncoeffs ]();
+    scratch     = new float[ ncoeffs ]();
+    touched     = new quint16[ ncoeffs ]();
+    nmix        = 0;
+    ramping     = false;
+    speakers    = speakerset;
+
+    back = 0; front = 1;
+    middle.store( 2 );
+}
+
+void RoomChannel::accumulate(RoomGains& slot, quint16 speaker, QVector3D const& point)
+{
+    merge( slot, speaker, spgain(point, *speakers[speaker]) );
+}
+
+void RoomChannel::merge(RoomGains& slot, quint16 speaker, float gain)
+{
+    // keeps the max gain over the channel's points
+    if ( gain <= slot.coeffs[speaker] ) return;
+
+    if ( slot.coeffs[speaker] == 0.f )
+         slot.routes[slot.nroutes++] = speaker;
+
+    slot.coeffs[speaker] = gain;
+}
+
 void RoomChannel::computeCoeffs()
 {
-    quint16 spk = 0;
-    for ( const auto& speaker: speakers )
+    QMutexLocker lock ( &g_control );
+    RoomGains& slot = slots[ back ];
+    if ( !slot.coeffs ) return;
+
+    memset( slot.coeffs, 0, ncoeffs*sizeof(float) );
+    slot.nroutes = 0;
+
+    if ( order >= 0 ) encode( slot );
+    else if ( vbap ) pan( slot );
+    else
+    {
+        const QVector3D points[ 5 ] = { c, n, s, e, w };
+        quint16 npoints = diffuse == 0.f ? 1 : 5;
+
+        bool interpolate = lattice && !exact && lattice->enabled();
+
+        if ( interpolate ) lattice->refresh();
+        else if ( grid ) grid->refresh();
+
+        for ( quint16 p = 0; p < npoints; ++p )
+        {
+            if ( interpolate )
+            {
+                quint16 ntouched = 0;
+                lattice->interpolate( points[p], scratch, touched, ntouched );
+
+                for ( quint16 k = 0; k < ntouched; ++k )
+                {
+                    merge( slot, touched[k], scratch[touched[k]] );
+                    scratch[touched[k]] = 0.f;
+                }
+            }
+            // only the speakers within reach of the point are evaluated
+            else if ( grid )
+            {
+                for ( const auto& spk : grid->candidates(points[p]) )
+                    accumulate( slot, spk, points[p] );
+            }
+            else
+            {
+                for ( quint16 spk = 0; spk < speakers.size(); ++spk )
+                    accumulate( slot, spk, points[p] );
+            }
+        }
+    }
+
+    // publish, and take the slot the audio thread isn't reading
+    back = middle.exchange( back | ROOMS_FRESH, std::memory_order_acq_rel ) & 3;
+}
+
+void RoomChannel::encode(RoomGains& slot)
+{
+    // direction seen from the center of the room
+    QVector3D direction = c-QVector3D( 0.5, 0.5, 0.5 );
+    if ( planar ) direction.setZ( 0 );
+
+    // diffusion widens the source by fading its higher orders out
+    float spread = 0;
+
+    if ( diffuse != 0.f )
+         spread = qMin<float>( 1, 2*qMax<float>(fabs(n.y()-c.y()), fabs(e.x()-c.x())) );
+
+    // and so does getting close to the center, where
+    // the direction would otherwise flip abruptly
+    float distance = direction.length();
+
+    if ( distance < ROOMS_HOA_CENTER )
+         spread = qMax<float>( spread, 1-distance/ROOMS_HOA_CENTER );
+
+    hoa::encode( order, direction, spread, slot.coeffs );
+
+    for ( quint16 k = 0; k < ncoeffs; ++k )
+        if ( slot.coeffs[k] != 0.f )
+             slot.routes[slot.nroutes++] = k;
+}
+
+void RoomChannel::pan(RoomGains& slot)
+{
+    // diffuse sources are panned on each of their points (MDAP),
+    // the sum being normalized in power
+    const QVector3D center ( 0.5, 0.5, 0.5 );
+    const QVector3D points[ 5 ] = { c, n, s, e, w };
+    quint16 npoints = diffuse == 0.f ? 1 : 5;
+
+    quint16 spk[ 3 ];
+    float gain[ 3 ];
+    qint32 hint = triangle;
+
+    for ( quint16 p = 0; p < npoints; ++p )
     {
-        qreal gain = 0.0;
-        if ( diffuse == 0.f ) gain = spgain(c, *speaker);
-        else
+        QVector3D direction = points[p]-center;
+        if ( planar ) direction.setZ( 0 );
+
+        quint8 count = vbap->pan( direction, hint, spk, gain );
+        if ( p == 0 ) triangle = hint;
+
+        for ( quint8 k = 0; k < count; ++k )
         {
-            qreal cg = spgain(c, *speaker);
-            qreal ng = spgain(n, *speaker);
-            qreal sg = spgain(s, *speaker);
-            qreal eg = spgain(e, *speaker);
-            qreal wg = spgain(w, *speaker);
+            if ( slot.coeffs[spk[k]] == 0.f )
+                 slot.routes[slot.nroutes++] = spk[k];
 
-            gain = qMax(qMax(qMax(qMax(ng,sg),eg),wg),cg);
+            slot.coeffs[spk[k]] += gain[k];
+        }
+    }
+
+    if ( slot.nroutes == 0 )
+    {
+        // right at the center: all speakers, evenly
+        for ( quint16 o = 0; o < ncoeffs; ++o )
+        {
+            slot.coeffs[o] = 1.f/std::sqrt( ncoeffs );
+            slot.routes[slot.nroutes++] = o;
         }
 
-        coeffs[spk] = gain;
-        spk++;
+        return;
     }
+
+    if ( npoints == 1 ) return;
+
+    float power = 0;
+    for ( quint16 k = 0; k < slot.nroutes; ++k )
+          power += slot.coeffs[slot.routes[k]]*slot.coeffs[slot.routes[k]];
+
+    power = 1.f/std::sqrt( power );
+    for ( quint16 k = 0; k < slot.nroutes; ++k )
+          slot.coeffs[slot.routes[k]] *= power;
+}
+
+bool RoomChannel::fetch()
+{
+    if ( !(middle.load(std::memory_order_acquire) & ROOMS_FRESH) )
+         return false;
+
+    front = middle.exchange( front, std::memory_order_acq_rel ) & 3;
+
+    // ramp on every speaker heard now, or reached by the new coefficients
+    auto coeffs = slots[front].coeffs;
+    nmix        = 0;
+
+    for ( quint16 o = 0; o < ncoeffs; ++o )
+        if ( gains[o] != 0.f || coeffs[o] != 0.f )
+             mix[nmix++] = o;
+
+    ramping = true;
+    return true;
+}
+
+void RoomChannel::settle()
+{
+    const RoomGains& slot = slots[front];
+
+    for ( quint16 k = 0; k < nmix; ++k )
+        gains[mix[k]] = slot.coeffs[mix[k]];
+
+    memcpy( mix, slot.routes, slot.nroutes*sizeof(quint16) );
+    nmix    = slot.nroutes;
+    ramping = false;
 }
 
 // MONO ------------------------------------------------------------------------------------------
@@ -572,15 +1026,9 @@ MonoSource::MonoSource() : RoomSource()
     m_channel.c = QVector3D( 0.5, 0.5, 0.5 );
 }
 
-void MonoSource::allocateCoeffs(QVector<Speaker*> const& speakerset)
+void MonoSource::allocateCoeffs(QVector<Speaker*> const& speakerset, qint16 order)
 {
-    auto coeffs = m_channel.coeffs;
-    if ( coeffs ) delete coeffs;
-
-    coeffs = new float[ speakerset.size() ]();
-
-    m_channel.coeffs    = coeffs;
-    m_channel.speakers  = speakerset;
+    m_channel.allocate( speakerset, order );
 }
 
 RoomChannel& MonoSource::channel(quint16)
@@ -591,12 +1039,6 @@ RoomChannel& MonoSource::channel(quint16)
 void MonoSource::componentComplete()
 {
     RoomSource::componentComplete();
-
-    if       ( m_bias == 0.5 )  { m_w = m_diffuse; m_h = m_diffuse; }
-    else if  ( m_bias < 0.5  )  { m_w = m_diffuse; m_h = m_bias; }
-    else if  ( m_bias > 0.5  )  { m_h = m_diffuse; m_w = m_bias-0.5; }
-
-    m_w /= 2.0; m_h /= 2.0;
     update();
 
     emit positionChanged();
@@ -604,6 +1046,16 @@ void MonoSource::componentComplete()
 
 void MonoSource::update()
 {
+    // channel's points are read by initialize's first computation
+    QMutexLocker lock ( &g_control );
+    m_channel.c = QVector3D( m_x, m_y, m_z );
+
+    if       ( m_bias == 0.5 )  { m_w = m_diffuse; m_h = m_diffuse; }
+    else if  ( m_bias < 0.5  )  { m_w = m_diffuse; m_h = m_bias; }
+    else if  ( m_bias > 0.5  )  { m_h = m_diffuse; m_w = m_bias-0.5; }
+
+    m_w /= 2.0; m_h /= 2.0;
+
     if ( m_diffuse > 0 )
     {
         m_channel.diffuse = true;
@@ -616,11 +1068,13 @@ void MonoSource::update()
     }
 
     else m_channel.diffuse = false;
+
+    // no-op until coefficients are allocated by Rooms
+    m_channel.computeCoeffs();
 }
 
 void MonoSource::setPosition(QVector3D position)
 {
-    m_channel.c = position;
     m_x = position.x();
     m_y = position.y();
     m_z = position.z();
@@ -630,23 +1084,18 @@ void MonoSource::setPosition(QVector3D position)
 void MonoSource::setX(qreal x)
 {
     m_x = x;    
-    m_channel.c.setX( x );
     update();
 }
 
 void MonoSource::setY(qreal y)
 {
     m_y = y;
-    m_channel.c.setY( y );
-
     update();
 }
 
 void MonoSource::setZ(qreal z)
 {
     m_z = z;
-    m_channel.c.setZ( z );
-
     update();
 }
 
@@ -678,10 +1127,10 @@ void StereoSource::expose(WPNNode*)
     m_right->setExposePath  ( m_exp_path+"/right" );
 }
 
-void StereoSource::allocateCoeffs(QVector<Speaker*> const& speakerset)
+void StereoSource::allocateCoeffs(QVector<Speaker*> const& speakerset, qint16 order)
 {
-    m_left  ->allocateCoeffs ( speakerset );
-    m_right ->allocateCoeffs ( speakerset );
+    m_left  ->allocateCoeffs ( speakerset, order );
+    m_right ->allocateCoeffs ( speakerset, order );
 }
 
 RoomChannel& StereoSource::channel(quint16 index)
@@ -730,6 +1179,13 @@ void StereoSource::setBias(qreal bias)
     m_right ->setBias(bias);
 }
 
+void StereoSource::setFixed(bool fixed)
+{
+    m_fixed = fixed;
+    m_left  ->setFixed ( fixed );
+    m_right ->setFixed ( fixed );
+}
+
 void StereoSource::setX(qreal x)
 {
     m_x = x;
@@ -757,13 +1213,59 @@ void StereoSource::setZ(qreal z)
 
 Rooms::Rooms() : m_setup(nullptr) { SETTYPE( StreamType::Effect ) }
 
+Rooms::~Rooms()
+{
+    m_pool.resize( 1 );
+
+    for ( auto& worker : m_workers )
+          StreamNode::deleteBuffer( worker.accumulator, m_ntargets, m_bus_size );
+
+    StreamNode::deleteBuffer( m_bus, m_nbus, m_bus_size );
+}
+
 void Rooms::setSetup(RoomSetup* setup)
 {
     if ( m_setup == setup ) return;
+
+    if ( m_setup ) QObject::disconnect( m_setup, SIGNAL(speakersChanged()), this, SLOT(onSpeakersChanged()) );
     m_setup = setup;
+    if ( m_setup ) QObject::connect( m_setup, SIGNAL(speakersChanged()), this, SLOT(onSpeakersChanged()) );
+
     emit setupChanged();
 }
 
+void Rooms::onSpeakersChanged()
+{
+    for ( const auto& source : m_sources )
+        for ( quint16 ch = 0; ch < source->numOutputs(); ++ch )
+              source->channel(ch).computeCoeffs();
+}
+
+void Rooms::setMode(Mode mode)
+{
+    if ( m_mode == mode ) return;
+    m_mode = mode;
+    emit modeChanged();
+}
+
+void Rooms::setThreads(quint16 threads)
+{
+    threads = qBound<quint16>( 1, threads, QThread::idealThreadCount() );
+    if ( m_threads == threads ) return;
+
+    m_threads = threads;
+    emit threadsChanged();
+}
+
+void Rooms::setOrder(quint16 order)
+{
+    order = qMin<quint16>( order, HOA_MAX_ORDER );
+    if ( m_order == order ) return;
+
+    m_order = order;
+    emit orderChanged();
+}
+
 void Rooms::componentComplete()
 {
     if ( m_setup ) { SETN_OUT ( m_setup->nspeakers()); }
@@ -776,17 +1278,99 @@ void Rooms::componentComplete()
 
 void Rooms::initialize(qint64 nsamples)
 {        
+    // runs on the stream's thread, while sources may be moved
+    QMutexLocker lock ( &g_control );
+
+    quint32 nrows   = 0;
+    qint16 order    = -1;
+    bool planar     = false;
+
+    m_sources.clear();
+
+    StreamNode::deleteBuffer( m_bus, m_nbus, m_bus_size );
+    m_bus = nullptr; m_nbus = 0;
+    m_decoder.clear();
+
+    // speakers' directions from the center, a setup whose speakers
+    // are all at the same height is rendered horizontally
+    QVector<QVector3D> directions;
+
+    if ( m_mode != Mode::Rooms )
+    {
+        planar = true;
+
+        for ( const auto& speaker : m_setup->speakers() )
+        {
+            directions << speaker->position()-QVector3D( 0.5, 0.5, 0.5 );
+            if ( speaker->z() != m_setup->speakers().first()->z() ) planar = false;
+        }
+
+        if ( planar )
+            for ( auto& direction : directions )
+                  direction.setZ( 0 );
+    }
+
+    if ( m_mode == Mode::Vbap )
+         m_vbap.setSpeakers( directions );
+
+    if ( m_mode == Mode::Ambisonics )
+    {
+        order       = m_order;
+        m_nbus      = hoa::nchannels( m_order );
+        m_bus_size  = nsamples;
+        m_decoder   = hoa::decoder( m_order, directions );
+
+        StreamNode::allocateBuffer( m_bus, m_nbus, m_bus_size );
+    }
+
     for ( const auto& node : m_subnodes )
     {
         auto source = qobject_cast<RoomSource*>(node);
         if ( ! source ) continue;
 
-        source->allocateCoeffs(m_setup->speakers());
+        m_sources << source;
+        source->allocateCoeffs(m_setup->speakers(), order);
+        nrows += source->numOutputs();
+
+        for ( quint16 ch = 0; ch < source->numOutputs(); ++ch )
+        {
+            auto& channel   = source->channel(ch);
+            channel.grid    = m_setup->grid();
+            channel.lattice = m_setup->gains();
+            channel.exact   = source->fixed();
+            channel.planar  = planar;
+            channel.vbap    = m_mode == Mode::Vbap ? &m_vbap : nullptr;
+            channel.triangle = -1;
+        }
+
+        // start right on the coefficients, without ramping from silence.
+        // afterwards, they are only recomputed when the source changes
+        for ( quint16 ch = 0; ch < source->numOutputs(); ++ch )
+        {
+            auto& channel = source->channel(ch);
+            channel.computeCoeffs();
+            channel.fetch();
+            channel.settle();
+        }
+    }
+
+    // any worker may end up with every source channel
+    for ( auto& worker : m_workers )
+          StreamNode::deleteBuffer( worker.accumulator, m_ntargets, m_bus_size );
+
+    m_ntargets = m_bus ? m_nbus : m_num_outputs;
+    m_pool.resize( m_threads );
+    m_workers.resize( m_pool.size() );
+
+    for ( quint16 w = 0; w < m_workers.size(); ++w )
+    {
+        auto& worker = m_workers[w];
+        worker.accumulator = nullptr;
+        worker.rows.resize      ( nrows );
+        worker.channels.resize  ( nrows );
+        worker.nrows = 0;
 
-        // manage coefficents for static sources
-        if ( source->fixed() )
-            for ( quint16 ch = 0; ch < source->numOutputs(); ++ch )
-                source->channel(ch).computeCoeffs();
+        if ( w ) StreamNode::allocateBuffer( worker.accumulator, m_ntargets, nsamples );
     }
 }
 
@@ -797,28 +1381,148 @@ float** Rooms::preprocess(float** buf, qint64 nsamples)
 
     StreamNode::resetBuffer(out, nout, nsamples);
 
-    for ( const auto& node : m_subnodes )
+    // in ambisonics mode, sources are mixed into the bus instead,
+    // with the very same kernel: its channels stand for the speakers
+    m_targets   = m_bus ? m_bus : out;
+    m_ntargets  = m_bus ? m_nbus : nout;
+    m_nsamples  = nsamples;
+
+    if ( m_bus ) StreamNode::resetBuffer(m_bus, m_nbus, nsamples);
+
+    for ( auto& worker : m_workers )
     {
-        auto source = qobject_cast<RoomSource*>(node);
-        if ( !source || !source->active() ) continue;
+        worker.nrows = 0;
+        if ( worker.accumulator )
+             StreamNode::resetBuffer(worker.accumulator, m_ntargets, nsamples);
+    }
+
+    // sources (and their subgraphs) are processed by whichever worker
+    // picks them, each worker then mixes its own sources in its accumulator,
+    // accumulators are finally summed pairwise, down to the output
+    m_pool.run( &Rooms::gather, this, m_sources.size() );
+    m_pool.run( &Rooms::mix, this, m_workers.size() );
+
+    for ( m_stride = 1; m_stride < (quint32) m_workers.size(); m_stride *= 2 )
+        m_pool.run( &Rooms::reduce, this, (m_workers.size()+2*m_stride-1)/(2*m_stride) );
+
+    if ( m_bus ) decode( out, nout, nsamples );
 
-        quint16 snch = source->numOutputs();
-        float** in  = source->preprocess(nullptr, nsamples);        
+    StreamNode::applyGain(out, nout, nsamples, m_level);
+    return out;
+}
+
+void Rooms::gather(void* context, quint32 task, quint16 index)
+{
+    auto rooms  = static_cast<Rooms*>(context);
+    auto source = rooms->m_sources[task];
+    auto& worker = rooms->m_workers[index];
+
+    if ( !source->active() ) return;
+
+    quint16 snch = source->numOutputs();
+    float** in  = source->preprocess(nullptr, rooms->m_nsamples);
+
+    for ( quint16 ch = 0; ch < snch && worker.nrows < (quint32) worker.rows.size(); ++ch )
+    {
+        auto& channel = source->channel(ch);
 
-        for ( quint16 ch = 0; ch < snch; ++ch )
+        channel.fetch();
+
+        if ( !channel.nmix )
         {
-            auto channel = source->channel(ch);
+            // silent, nothing to ramp
+            if ( channel.ramping ) channel.settle();
+            continue;
+        }
 
-            // if source's not supposed to move, dont re-calculate the coeffs
-            if ( !source->fixed() ) channel.computeCoeffs();
-            auto coeffs = channel.coeffs;
+        worker.rows[worker.nrows]       = in[ch];
+        worker.channels[worker.nrows]   = &channel;
+        ++worker.nrows;
+    }
+}
 
-            for ( quint16 o = 0; o < nout; ++o )
-                for ( quint16 s = 0; s < nsamples; ++s )
-                    out[o][s] += in[ch][s] * coeffs[o];
+void Rooms::mix(void* context, quint32 task, quint16)
+{
+    auto rooms      = static_cast<Rooms*>(context);
+    auto& worker    = rooms->m_workers[task];
+    auto nsamples   = rooms->m_nsamples;
+    auto ntargets   = rooms->m_ntargets;
+    float** targets = worker.accumulator ? worker.accumulator : rooms->m_targets;
+
+    // sources x speakers gain matrix, each source channel
+    // only visits the speakers it reaches. when its coefficients
+    // have changed, gains ramp linearly over the block
+    for ( qint64 s = 0; s < nsamples; s += ROOMS_TILE )
+    {
+        qint64 n = qMin<qint64>( ROOMS_TILE, nsamples-s );
+
+        for ( quint32 r = 0; r < worker.nrows; ++r )
+        {
+            const float* x  = worker.rows[r]+s;
+            auto channel    = worker.channels[r];
+            auto gains      = channel->gains;
+
+            if ( !channel->ramping )
+            {
+                for ( quint16 k = 0; k < channel->nmix; ++k )
+                {
+                    quint16 o = channel->mix[k];
+                    if ( o < ntargets ) simd::madd( targets[o]+s, x, gains[o], n );
+                }
+
+                continue;
+            }
+
+            auto target = channel->target().coeffs;
+
+            for ( quint16 k = 0; k < channel->nmix; ++k )
+            {
+                quint16 o = channel->mix[k];
+                if ( o >= ntargets ) continue;
+
+                float inc = (target[o]-gains[o])/nsamples;
+                simd::madd_ramp( targets[o]+s, x, gains[o]+inc*s, inc, n );
+            }
         }
     }
 
-    StreamNode::applyGain(out, nout, nsamples, m_level);
-    return out;
+    for ( quint32 r = 0; r < worker.nrows; ++r )
+        if ( worker.channels[r]->ramping )
+             worker.channels[r]->settle();
+}
+
+void Rooms::reduce(void* context, quint32 task, quint16)
+{
+    auto rooms  = static_cast<Rooms*>(context);
+    quint32 dst = task*2*rooms->m_stride;
+    quint32 src = dst+rooms->m_stride;
+
+    if ( src >= (quint32) rooms->m_workers.size() ) return;
+
+    float** lhs = dst ? rooms->m_workers[dst].accumulator : rooms->m_targets;
+    float** rhs = rooms->m_workers[src].accumulator;
+
+    for ( quint16 ch = 0; ch < rooms->m_ntargets; ++ch )
+          simd::add( lhs[ch], rhs[ch], rooms->m_nsamples );
+}
+
+void Rooms::decode(float** out, quint16 nout, qint64 nsamples)
+{
+    // speakers x channels, once per block whatever the number of sources
+    quint16 nspeakers = qMin<quint16>( nout, m_decoder.size()/m_nbus );
+    const float* decoder = m_decoder.constData();
+
+    for ( qint64 s = 0; s < nsamples; s += ROOMS_TILE )
+    {
+        qint64 n = qMin<qint64>( ROOMS_TILE, nsamples-s );
+
+        for ( quint16 o = 0; o < nspeakers; ++o )
+        {
+            const float* row = decoder+o*m_nbus;
+
+            for ( quint16 k = 0; k < m_nbus; ++k )
+                if ( row[k] != 0.f )
+                     simd::madd( out[o]+s, m_bus[k]+s, row[k], n );
+        }
+    }
 }
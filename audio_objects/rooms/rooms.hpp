@@ -2,10 +2,21 @@
 #define ROOMS_H
 
 #include <source/audio/audio.hpp>
+#include <source/audio/workerpool.hpp>
+#include "vbap.hpp"
 #include <QVector2D>
 #include <QVector3D>
 #include <QVector4D>
 #include <QQmlListProperty>
+#include <atomic>
+
+#define ROOMS_TILE 64
+// in samples, sources are mixed by tiles so that
+// the speakers' output tile stays in cache
+
+#define ROOMS_HOA_CENTER 0.05
+// radius around the center within which an ambisonic
+// source gradually becomes omnidirectional
 
 class SpeakerArea : public QObject
 {
@@ -231,6 +242,78 @@ class SpeakerRing : public RoomNode
     qreal m_radius      = 1;
 };
 
+#define ROOMS_GRID_RES 16
+#define ROOMS_GRID_RES_Z 4
+// cells per axis of the speaker grid
+
+// uniform grid over the speakers' influence boxes:
+// each speaker is registered in every cell its box overlaps,
+// so a point only has to be tested against the speakers of its cell.
+// rebuilt lazily (on the control thread) after a speaker has moved
+
+class SpeakerGrid
+{
+    public:
+    void setSpeakers ( QVector<Speaker*> const& speakers );
+    void invalidate  ( ) { m_dirty = true; }
+    void refresh     ( );
+
+    // indexes of the speakers whose influence may reach 'point'
+    const QVector<quint16>& candidates ( QVector3D const& point ) const;
+
+    private:
+    QVector<Speaker*> m_speakers;
+    QVector<QVector<quint16>> m_cells;
+    QVector<quint16> m_none;
+    QVector3D m_min;
+    QVector3D m_max;
+    QVector3D m_scale;
+    bool m_dirty = true;
+};
+
+#define ROOMS_GAINS_MAX_RES 64
+
+// gains of every speaker sampled on the vertices of a regular lattice
+// spanning the speakers' reach, trilinearly interpolated in between,
+// so that moving sources don't evaluate the influence areas at all.
+// the resolution (cells per axis) trades accuracy for memory, 0 disables it.
+// rebuilt lazily (on the control thread) after a speaker has moved
+
+class GainGrid
+{
+    public:
+    void setSpeakers    ( QVector<Speaker*> const& speakers );
+    void setResolution  ( quint16 resolution );
+    void invalidate     ( ) { m_dirty = true; }
+    void refresh        ( );
+
+    quint16 resolution  ( ) const { return m_resolution; }
+    bool enabled        ( ) const { return m_resolution > 0 && !m_speakers.isEmpty(); }
+
+    // adds the gains interpolated at 'point' to 'gains' (one per speaker),
+    // speakers that were at zero are appended to 'touched'
+    void interpolate ( QVector3D const& point, float* gains,
+                       quint16* touched, quint16& ntouched ) const;
+
+    private:
+    struct Entry
+    {
+        quint16 speaker;
+        float gain;
+    };
+
+    // non-zero gains of vertex v are m_entries[m_offsets[v]] to [m_offsets[v+1]]
+    QVector<quint32> m_offsets;
+    QVector<Entry> m_entries;
+    QVector<Speaker*> m_speakers;
+
+    QVector3D m_min;
+    QVector3D m_max;
+    QVector3D m_scale;
+    quint16 m_resolution = 0;
+    bool m_dirty = true;
+};
+
 // x, y, z, w = influence
 class RoomSetup : public QObject, public QQmlParserStatus
 {
@@ -238,6 +321,7 @@ class RoomSetup : public QObject, public QQmlParserStatus
     Q_CLASSINFO ( "DefaultProperty", "nodes" )
     Q_PROPERTY  ( int nspeakers READ nspeakers )
     Q_PROPERTY  ( QQmlListProperty<RoomNode> nodes READ nodes NOTIFY nodesChanged )
+    Q_PROPERTY  ( int gainResolution READ gainResolution WRITE setGainResolution NOTIFY gainResolutionChanged )
 
     public:
     RoomSetup();
@@ -253,6 +337,11 @@ class RoomSetup : public QObject, public QQmlParserStatus
     QVector<Speaker*> speakers ( ) const { return m_speakers; }
 
     Q_INVOKABLE QVariantList speakerList() const;
+    SpeakerGrid* grid ( ) { return &m_grid; }
+    GainGrid* gains ( ) { return &m_gains; }
+
+    quint16 gainResolution ( ) const { return m_gains.resolution(); }
+    void setGainResolution ( quint16 resolution );
 
     void appendNode     ( RoomNode* );
     int nodeCount       ( ) const;
@@ -261,6 +350,11 @@ class RoomSetup : public QObject, public QQmlParserStatus
 
     signals:
     void nodesChanged();
+    void gainResolutionChanged();
+    void speakersChanged();
+
+    protected slots:
+    void onSpeakerChanged ( );
 
     private:
     static void appendNode  ( QQmlListProperty<RoomNode>*, RoomNode*);
@@ -270,13 +364,56 @@ class RoomSetup : public QObject, public QQmlParserStatus
 
     QVector<RoomNode*> m_nodes;
     QVector<Speaker*> m_speakers;
+    SpeakerGrid m_grid;
+    GainGrid m_gains;
+};
+
+#define ROOMS_FRESH 0x4
+// set on the exchanged slot index when it holds unread coefficients
 
+struct RoomGains
+{
+    float* coeffs   = nullptr;
+
+    // indexes of the speakers (or ambisonic channels)
+    // actually reached (non-zero coeff)
+    quint16* routes = nullptr;
+    quint16 nroutes = 0;
 };
 
+// coefficients are computed on the control thread, whenever the
+// source moves, and handed to the audio thread through a triple buffer:
+// control thread writes 'back', audio thread reads 'front',
+// both exchange their slot with 'middle'
+
 struct RoomChannel
 {
-    qreal spgain ( QVector3D const& src, Speaker const& ls );
+    RoomChannel  ( ) {}
+    ~RoomChannel ( );
+
+    RoomChannel ( RoomChannel const& ) = delete;
+    RoomChannel& operator= ( RoomChannel const& ) = delete;
+
+    static qreal spgain ( QVector3D const& src, Speaker const& ls );
+    void accumulate ( RoomGains& slot, quint16 speaker, QVector3D const& point );
+    void merge ( RoomGains& slot, quint16 speaker, float gain );
+
+    // 'order' >= 0 encodes the channel in an ambisonic bus of that order
+    // instead of computing one gain per speaker
+    void allocate ( QVector<Speaker*> const& speakerset, qint16 order = -1 );
+
+    // control thread: computes and publishes the coefficients
     void computeCoeffs ( );
+    void encode ( RoomGains& slot );
+    void pan    ( RoomGains& slot );
+
+    // audio thread, once per block: picks up the latest coefficients,
+    // returns true if gains have to ramp towards them during this block
+    bool fetch  ( );
+    // audio thread, end of a ramping block
+    void settle ( );
+
+    const RoomGains& target ( ) const { return slots[front]; }
 
     QVector3D c;
     QVector3D n;
@@ -285,9 +422,36 @@ struct RoomChannel
     QVector3D e;
 
     QVector<Speaker*> speakers;
-
-    float* coeffs   = nullptr;
+    SpeakerGrid* grid = nullptr;
     float  diffuse  = 0.f;
+
+    // interpolated gains, unless 'exact' (fixed sources)
+    GainGrid* lattice   = nullptr;
+    bool exact          = false;
+    float* scratch      = nullptr;
+    quint16* touched    = nullptr;
+
+    qint16 order    = -1;
+    quint16 ncoeffs = 0;
+    // flattens the source's direction, for horizontal-only setups
+    bool planar     = false;
+
+    // vbap mode: the speaker layout, and the triangle
+    // the source was last found in, where the search starts over
+    const VbapLayout* vbap = nullptr;
+    qint32 triangle = -1;
+
+    RoomGains slots [ 3 ];
+    quint8 back     = 0;
+    quint8 front    = 1;
+    std::atomic<quint8> middle { 2 };
+
+    // audio thread: gains reached at the end of the last block,
+    // and the speakers to visit (heard now or reached by the target)
+    float* gains    = nullptr;
+    quint16* mix    = nullptr;
+    quint16 nmix    = 0;
+    bool ramping    = false;
 };
 
 class RoomSource : public StreamNode
@@ -314,7 +478,7 @@ class RoomSource : public StreamNode
 
     virtual quint16 nchannels  ( ) const = 0;
 
-    virtual void allocateCoeffs ( QVector<Speaker*> const& speakerset ) = 0;
+    virtual void allocateCoeffs ( QVector<Speaker*> const& speakerset, qint16 order ) = 0;
     virtual RoomChannel& channel(quint16 channel) = 0;
 
     qreal x ( ) const { return m_x; }
@@ -339,7 +503,7 @@ class RoomSource : public StreamNode
 
     protected:
     virtual void update() {}
-    bool m_fixed;
+    bool m_fixed = false;
     bool m_changed = true;
 
     qreal m_x = 0.5;
@@ -362,7 +526,7 @@ class MonoSource : public RoomSource
 
     virtual quint16 nchannels ( ) const override { return 1; }
 
-    virtual void allocateCoeffs ( QVector<Speaker*> const& speakerset ) override;
+    virtual void allocateCoeffs ( QVector<Speaker*> const& speakerset, qint16 order ) override;
     virtual RoomChannel& channel(quint16 channel) override;
 
     void setX   ( qreal x ) override;
@@ -399,7 +563,7 @@ class StereoSource : public RoomSource
     virtual void componentComplete() override;
     virtual quint16 nchannels ( ) const override { return 2; }
 
-    virtual void allocateCoeffs ( QVector<Speaker*> const& speakerset ) override;
+    virtual void allocateCoeffs ( QVector<Speaker*> const& speakerset, qint16 order ) override;
     virtual RoomChannel& channel(quint16 channel) override;
 
     virtual void expose(WPNNode*) override;
@@ -418,6 +582,7 @@ class StereoSource : public RoomSource
     void setDiffuse     ( qreal diffuse ) override;
     void setRotate      ( qreal rotate ) override;
     void setBias        ( qreal bias ) override;
+    void setFixed       ( bool fixed ) override;
 
     private:
     qreal m_xspread;
@@ -427,18 +592,57 @@ class StereoSource : public RoomSource
 
 };
 
+// sources and channels mixed by one worker during the current block,
+// in its private accumulator (worker 0 mixes right into the output)
+struct RoomsWorker
+{
+    float** accumulator = nullptr;
+    QVector<const float*> rows;
+    QVector<RoomChannel*> channels;
+    quint32 nrows = 0;
+};
+
 class Rooms : public StreamNode
 {
     Q_OBJECT
 
     Q_PROPERTY  ( RoomSetup* setup READ setup WRITE setSetup NOTIFY setupChanged )
+    Q_PROPERTY  ( Mode mode READ mode WRITE setMode NOTIFY modeChanged )
+    Q_PROPERTY  ( int order READ order WRITE setOrder NOTIFY orderChanged )
+    Q_PROPERTY  ( int threads READ threads WRITE setThreads NOTIFY threadsChanged )
 
     public:
     Rooms();
+    ~Rooms();
+
+    // Rooms: one gain per source channel and speaker
+    // Ambisonics: sources are encoded in a bus of (order+1)^2 channels,
+    // decoded once per block to the setup's speakers
+    // Vbap: sources are panned on the (at most) three speakers surrounding them
+    enum class Mode
+    {
+        Rooms       = 0,
+        Ambisonics  = 1,
+        Vbap        = 2
+    };
+
+    Q_ENUM ( Mode )
 
     RoomSetup* setup() const { return m_setup; }
     void setSetup(RoomSetup* setup);
 
+    // taken into account when the graph is initialized
+    Mode mode           ( ) const { return m_mode; }
+    quint16 order       ( ) const { return m_order; }
+
+    // number of threads processing the sources, the audio thread included.
+    // sources' subgraphs then run concurrently, and must not share nodes
+    quint16 threads     ( ) const { return m_threads; }
+
+    void setMode        ( Mode mode );
+    void setOrder       ( quint16 order );
+    void setThreads     ( quint16 threads );
+
     virtual void componentComplete() override;
 
     virtual float** preprocess  ( float** buf, qint64 le ) override;
@@ -447,9 +651,45 @@ class Rooms : public StreamNode
 
     signals:
     void setupChanged();
+    void modeChanged();
+    void orderChanged();
+    void threadsChanged();
+
+    protected slots:
+    // republishes every source channel's coefficients,
+    // speakers' layout in Ambisonics and Vbap modes is taken on initialization
+    void onSpeakersChanged ( );
 
     private:    
+    void decode ( float** out, quint16 nout, qint64 nsamples );
+
+    // worker pool tasks
+    static void gather  ( void* rooms, quint32 source, quint16 worker );
+    static void mix     ( void* rooms, quint32 worker, quint16 );
+    static void reduce  ( void* rooms, quint32 pair, quint16 );
+
     RoomSetup* m_setup;
+    Mode m_mode         = Mode::Rooms;
+    quint16 m_order     = 3;
+    quint16 m_threads   = 1;
+
+    // ambisonic bus and decoding matrix (nspeakers x nchannels)
+    float** m_bus       = nullptr;
+    quint16 m_nbus      = 0;
+    qint64 m_bus_size   = 0;
+    QVector<float> m_decoder;
+
+    VbapLayout m_vbap;
+
+    QVector<RoomSource*> m_sources;
+    QVector<RoomsWorker> m_workers;
+    WorkerPool m_pool;
+
+    // current block
+    float** m_targets   = nullptr;
+    quint16 m_ntargets  = 0;
+    qint64 m_nsamples   = 0;
+    quint32 m_stride    = 1;
 };
 
 #endif // ROOMS_H
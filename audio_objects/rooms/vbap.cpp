@@ -0,0 +1,322 @@
+#include "vbap.hpp"
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+
+#define VBAP_EPSILON 1e-5f
+
+static int sign(float value)
+{
+    return value > VBAP_EPSILON ? 1 : value < -VBAP_EPSILON ? -1 : 0;
+}
+
+// orientation of (a, b, c) in the plane of normal 'n'
+static int orient(QVector3D const& a, QVector3D const& b, QVector3D const& c, QVector3D const& n)
+{
+    return sign( QVector3D::dotProduct(QVector3D::crossProduct(b-a, c-a), n) );
+}
+
+static bool inside(QVector3D const& p, QVector3D const* t, QVector3D const& n)
+{
+    int a = orient( t[0], t[1], p, n );
+    int b = orient( t[1], t[2], p, n );
+    int c = orient( t[2], t[0], p, n );
+
+    return a && a == b && b == c;
+}
+
+// coplanar triangles overlapping each other: an edge crossing
+// another, or a vertex strictly inside the other triangle
+static bool overlap(QVector3D const* t, QVector3D const* u, QVector3D const& n)
+{
+    for ( quint8 i = 0; i < 3; ++i )
+    {
+        if ( inside(t[i], u, n) || inside(u[i], t, n) ) return true;
+
+        for ( quint8 j = 0; j < 3; ++j )
+        {
+            auto& p1 = t[i]; auto& p2 = t[(i+1)%3];
+            auto& q1 = u[j]; auto& q2 = u[(j+1)%3];
+
+            if ( orient(p1, p2, q1, n)*orient(p1, p2, q2, n) < 0 &&
+                 orient(q1, q2, p1, n)*orient(q1, q2, p2, n) < 0 )
+                 return true;
+        }
+    }
+
+    return false;
+}
+
+void VbapLayout::setSpeakers(QVector<QVector3D> const& directions)
+{
+    m_triangles.clear();
+    m_directions.clear();
+    m_planar = true;
+
+    for ( const auto& direction : directions )
+    {
+        if ( direction.z() != 0.f ) m_planar = false;
+        m_directions << ( direction.lengthSquared() < VBAP_EPSILON ?
+                          QVector3D() : direction.normalized() );
+    }
+
+    if ( m_planar ) pairs( directions );
+    else triangles( directions );
+
+    link();
+}
+
+void VbapLayout::pairs(QVector<QVector3D> const& directions)
+{
+    // speakers sorted by azimuth, each one paired with the next
+    QVector<quint16> order;
+    QVector<float> azimuths ( directions.size() );
+
+    for ( quint16 s = 0; s < directions.size(); ++s )
+    {
+        if ( directions[s].lengthSquared() < VBAP_EPSILON ) continue;
+        azimuths[s] = std::atan2( directions[s].x(), directions[s].y() );
+        order << s;
+    }
+
+    std::sort( order.begin(), order.end(), [&](quint16 a, quint16 b) {
+        return azimuths[a] < azimuths[b];
+    });
+
+    if ( order.size() < 2 ) return;
+
+    for ( quint16 i = 0; i < order.size(); ++i )
+    {
+        quint16 a = order[i], b = order[(i+1)%order.size()];
+        if ( a == b ) continue;
+
+        QVector3D la = directions[a].normalized();
+        QVector3D lb = directions[b].normalized();
+
+        // pairs spanning 180 degrees or more leave a gap
+        float det = la.x()*lb.y()-la.y()*lb.x();
+        if ( det >= -VBAP_EPSILON ) continue;
+
+        Triangle pair;
+        pair.speakers[0]    = a;
+        pair.speakers[1]    = b;
+        pair.speakers[2]    = 0;
+        pair.size           = 2;
+        pair.inverse[0]     = QVector3D(  lb.y(), -lb.x(), 0 )/det;
+        pair.inverse[1]     = QVector3D( -la.y(),  la.x(), 0 )/det;
+
+        m_triangles << pair;
+    }
+}
+
+void VbapLayout::triangles(QVector<QVector3D> const& directions)
+{
+    QVector<QVector3D> l;
+    QVector<quint16> index;
+
+    for ( quint16 s = 0; s < directions.size(); ++s )
+    {
+        if ( directions[s].lengthSquared() < VBAP_EPSILON ) continue;
+        l << directions[s].normalized();
+        index << s;
+    }
+
+    struct Candidate { quint16 v[3]; QVector3D normal; float perimeter; };
+    QVector<Candidate> candidates;
+    quint16 n = l.size();
+
+    // faces of the convex hull, facing away from the listener
+    for ( quint16 i = 0; i < n; ++i )
+    for ( quint16 j = i+1; j < n; ++j )
+    for ( quint16 k = j+1; k < n; ++k )
+    {
+        QVector3D normal = QVector3D::crossProduct( l[j]-l[i], l[k]-l[i] );
+        if ( normal.length() < VBAP_EPSILON ) continue;
+
+        normal.normalize();
+        float d = QVector3D::dotProduct( normal, l[i] );
+        if ( d < 0 ) { normal = -normal; d = -d; }
+
+        // the listener has to be inside the hull
+        if ( d <= VBAP_EPSILON ) continue;
+
+        QVector3D t[ 3 ] = { l[i], l[j], l[k] };
+        bool face = true;
+
+        for ( quint16 m = 0; m < n && face; ++m )
+        {
+            if ( m == i || m == j || m == k ) continue;
+            float dm = QVector3D::dotProduct( normal, l[m] );
+
+            if ( dm > d+VBAP_EPSILON ) face = false;
+            // another speaker within the triangle
+            else if ( dm > d-VBAP_EPSILON && inside(l[m], t, normal) ) face = false;
+        }
+
+        if ( !face ) continue;
+
+        Candidate candidate = { { i, j, k }, normal,
+            (l[j]-l[i]).length()+(l[k]-l[j]).length()+(l[i]-l[k]).length() };
+
+        candidates << candidate;
+    }
+
+    // faces with more than three speakers can be split several ways,
+    // keep the smallest triangles
+    std::sort( candidates.begin(), candidates.end(), [](Candidate const& a, Candidate const& b) {
+        return a.perimeter < b.perimeter;
+    });
+
+    QVector<Candidate> accepted;
+
+    for ( const auto& candidate : candidates )
+    {
+        QVector3D t[ 3 ] = { l[candidate.v[0]], l[candidate.v[1]], l[candidate.v[2]] };
+        bool free = true;
+
+        for ( const auto& other : accepted )
+        {
+            if ( (other.normal-candidate.normal).length() > VBAP_EPSILON ) continue;
+
+            QVector3D u[ 3 ] = { l[other.v[0]], l[other.v[1]], l[other.v[2]] };
+            if ( overlap(t, u, candidate.normal) ) { free = false; break; }
+        }
+
+        if ( !free ) continue;
+        accepted << candidate;
+
+        Triangle triangle;
+        triangle.size = 3;
+
+        for ( quint8 v = 0; v < 3; ++v )
+             triangle.speakers[v] = index[candidate.v[v]];
+
+        // rows of L are the speakers, L^-1 = [ l2 x l3, l3 x l1, l1 x l2 ] / det
+        float det = QVector3D::dotProduct( t[0], QVector3D::crossProduct(t[1], t[2]) );
+
+        triangle.inverse[0] = QVector3D::crossProduct( t[1], t[2] )/det;
+        triangle.inverse[1] = QVector3D::crossProduct( t[2], t[0] )/det;
+        triangle.inverse[2] = QVector3D::crossProduct( t[0], t[1] )/det;
+
+        m_triangles << triangle;
+    }
+}
+
+void VbapLayout::link()
+{
+    // neighbours share an edge (a speaker for pairs)
+    for ( qint32 a = 0; a < m_triangles.size(); ++a )
+    {
+        auto& ta = m_triangles[a];
+
+        for ( qint32 b = 0; b < m_triangles.size(); ++b )
+        {
+            if ( a == b ) continue;
+            auto& tb = m_triangles[b];
+            quint8 shared = 0;
+
+            for ( quint8 i = 0; i < ta.size; ++i )
+                for ( quint8 j = 0; j < tb.size; ++j )
+                    if ( ta.speakers[i] == tb.speakers[j] ) ++shared;
+
+            if ( shared == ta.size-1 ) ta.neighbours << b;
+        }
+    }
+}
+
+float VbapLayout::gains(Triangle const& triangle, QVector3D const& direction, float* out) const
+{
+    float min = 1;
+
+    for ( quint8 v = 0; v < triangle.size; ++v )
+    {
+        out[v] = QVector3D::dotProduct( direction, triangle.inverse[v] );
+        min = qMin( min, out[v] );
+    }
+
+    return min;
+}
+
+quint8 VbapLayout::pan(QVector3D direction, qint32& hint, quint16* speakers, float* out) const
+{
+    if ( m_planar ) direction.setZ( 0 );
+
+    if ( m_triangles.isEmpty() || direction.lengthSquared() < VBAP_EPSILON )
+         return 0;
+
+    direction.normalize();
+
+    float g[ 3 ];
+    qint32 found = -1;
+
+    // sources mostly move to the same or a neighbouring triangle
+    if ( hint >= 0 && hint < m_triangles.size() )
+    {
+        if ( gains(m_triangles[hint], direction, g) >= -VBAP_EPSILON )
+             found = hint;
+
+        else for ( const auto& t : m_triangles[hint].neighbours )
+        {
+            if ( gains(m_triangles[t], direction, g) >= -VBAP_EPSILON )
+            {
+                found = t;
+                break;
+            }
+        }
+    }
+
+    if ( found < 0 )
+    {
+        // otherwise, the enclosing triangle or, in a gap
+        // of the layout, the one it is closest to
+        float best = -FLT_MAX;
+
+        for ( qint32 t = 0; t < m_triangles.size(); ++t )
+        {
+            float min = gains( m_triangles[t], direction, g );
+
+            if ( min > best ) { best = min; found = t; }
+            if ( min >= -VBAP_EPSILON ) break;
+        }
+    }
+
+    hint = found;
+    const Triangle& triangle = m_triangles[found];
+    gains( triangle, direction, g );
+
+    float power = 0;
+
+    for ( quint8 v = 0; v < triangle.size; ++v )
+    {
+        g[v]  = qMax( g[v], 0.f );
+        power += g[v]*g[v];
+    }
+
+    if ( power <= 0 )
+    {
+        // far off the layout (e.g. behind a stereo pair): nearest speaker
+        quint16 nearest = 0;
+
+        for ( quint16 s = 1; s < m_directions.size(); ++s )
+            if ( QVector3D::dotProduct(direction, m_directions[s]) >
+                 QVector3D::dotProduct(direction, m_directions[nearest]) )
+                 nearest = s;
+
+        speakers[0] = nearest;
+        out[0] = 1;
+        return 1;
+    }
+
+    power = 1.f/std::sqrt(power);
+
+    quint8 count = 0;
+
+    for ( quint8 v = 0; v < triangle.size; ++v )
+    {
+        if ( g[v] == 0.f ) continue;
+        speakers[count] = triangle.speakers[v];
+        out[count++] = g[v]*power;
+    }
+
+    return count;
+}
@@ -0,0 +1,50 @@
+#ifndef VBAP_HPP
+#define VBAP_HPP
+
+#include <QVector>
+#include <QVector3D>
+
+// vector base amplitude panning over a speaker layout:
+// the speakers' directions are triangulated once (convex hull),
+// or paired by azimuth when they all lie in the horizontal plane.
+// a direction is then panned on the (at most) three speakers
+// of the triangle enclosing it
+
+class VbapLayout
+{
+    public:
+    // directions of the speakers from the listener,
+    // all with z == 0 for a horizontal layout
+    void setSpeakers ( QVector<QVector3D> const& directions );
+
+    bool planar ( ) const { return m_planar; }
+    quint16 ntriangles ( ) const { return m_triangles.size(); }
+
+    // fills the speakers and their (power normalized) gains for 'direction',
+    // returns their count. the search starts from triangle 'hint',
+    // then its neighbours, and 'hint' is updated to the enclosing triangle
+    quint8 pan ( QVector3D direction, qint32& hint, quint16* speakers, float* gains ) const;
+
+    private:
+    struct Triangle
+    {
+        quint16 speakers [ 3 ];
+        quint8 size;
+
+        // columns of the inverse speaker matrix: gain[i] = direction . inverse[i]
+        QVector3D inverse [ 3 ];
+        QVector<qint32> neighbours;
+    };
+
+    float gains ( Triangle const& triangle, QVector3D const& direction, float* out ) const;
+
+    void pairs      ( QVector<QVector3D> const& directions );
+    void triangles  ( QVector<QVector3D> const& directions );
+    void link       ( );
+
+    QVector<Triangle> m_triangles;
+    QVector<QVector3D> m_directions;
+    bool m_planar = false;
+};
+
+#endif // VBAP_HPP
@@ -2,19 +2,18 @@
 
 #include <cmath>
 #include <QtDebug>
+#include <source/audio/simd.hpp>
+#include <QtConcurrent>
 
 #define BUFSR m_soundfile->sampleRate()
 
 StreamSampler::StreamSampler() : StreamNode()
 {
     SETTYPE( StreamType::Generator );
-    // building sin envelopes
-    for ( int i = 0; i < ENV_RESOLUTION; ++ i )
-    {
-        auto env_value    = sin ((float)i/ENV_RESOLUTION*M_PI_2);
-        m_attack_env[i]   = env_value;
-        m_release_env[i]  = 1.f-env_value;
-    }
+    // envelopes are shared by all samplers
+    m_attack_env    = Tables::attack  ( m_attack_curve );
+    m_release_env   = Tables::release ( m_release_curve );
+    m_xfade_env     = Tables::attack  ( Curve::Sine );
 
     setActive( false );
 }
@@ -33,6 +32,9 @@ StreamSampler::~StreamSampler()
     delete m_xfade_buffer;
     delete m_current_buffer;
     delete m_next_buffer;
+    delete m_resampler;
+
+    MemoryBudget::instance().release(this);
 }
 
 inline quint64 ms_to_samples(quint64 x, quint64 sr)
@@ -63,6 +65,18 @@ void StreamSampler::setRelease(quint32 release)
     m_release = release;
 }
 
+void StreamSampler::setAttackCurve(Curve::Values curve)
+{
+    m_attack_curve  = curve;
+    m_attack_env    = Tables::attack( curve );
+}
+
+void StreamSampler::setReleaseCurve(Curve::Values curve)
+{
+    m_release_curve = curve;
+    m_release_env   = Tables::release( curve );
+}
+
 void StreamSampler::setStart(qreal start)
 {
     m_start = start;
@@ -91,6 +105,11 @@ void StreamSampler::setRate(qreal rate)
     m_rate = rate;
 }
 
+void StreamSampler::setQuality(Interpolation::Values quality)
+{
+    m_quality = quality;
+}
+
 void StreamSampler::setPath(QString path)
 {
     m_path = path;
@@ -145,13 +164,16 @@ void StreamSampler::componentComplete()
     m_next_buffer     = new float[ BUFSTREAM_NSAMPLES_DEFAULT*nch ]();
     m_buffer_size     = BUFSTREAM_NSAMPLES_DEFAULT;
 
+    MemoryBudget::instance().book( this, m_path, BUFSTREAM_NSAMPLES_DEFAULT*nch*2*sizeof(float),
+                                   MemoryBudget::Streamed );
+
     m_streamer->moveToThread(&m_streamer_thread);
     QObject::connect(this, SIGNAL(next(float*)), m_streamer, SLOT(next(float*)));
     QObject::connect(this, SIGNAL(reset(float*)), m_streamer, SLOT(reset(float*)));
     QObject::connect(m_streamer, SIGNAL(bufferLoaded()), this, SLOT(onNextBufferReady()));
 }
 
-void StreamSampler::initialize(qint64)
+void StreamSampler::initialize(qint64 nsamples)
 {
     m_xfade_inc     = static_cast<float>(ENV_RESOLUTION/(float)ms_to_samples(m_xfade, SAMPLERATE));
     m_attack_inc    = static_cast<float>(ENV_RESOLUTION/(float)ms_to_samples(m_attack, SAMPLERATE));
@@ -163,9 +185,21 @@ void StreamSampler::initialize(qint64)
 
     quint64 srate   = m_soundfile->sampleRate();
 
+    // files are streamed at their own rate,
+    // conversion to the stream rate is done on the fly
+    delete m_resampler;
+    m_resampler = new Resampler( m_num_outputs, nsamples, m_quality );
+
     // load crossfade buffer
-    m_xfade_buffer = new float[ BUFSTREAM_MAX_XFADELEN*SAMPLERATE*m_num_outputs ]();
-    m_soundfile->buffer( m_xfade_buffer, m_start*srate, BUFSTREAM_MAX_XFADELEN*SAMPLERATE );
+    quint64 head    = BUFSTREAM_MAX_XFADELEN*SAMPLERATE;
+    delete [ ] m_xfade_buffer;
+    m_xfade_buffer  = new float[ head*m_num_outputs ]();
+    m_soundfile->buffer( m_xfade_buffer, m_start*srate, head );
+
+    // the head stays resident, the rest is streamed
+    MemoryBudget::instance().book( this, m_path,
+                                   (head+BUFSTREAM_NSAMPLES_DEFAULT*2)*m_num_outputs*sizeof(float),
+                                   MemoryBudget::Streamed );
 
     // start streamer thread, load first buffer
     // start sample is the end of the 'up' xfade
@@ -220,9 +254,29 @@ inline void StreamSampler::reset()
     m_xfade_phase       = 0;
     m_release_phase     = 0;
     m_first_play        = true;
+
+    if ( m_resampler ) m_resampler->reset();
 }
 
-float** StreamSampler::process(float** buf, qint64 nsamples)
+float** StreamSampler::process(float**, qint64 nsamples)
+{
+    auto out        = m_out;
+    double ratio    = m_rate*BUFSR/SAMPLERATE;
+    ratio = qBound( 1.0/RESAMPLER_MAX_RATIO, ratio, (double) RESAMPLER_MAX_RATIO );
+
+    // always fed through the resampler, which copies at unity rate:
+    // bypassing it would leave its history stale and shift the output
+    // by its latency whenever the rate moves through 1
+    quint32 required = m_resampler->required( nsamples, ratio );
+    render( m_resampler->input(), required );
+
+    m_resampler->commit  ( required );
+    m_resampler->process ( out, nsamples, ratio );
+
+    return out;
+}
+
+void StreamSampler::render(float** out, qint64 nsamples)
 {
     auto bufdata        = m_current_buffer;
     auto xfdata         = m_xfade_buffer;
@@ -232,7 +286,6 @@ float** StreamSampler::process(float** buf, qint64 nsamples)
     auto spos           = m_phase;
     auto bpos           = m_stream_phase;
     auto xpos           = m_xfade_buf_phase;
-    auto out            = m_out;
     auto nch            = m_num_outputs;
     auto loop           = m_loop;
 
@@ -242,6 +295,7 @@ float** StreamSampler::process(float** buf, qint64 nsamples)
     auto release_inc    = m_release_inc;
 
     auto attack         = m_attack_env;
+    auto xfade          = m_xfade_env;
     auto attack_end     = m_attack_end;
     auto attack_phase   = m_attack_phase;
     auto attack_inc     = m_attack_inc;
@@ -265,9 +319,10 @@ float** StreamSampler::process(float** buf, qint64 nsamples)
         if ( !m_playing )
         {
             // filling with zeroes before going inactive
-            for ( quint16 ch = 0; ch < nch; ++ch )
-                out[ch][s] = 0.f;
-            return out;
+            for ( ; s < nsamples; ++s )
+                for ( quint16 ch = 0; ch < nch; ++ch )
+                    out[ch][s] = 0.f;
+            return;
         }
 
         if ( spos == xfade_length && bpos == 0 ) emit next( m_next_buffer );
@@ -339,7 +394,7 @@ float** StreamSampler::process(float** buf, qint64 nsamples)
             //          get interpolated data from attack envelope
             int y       = floor(xfade_phase);
             float x     = (float) xfade_phase-y;
-            float xfu   = lininterp(x, attack[y], attack[y+1]);
+            float xfu   = lininterp(x, xfade[y], xfade[y+1]);
             float xfd   = 1.f - xfu;
 
             for ( quint16 ch = 0; ch < nch; ++ch )
@@ -427,30 +482,35 @@ float** StreamSampler::process(float** buf, qint64 nsamples)
     m_attack_phase      = attack_phase;
     m_xfade_phase       = xfade_phase;
     m_release_phase     = release_phase;
-
-    return out;
 }
 
 //-----------------------------------------------------------------------------------
 
-Sampler::Sampler() : StreamNode()
+Sampler::Sampler() : StreamNode(), m_commands(SAMPLER_MAX_COMMANDS)
 {    
     SETTYPE( StreamType::Generator );
-    // building sin envelopes
-    for ( int i = 0; i < ENV_RESOLUTION; ++ i )
-    {
-        auto env_value    = sin ((float)i/ENV_RESOLUTION*M_PI_2);
-        m_attack_env[i]   = env_value;
-        m_release_env[i]  = 1.f-env_value;
-    }
+    // envelopes are shared by all samplers
+    m_attack_env    = Tables::attack  ( m_attack_curve );
+    m_release_env   = Tables::release ( m_release_curve );
+    m_xfade_env     = Tables::attack  ( Curve::Sine );
 
+    m_voices.resize(1);
     setActive(false);
 }
 
 Sampler::~Sampler()
 {
+    m_loader.waitForFinished();
+    StreamNode::deleteBuffer(m_voice_buffer, m_num_outputs, m_stream_properties.block_size);
+
+    for ( const auto& voice : m_voices )
+    {
+        delete voice.resampler;
+        delete voice.reader;
+    }
+
     delete m_soundfile;
-    delete m_buffer;
+    MemoryBudget::instance().release(this);
 }
 
 void Sampler::expose(WPNNode* root)
@@ -470,30 +530,96 @@ void Sampler::componentComplete()
 {
     if ( m_path.isEmpty() ) return;
 
-    m_soundfile     = new Soundfile(m_path);
-    quint16 nch     = m_soundfile->nchannels();
-    quint64 srate   = m_soundfile->sampleRate();
+    if ( !m_info.nchannels )
+    {
+        m_soundfile         = new Soundfile(m_path);
+        m_info.nchannels    = m_soundfile->nchannels();
+        m_info.sample_rate  = m_soundfile->sampleRate();
+        m_info.nframes      = m_soundfile->nsamples();
+    }
+
+    quint16 nch     = m_info.nchannels;
+    quint64 srate   = m_info.sample_rate;
+
+    quint64 start   = m_start*srate;
+    quint64 len;
 
     if ( m_length == 0 ) // if length unspecified take from start to the end of the fle
     {
-        quint64 nsamples = m_soundfile->nsamples()-(m_start*srate);
-        m_length = (qreal) nsamples/srate;
-        m_buffer = new float[nsamples*nch]();
-        m_buffer_size = nsamples;
+        len = m_info.nframes-start;
+        m_length = (qreal) len/srate;
+    }
+    else len = (m_end-m_start)*srate;
 
-        m_soundfile->buffer(m_buffer, m_start*srate, nsamples);
+    // only the header has been read so far, book the memory now
+    // so that budget decisions don't wait for the decoding
+    MemoryBudget::instance().book( this, m_path, len*nch*SampleBuffer::bytesPerSample(m_storage),
+                                   MemoryBudget::Resident );
+
+    SETN_IN  ( 0 );
+    SETN_OUT ( nch );
+
+    if ( SampleCache::instance().enabled() )
+         m_cache_key = SampleCache::key( m_path, start, len, m_storage, m_quality );
+
+    // samplers decode their files in parallel on the global thread pool,
+    // the stream waits for them when initializing
+    m_region_start  = start;
+    m_region_length = len;
+    m_loader = QtConcurrent::run( this, &Sampler::load );
+}
+
+void Sampler::load()
+{
+    // the stream's rate is not known yet, map the most recent entry,
+    // initialize() looks for one at the right rate if it differs
+    if ( !m_cache_key.isEmpty() )
+    {
+        auto cached = SampleCache::instance().fetch( m_cache_key );
+
+        if ( !cached.isNull() )
+        {
+            m_sample        = cached;
+            m_buffer_size   = cached->nframes();
+            m_cached        = true;
+            return;
+        }
     }
+
+    decode();
+}
+
+void Sampler::decode()
+{
+    quint64 start   = m_region_start;
+    quint64 len     = m_region_length;
+
+    if ( !m_soundfile )
+         m_soundfile = new Soundfile(m_path);
+
+    quint16 nch     = m_soundfile->nchannels();
+    quint64 srate   = m_soundfile->sampleRate();
+    auto sample     = SampleBufferPtr( new SampleBuffer(nch, len, srate, m_storage) );
+
+    if ( m_storage == SampleFormat::Float32 )
+         m_soundfile->buffer(sample->data(), start, len);
     else
     {
-        quint64 len = (m_end-m_start)*srate;
-        m_buffer = new float[len*nch]();
-        m_buffer_size = len;
+        // never hold the whole file as floats,
+        // decode by blocks straight into the compact storage
+        QVector<float> block ( SAMPLER_LOAD_BLOCK*nch );
 
-        m_soundfile->buffer(m_buffer, m_start*srate, len);
+        for ( quint64 f = 0; f < len; f += SAMPLER_LOAD_BLOCK )
+        {
+            quint64 n = qMin<quint64>( SAMPLER_LOAD_BLOCK, len-f );
+            m_soundfile->buffer( block.data(), start+f, n );
+            sample->encode( f, n, block.constData() );
+        }
     }
 
-    SETN_IN  ( 0 );
-    SETN_OUT ( nch );
+    m_sample        = sample;
+    m_buffer_size   = sample->nframes();
+    m_cached        = false;
 }
 
 void Sampler::setPath(QString path)
@@ -523,6 +649,18 @@ void Sampler::setRelease(quint32 release)
     m_release = release;
 }
 
+void Sampler::setAttackCurve(Curve::Values curve)
+{
+    m_attack_curve  = curve;
+    m_attack_env    = Tables::attack( curve );
+}
+
+void Sampler::setReleaseCurve(Curve::Values curve)
+{
+    m_release_curve = curve;
+    m_release_env   = Tables::release( curve );
+}
+
 void Sampler::setStart(qreal start)
 {
     m_start = start;
@@ -545,73 +683,332 @@ void Sampler::setRate(qreal rate)
     m_rate = rate;
 }
 
+void Sampler::setQuality(Interpolation::Values quality)
+{
+    m_quality = quality;
+}
+
+void Sampler::setPolyphony(int polyphony)
+{
+    // voices are preallocated when the stream is initialized,
+    // a change only takes effect from then on
+    m_polyphony = qBound<int>(1, polyphony, SAMPLER_MAX_POLYPHONY);
+}
+
+void Sampler::setStealing(Stealing stealing)
+{
+    m_stealing = stealing;
+}
+
+void Sampler::setStorage(SampleFormat::Values storage)
+{
+    // takes effect at load time,
+    // or when the stream is initialized if already loaded
+    m_storage = storage;
+}
+
 void Sampler::play()
 {
-    m_playing = true;
-    if ( !m_active ) setActive(true);
+    // voices are started from the audio thread
+    // counted before it can be popped
+    m_pending.fetch_add(1);
+
+    if ( !m_commands.push(Command::Play) )
+    {
+        m_pending.fetch_sub(1);
+        return;
+    }
+
+    setActive(true);
 }
 
 void Sampler::stop()
 {
-    m_releasing = true;
+    if ( !m_active ) return;
+    m_commands.push(Command::Stop);
 }
 
-void Sampler::initialize(qint64)
+void Sampler::initialize(qint64 nsamples)
 {   
+    m_loader.waitForFinished();
+
+    if ( !m_sample.isNull() && m_sample->sampleRate() != SAMPLERATE )
+    {
+        auto cached = SampleCache::instance().fetch( m_cache_key, SAMPLERATE );
+
+        if ( !cached.isNull() )
+        {
+            m_sample = cached;
+            m_cached = true;
+        }
+        else
+        {
+            // a cached entry may already be converted to another rate,
+            // converting it again would compound the interpolation loss
+            if ( m_sample->sampleRate() != m_info.sample_rate )
+                 decode();
+
+            // convert once to the stream's rate, identical files
+            // and regions share the same converted buffer
+            QString key = QString("%1|%2|%3").arg(m_path).arg(m_start).arg(m_length);
+            m_sample    = Resampler::convert( m_sample, SAMPLERATE, m_quality, key );
+            m_cached    = false;
+        }
+    }
+
+    if ( !m_sample.isNull() )
+    {
+        m_sample        = SampleBuffer::convert( m_sample, m_storage );
+        m_buffer_size   = m_sample->nframes();
+        MemoryBudget::instance().book( this, m_path, m_sample->bytes(), MemoryBudget::Resident );
+
+        if ( !m_cached && !m_cache_key.isEmpty() )
+        {
+            SampleCache::instance().store( m_cache_key, m_sample );
+            m_cached = true;
+        }
+    }
+
     m_xfade_inc     = static_cast<float>(ENV_RESOLUTION/(float)ms_to_samples(m_xfade, SAMPLERATE));
     m_attack_inc    = static_cast<float>(ENV_RESOLUTION/(float)ms_to_samples(m_attack, SAMPLERATE));
     m_release_inc   = static_cast<float>(ENV_RESOLUTION/(float)ms_to_samples(m_release, SAMPLERATE));
+    m_steal_inc     = static_cast<float>(ENV_RESOLUTION/(float)ms_to_samples(SAMPLER_STEAL_FADE, SAMPLERATE));
 
     m_release_end   = ENV_RESOLUTION;
     m_attack_end    = ms_to_samples(m_attack, SAMPLERATE);
 
     m_xfade_length  = ms_to_samples(m_xfade, SAMPLERATE);
     m_xfade_point   = m_buffer_size-m_xfade_length;
+
+    for ( auto& voice : m_voices )
+    {
+        delete voice.resampler;
+        delete voice.reader;
+    }
+
+    // the pool is only resized here, the audio thread
+    // goes by its size rather than by the 'polyphony' property
+    m_voices.fill( SamplerVoice(), m_polyphony == 1 ? 1 : m_polyphony+1 );
+
+    for ( auto& voice : m_voices )
+    {
+        voice.resampler = new Resampler( m_num_outputs, nsamples, m_quality );
+        voice.reader    = m_sample.isNull() ? nullptr : new SampleReader( m_sample );
+    }
+
+    StreamNode::deleteBuffer ( m_voice_buffer, m_num_outputs, m_stream_properties.block_size );
+    m_voice_buffer = nullptr;
+
+    if ( m_voices.size() > 1 )
+         StreamNode::allocateBuffer ( m_voice_buffer, m_num_outputs, nsamples );
+}
+
+SamplerVoice* Sampler::allocate()
+{
+    SamplerVoice* free      = nullptr;
+    SamplerVoice* victim    = nullptr;
+    quint16 audible         = 0;
+
+    for ( auto& voice : m_voices )
+    {
+        if ( !voice.playing )
+        {
+            if ( !free ) free = &voice;
+            continue;
+        }
+
+        // voices that are already fading out don't count
+        if ( voice.stolen ) continue;
+        audible++;
+
+        if ( !victim ) victim = &voice;
+        else if ( m_stealing == Stealing::Oldest && voice.age < victim->age )
+            victim = &voice;
+        else if ( m_stealing == Stealing::Quietest && voice.level < victim->level )
+            victim = &voice;
+    }
+
+    // the pool holds polyphony+1 voices
+    if ( free && audible+1 < m_voices.size() )
+        return free;
+
+    if ( victim )
+    {
+        // fade out the victim quickly,
+        // its replacement takes the spare voice
+        victim->stolen          = true;
+        victim->releasing       = true;
+        victim->release_phase   = 0.f;
+        victim->release_inc     = m_steal_inc;
+
+        if ( free ) return free;
+        return victim;
+    }
+
+    // every voice is already fading out, reuse the oldest one
+    victim = &m_voices[0];
+    for ( auto& voice : m_voices )
+        if ( voice.age < victim->age ) victim = &voice;
+
+    return victim;
+}
+
+void Sampler::processCommands()
+{
+    Command command;
+
+    while ( m_commands.pop(command) )
+    {
+        if ( command == Command::Play )
+             m_pending.fetch_sub(1);
+
+        if ( command == Command::Stop )
+        {
+            for ( auto& voice : m_voices )
+            {
+                if ( !voice.playing || voice.releasing ) continue;
+
+                voice.releasing     = true;
+                voice.release_phase = 0.f;
+                voice.release_inc   = m_release_inc;
+            }
+        }
+
+        // nothing was loaded, there's nothing to play
+        else if ( m_sample.isNull() ) continue;
+
+        else if ( m_voices.size() == 1 )
+        {
+            auto& voice = m_voices[0];
+            if ( voice.playing ) continue;
+
+            voice.reset();
+            voice.resampler->reset();
+            voice.playing   = true;
+        }
+
+        else
+        {
+            auto voice = allocate();
+
+            voice->reset();
+            voice->resampler->reset();
+            voice->playing  = true;
+            voice->level    = 1.f;
+            voice->age      = ++m_voice_age;
+        }
+    }
 }
 
 float** Sampler::process(float**, qint64 le)
 {
-    auto bufdata        = m_buffer;
+    auto out    = m_out;
+    auto nch    = m_num_outputs;
+    bool any    = false;
+
+    processCommands();
+
+    if ( m_voices.size() == 1 )
+    {
+        auto& voice = m_voices[0];
+
+        if ( voice.playing ) renderVoice( voice, out, le );
+        else StreamNode::resetBuffer( out, nch, le );
+    }
+    else
+    {
+        // each voice renders in its own buffer
+        // which is then summed to the output
+        auto vbuf = m_voice_buffer;
+        StreamNode::resetBuffer( out, nch, le );
+
+        for ( auto& voice : m_voices )
+        {
+            if ( !voice.playing ) continue;
+
+            renderVoice( voice, vbuf, le );
+            float level = 0.f;
+
+            for ( quint16 ch = 0; ch < nch; ++ch )
+            {
+                simd::add( out[ch], vbuf[ch], le );
+                level = qMax( level, simd::peak(vbuf[ch], le) );
+            }
+
+            voice.level = level;
+        }
+    }
+
+    for ( const auto& voice : m_voices )
+          any |= voice.playing;
+
+    // go inactive once every voice has ended, unless new triggers are
+    // already waiting. one may land after the check, while play() still
+    // sees the sampler active: it's looked for again once deactivated
+    if ( !any && !m_pending.load() )
+    {
+        setActive( false );
+        if ( m_pending.load() ) setActive( true );
+    }
+
+    return out;
+}
+
+void Sampler::renderVoice(SamplerVoice& voice, float** out, qint64 le)
+{
+    double ratio = qBound( 1.0/RESAMPLER_MAX_RATIO, (double) m_rate, (double) RESAMPLER_MAX_RATIO );
+
+    // render the voice at its own rate, then interpolate (or copy, at
+    // unity rate) so that the resampler's history stays continuous
+    auto resampler      = voice.resampler;
+    quint32 required    = resampler->required( le, ratio );
+
+    render( voice, resampler->input(), required );
+    resampler->commit  ( required );
+    resampler->process ( out, le, ratio );
+}
+
+void Sampler::render(SamplerVoice& voice, float** out, qint64 le)
+{
+    auto reader         = voice.reader;
     auto bufnsamples    = m_buffer_size;
-    auto first          = m_first_play;
-    auto spos           = m_phase;
-    auto out            = m_out;
+    auto first          = voice.first_play;
+    auto spos           = voice.phase;
     auto nch            = m_num_outputs;
     auto loop           = m_loop;
 
     auto attack         = m_attack_env;
+    auto xfade          = m_xfade_env;
     auto attack_end     = m_attack_end;
-    auto attack_phase   = m_attack_phase;
+    auto attack_phase   = voice.attack_phase;
     auto attack_inc     = m_attack_inc;
-    auto release_phase  = m_release_phase;
+    auto release_phase  = voice.release_phase;
 
     auto release        = m_release_env;
-    auto release_inc    = m_release_inc;
+    auto release_inc    = voice.release_inc;
     auto release_end    = m_release_end;
 
     auto xfade_point    = m_xfade_point;
-    auto xfade_phase    = m_xfade_phase;
+    auto xfade_phase    = voice.xfade_phase;
     auto xfade_inc      = m_xfade_inc;
     auto xfade_len      = m_xfade_length;
 
-    bufdata+= spos*nch;
+    if ( !reader )
+    {
+        StreamNode::resetBuffer( out, nch, le );
+        voice.reset();
+        return;
+    }
 
     if ( loop && spos > attack_end )
     {
-        first        = false;
-        m_first_play = first;
+        first            = false;
+        voice.first_play = first;
     }
 
     for ( qint64 s = 0; s < le; ++s )
     {
-        if ( !m_playing )
-        {
-            for ( quint16 ch = 0; ch < nch; ++ch )
-                out[ch][s] = 0.f;
-            return out;
-        }
-
-        else if ( first && spos < attack_end )
+        if ( first && spos < attack_end )
         {
             //          if first play && phase is in the 'attack zone'
             //          get interpolated data from envelope
@@ -619,11 +1016,10 @@ float** Sampler::process(float**, qint64 le)
             float x     = (float) attack_phase-y;
             float e     = lininterp(x, attack[y], attack[y+1]);
 
+            auto frame  = reader->frame(spos);
+
             for ( quint16 ch = 0; ch < nch; ++ch )
-            {
-                out[ch][s] = *bufdata*e;
-                bufdata++;
-            }
+                out[ch][s] = frame[ch]*e;
 
             spos++;
             attack_phase += attack_inc;
@@ -634,16 +1030,15 @@ float** Sampler::process(float**, qint64 le)
             //          get interpolated data from envelope
             int y       = floor(xfade_phase);
             float x     = (float) xfade_phase-y;
-            float xfu   = lininterp(x, attack[y], attack[y+1]);
+            float xfu   = lininterp(x, xfade[y], xfade[y+1]);
             float xfd   = 1.f - xfu;
 
+            auto frame  = reader->frame(spos);
+            auto rframe = reader->frame(spos-xfade_point);
+
             for ( quint16 ch = 0; ch < nch; ++ch )
-            {
-                float* rphs = bufdata-xfade_point*nch;
-                out[ch][s]  = *bufdata*xfd + *rphs*xfu;
+                out[ch][s]  = frame[ch]*xfd + rframe[ch]*xfu;
 
-                bufdata++;
-            }
             spos++;
             xfade_phase += xfade_inc;
         }
@@ -655,56 +1050,48 @@ float** Sampler::process(float**, qint64 le)
                 // if phase reaches end of 'crossfade zone'
                 // main phase continues from end of 'up' crossfade
                 // reset envelope phase
-                bufdata         = &m_buffer[xfade_len*nch];
+                auto frame      = reader->frame(xfade_len);
                 xfade_phase     = 0;
 
                 for ( quint16 ch = 0; ch < nch; ++ch )
-                    out[ch][s] = *bufdata++;
+                    out[ch][s] = frame[ch];
 
                 spos = xfade_len+1;
             }
             else
             {
-                // if not looping, stop and set inactive
+                // if not looping, the voice ends here
                 // zero out rest of the buffer
-                for ( quint16 ch = 0; ch < nch; ++ch )
-                    out[ch][s] = 0.f;
+                for ( ; s < le; ++s )
+                    for ( quint16 ch = 0; ch < nch; ++ch )
+                        out[ch][s] = 0.f;
 
-                m_phase             = 0;
-                m_attack_phase      = 0;
-                m_xfade_phase       = 0;
-                m_release_phase     = 0;
-                m_playing           = false;
-                m_first_play        = true;
-                setActive          ( false );
-                m_releasing         = false;
+                voice.reset();
+                return;
             }
         }
         else
         {
             // normal behaviour
+            auto frame = reader->frame(spos);
+
             for ( quint16 ch = 0; ch < nch; ++ch )
-                out[ch][s] = *bufdata++;
+                out[ch][s] = frame[ch];
 
             spos++;
         }
 
-        if ( m_releasing )
+        if ( voice.releasing )
         {
             // if reaching end of release envelope
             if ( release_phase >= release_end )
             {
-                m_phase             = 0;
-                m_attack_phase      = 0;
-                m_xfade_phase       = 0;
-                m_release_phase     = 0;
-                m_playing           = false;
-                m_first_play        = true;
-                setActive          ( false );
-                m_releasing         = false;
+                for ( ; s < le; ++s )
+                    for ( quint16 ch = 0; ch < nch; ++ch )
+                        out[ch][s] = 0.f;
 
-                for ( quint16 ch = 0; ch < nch; ++ch )
-                    out[ch][s] = 0.f;
+                voice.reset();
+                return;
             }
 
             else
@@ -721,11 +1108,211 @@ float** Sampler::process(float**, qint64 le)
         }
     }
 
-    // update member values
-    m_phase             = spos;
-    m_attack_phase      = attack_phase;
-    m_xfade_phase       = xfade_phase;
-    m_release_phase     = release_phase;
+    // update voice state
+    voice.phase             = spos;
+    voice.attack_phase      = attack_phase;
+    voice.xfade_phase       = xfade_phase;
+    voice.release_phase     = release_phase;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+AutoSampler::AutoSampler() : StreamNode()
+{
+    SETTYPE( StreamType::Generator );
+    setActive( false );
+}
+
+AutoSampler::~AutoSampler()
+{
+    delete m_player;
+}
+
+quint64 AutoSampler::residentSize() const
+{
+    // header only, no sample data is read
+    Soundfile soundfile ( m_path );
+    quint64 srate   = soundfile.sampleRate();
+    quint64 start   = m_start*srate;
+    quint64 len     = m_length == 0 ? soundfile.nsamples()-qMin<quint64>(start, soundfile.nsamples()) :
+                                      (m_end-m_start)*srate;
+
+    return len*soundfile.nchannels()*SampleBuffer::bytesPerSample(m_storage);
+}
+
+void AutoSampler::componentComplete()
+{
+    if ( m_path.isEmpty() ) return;
+
+    bool resident = m_mode == Mode::Resident ||
+                  ( m_mode == Mode::Auto && MemoryBudget::instance().fits(residentSize()) );
+
+    if ( resident )
+    {
+        m_sampler = new Sampler;
+        m_sampler->setPath          ( m_path );
+        m_sampler->setStorage       ( m_storage );
+        m_sampler->setStart         ( m_start );
+        if ( m_length > 0 ) m_sampler->setLength( m_length );
+        m_player  = m_sampler;
+    }
+    else
+    {
+        m_streamer = new StreamSampler;
+        m_streamer->setPath         ( m_path );
+        m_streamer->setStart        ( m_start );
+        if ( m_length > 0 ) m_streamer->setLength( m_length );
+        m_player   = m_streamer;
+    }
+
+    // remaining properties are forwarded by their setters
+    setLoop         ( m_loop );
+    setXfade        ( m_xfade );
+    setAttack       ( m_attack );
+    setRelease      ( m_release );
+    setAttackCurve  ( m_attack_curve );
+    setReleaseCurve ( m_release_curve );
+    setRate         ( m_rate );
+    setQuality      ( m_quality );
+
+    m_player->componentComplete();
+    m_length = resident ? m_sampler->length() : m_streamer->length();
+    m_end    = m_start+m_length;
+
+    SETN_IN  ( 0 );
+    SETN_OUT ( m_player->numOutputs() );
 
+    emit residentChanged();
+}
+
+void AutoSampler::expose(WPNNode* root)
+{
+    auto funcs = m_exp_node->createSubnode("functions");
+    auto play = funcs->createSubnode("play");
+    auto stop = funcs->createSubnode("stop");
+
+    play->setType(Type::Impulse);
+    stop->setType(Type::Impulse);
+
+    QObject::connect(play, SIGNAL(valueReceived(QVariant)), this, SLOT(play()));
+    QObject::connect(stop, SIGNAL(valueReceived(QVariant)), this, SLOT(stop()));
+}
+
+void AutoSampler::initialize(qint64)
+{
+    if ( m_player ) m_player->preinitialize(m_stream_properties);
+}
+
+float** AutoSampler::process(float**, qint64 le)
+{
+    auto out = m_player->preprocess( nullptr, le );
+
+    // follow the player's state
+    if ( !m_player->active() ) setActive(false);
     return out;
 }
+
+void AutoSampler::play()
+{
+    if ( !m_player ) return;
+
+    if ( m_sampler ) m_sampler->play();
+    else m_streamer->play();
+
+    if ( !m_active ) setActive(true);
+}
+
+void AutoSampler::stop()
+{
+    if ( m_sampler ) m_sampler->stop();
+    else if ( m_streamer ) m_streamer->stop();
+}
+
+void AutoSampler::setPath(QString path)
+{
+    m_path = path;
+}
+
+void AutoSampler::setMode(Mode mode)
+{
+    m_mode = mode;
+}
+
+void AutoSampler::setLoop(bool loop)
+{
+    m_loop = loop;
+    if ( m_sampler ) m_sampler->setLoop(loop);
+    else if ( m_streamer ) m_streamer->setLoop(loop);
+}
+
+void AutoSampler::setXfade(quint32 xfade)
+{
+    m_xfade = xfade;
+    if ( m_sampler ) m_sampler->setXfade(xfade);
+    else if ( m_streamer ) m_streamer->setXfade(xfade);
+}
+
+void AutoSampler::setAttack(quint32 attack)
+{
+    m_attack = attack;
+    if ( m_sampler ) m_sampler->setAttack(attack);
+    else if ( m_streamer ) m_streamer->setAttack(attack);
+}
+
+void AutoSampler::setRelease(quint32 release)
+{
+    m_release = release;
+    if ( m_sampler ) m_sampler->setRelease(release);
+    else if ( m_streamer ) m_streamer->setRelease(release);
+}
+
+void AutoSampler::setAttackCurve(Curve::Values curve)
+{
+    m_attack_curve = curve;
+    if ( m_sampler ) m_sampler->setAttackCurve(curve);
+    else if ( m_streamer ) m_streamer->setAttackCurve(curve);
+}
+
+void AutoSampler::setReleaseCurve(Curve::Values curve)
+{
+    m_release_curve = curve;
+    if ( m_sampler ) m_sampler->setReleaseCurve(curve);
+    else if ( m_streamer ) m_streamer->setReleaseCurve(curve);
+}
+
+void AutoSampler::setStart(qreal start)
+{
+    m_start = start;
+}
+
+void AutoSampler::setEnd(qreal end)
+{
+    m_end       = end;
+    m_length    = end-m_start;
+}
+
+void AutoSampler::setLength(qreal length)
+{
+    m_length    = length;
+    m_end       = m_start+length;
+}
+
+void AutoSampler::setRate(qreal rate)
+{
+    m_rate = rate;
+    if ( m_sampler ) m_sampler->setRate(rate);
+    else if ( m_streamer ) m_streamer->setRate(rate);
+}
+
+void AutoSampler::setQuality(Interpolation::Values quality)
+{
+    m_quality = quality;
+    if ( m_sampler ) m_sampler->setQuality(quality);
+    else if ( m_streamer ) m_streamer->setQuality(quality);
+}
+
+void AutoSampler::setStorage(SampleFormat::Values storage)
+{
+    m_storage = storage;
+    if ( m_sampler ) m_sampler->setStorage(storage);
+}
@@ -3,14 +3,27 @@
 
 #include <source/audio/audio.hpp>
 #include <source/audio/soundfile.hpp>
+#include <source/audio/ringbuffer.hpp>
+#include <source/audio/resampler.hpp>
+#include <source/audio/tables.hpp>
+#include <source/audio/memorybudget.hpp>
+#include <source/audio/samplecache.hpp>
+#include <source/audio/sampleindex.hpp>
 #include <QQmlParserStatus>
 #include <QThread>
+#include <QFuture>
+#include <atomic>
 
-#define ENV_RESOLUTION 32768
 #define BUFSTREAM_MAX_XFADELEN 5
 // in seconds
 #define BUFSTREAM_NSAMPLES_DEFAULT 131072
 // approx. 3 seconds buffer
+#define SAMPLER_MAX_POLYPHONY 64
+#define SAMPLER_MAX_COMMANDS 256
+#define SAMPLER_STEAL_FADE 5
+// in milliseconds
+#define SAMPLER_LOAD_BLOCK 65536
+// in frames, compact storage is filled block by block
 
 class StreamSampler : public StreamNode
 {
@@ -21,9 +34,13 @@ class StreamSampler : public StreamNode
     Q_PROPERTY  ( int xfade READ xfade WRITE setXfade )
     Q_PROPERTY  ( int attack READ attack WRITE setAttack )
     Q_PROPERTY  ( int release READ release WRITE setRelease )
+    Q_PROPERTY  ( Curve::Values attackCurve READ attackCurve WRITE setAttackCurve )
+    Q_PROPERTY  ( Curve::Values releaseCurve READ releaseCurve WRITE setReleaseCurve )
     Q_PROPERTY  ( qreal start READ start WRITE setStart )
     Q_PROPERTY  ( qreal end READ end WRITE setEnd )
     Q_PROPERTY  ( qreal length READ length WRITE setLength )
+    Q_PROPERTY  ( qreal rate READ rate WRITE setRate )
+    Q_PROPERTY  ( Interpolation::Values quality READ quality WRITE setQuality )
 
     public:
     StreamSampler();
@@ -40,20 +57,26 @@ class StreamSampler : public StreamNode
     quint32 xfade       ( ) const { return m_xfade; }
     quint32 attack      ( ) const { return m_attack; }
     quint32 release     ( ) const { return m_release; }
+    Curve::Values attackCurve  ( ) const { return m_attack_curve; }
+    Curve::Values releaseCurve ( ) const { return m_release_curve; }
     qreal start         ( ) const { return m_start; }
     qreal end           ( ) const { return m_end; }
     qreal length        ( ) const { return m_length; }
     qreal rate          ( ) const { return m_rate; }
+    Interpolation::Values quality ( ) const { return m_quality; }
 
     void setPath        ( QString path );
     void setLoop        ( bool loop );
     void setXfade       ( quint32 xfade );
     void setAttack      ( quint32 attack );
     void setRelease     ( quint32 release );
+    void setAttackCurve ( Curve::Values curve );
+    void setReleaseCurve( Curve::Values curve );
     void setStart       ( qreal start );
     void setEnd         ( qreal end );
     void setLength      ( qreal length );
     void setRate        ( qreal rate );
+    void setQuality     ( Interpolation::Values quality );
 
     public slots:
     void onNextBufferReady();
@@ -67,9 +90,11 @@ class StreamSampler : public StreamNode
 
     private:
     void reset();
+    void render(float** out, qint64 nsamples);
 
     Soundfile* m_soundfile          = nullptr;
     SoundfileStreamer* m_streamer   = nullptr;
+    Resampler* m_resampler          = nullptr;
     QThread m_streamer_thread;
 
     bool m_next_buffer_ready    = false;
@@ -98,8 +123,9 @@ class StreamSampler : public StreamNode
     quint64 m_xfade_point       = 0;
     quint64 m_xfade_length      = 0;
 
-    float m_attack_env  [ ENV_RESOLUTION ];
-    float m_release_env [ ENV_RESOLUTION ];
+    const float* m_attack_env   = nullptr;
+    const float* m_release_env  = nullptr;
+    const float* m_xfade_env    = nullptr;
 
     // properties
     QString m_path;
@@ -107,10 +133,45 @@ class StreamSampler : public StreamNode
     quint32 m_xfade     = 0;
     quint32 m_attack    = 0;
     quint32 m_release   = 0;
+    Curve::Values m_attack_curve    = Curve::Sine;
+    Curve::Values m_release_curve   = Curve::Sine;
     qreal m_start       = 0;
     qreal m_end         = 0;
     qreal m_length      = 0;
     qreal m_rate        = 1;
+    Interpolation::Values m_quality = Interpolation::Medium;
+};
+
+struct SamplerVoice
+{
+    quint64 phase           = 0;
+    quint64 age             = 0;
+    float attack_phase      = 0.f;
+    float release_phase     = 0.f;
+    float release_inc       = 0.f;
+    float xfade_phase       = 0.f;
+    float level             = 0.f;
+    bool first_play         = true;
+    bool playing            = false;
+    bool releasing          = false;
+    bool stolen             = false;
+
+    // owned by the sampler, survive reset()
+    Resampler* resampler    = nullptr;
+    SampleReader* reader    = nullptr;
+
+    void reset()
+    {
+        phase           = 0;
+        attack_phase    = 0.f;
+        release_phase   = 0.f;
+        xfade_phase     = 0.f;
+        level           = 0.f;
+        first_play      = true;
+        playing         = false;
+        releasing       = false;
+        stolen          = false;
+    }
 };
 
 class Sampler : public StreamNode
@@ -122,15 +183,29 @@ class Sampler : public StreamNode
     Q_PROPERTY  ( int xfade READ xfade WRITE setXfade )
     Q_PROPERTY  ( int attack READ attack WRITE setAttack )
     Q_PROPERTY  ( int release READ release WRITE setRelease )
+    Q_PROPERTY  ( Curve::Values attackCurve READ attackCurve WRITE setAttackCurve )
+    Q_PROPERTY  ( Curve::Values releaseCurve READ releaseCurve WRITE setReleaseCurve )
     Q_PROPERTY  ( qreal start READ start WRITE setStart )
     Q_PROPERTY  ( qreal end READ end WRITE setEnd )
     Q_PROPERTY  ( qreal length READ length WRITE setLength )
     Q_PROPERTY  ( qreal rate READ rate WRITE setRate )
+    Q_PROPERTY  ( Interpolation::Values quality READ quality WRITE setQuality )
+    Q_PROPERTY  ( int polyphony READ polyphony WRITE setPolyphony )
+    Q_PROPERTY  ( Stealing stealing READ stealing WRITE setStealing )
+    Q_PROPERTY  ( SampleFormat::Values storage READ storage WRITE setStorage )
 
     public:
     Sampler();
     ~Sampler() override;
 
+    enum class Stealing
+    {
+        Oldest      = 0,
+        Quietest    = 1
+    };
+
+    Q_ENUM ( Stealing )
+
     virtual void componentComplete() override;
 
     virtual float** process ( float**, qint64 le ) override;
@@ -143,40 +218,80 @@ class Sampler : public StreamNode
     quint32 xfade       ( ) const { return m_xfade; }
     quint32 attack      ( ) const { return m_attack; }
     quint32 release     ( ) const { return m_release; }
+    Curve::Values attackCurve  ( ) const { return m_attack_curve; }
+    Curve::Values releaseCurve ( ) const { return m_release_curve; }
     qreal start         ( ) const { return m_start; }
     qreal end           ( ) const { return m_end; }
     qreal length        ( ) const { return m_length; }
     qreal rate          ( ) const { return m_rate; }
+    int polyphony       ( ) const { return m_polyphony; }
+    Stealing stealing   ( ) const { return m_stealing; }
+    SampleFormat::Values storage  ( ) const { return m_storage; }
+    Interpolation::Values quality ( ) const { return m_quality; }
 
     void setPath        ( QString path );
     void setLoop        ( bool loop );
     void setXfade       ( quint32 xfade );
     void setAttack      ( quint32 attack );
     void setRelease     ( quint32 release );
+    void setAttackCurve ( Curve::Values curve );
+    void setReleaseCurve( Curve::Values curve );
     void setStart       ( qreal start );
     void setEnd         ( qreal end );
     void setLength      ( qreal length );
     void setRate        ( qreal rate );
+    void setPolyphony   ( int polyphony );
+    void setStealing    ( Stealing stealing );
+    void setStorage     ( SampleFormat::Values storage );
+    void setQuality     ( Interpolation::Values quality );
+
+    // header known from a SampleIndex: set before componentComplete,
+    // the file is then only opened by the loader, if not cached
+    void setInfo        ( SampleInfo const& info ) { m_info = info; }
 
     public slots:
     Q_INVOKABLE void play   ( );
     Q_INVOKABLE void stop   ( );
 
-    private:        
-
+    private:
+    enum class Command
+    {
+        Play    = 0,
+        Stop    = 1
+    };
+
+    void load               ( );
+    void decode             ( );
+    void processCommands    ( );
+    SamplerVoice* allocate  ( );
+    void renderVoice        ( SamplerVoice& voice, float** out, qint64 le );
+    void render             ( SamplerVoice& voice, float** out, qint64 le );
 
     Soundfile* m_soundfile  = nullptr;
-    float* m_buffer         = nullptr;
+    SampleInfo m_info;
+    QFuture<void> m_loader;
+    SampleBufferPtr m_sample;
+    QString m_cache_key;
+    bool m_cached = false;
+
+    // region of the file, in frames at its own rate
+    quint64 m_region_start  = 0;
+    quint64 m_region_length = 0;
     quint64 m_buffer_size   = 0;
 
-    bool m_first_play   = true;
-    bool m_releasing    = false;
-    bool m_playing      = false;
+    // voices all read from the same sample buffer,
+    // the pool holds one extra voice so that a stolen voice
+    // can fade out while its replacement starts
+    QVector<SamplerVoice> m_voices;
+    Ringbuffer<Command> m_commands;
+
+    // play commands not processed yet, checked by the audio thread
+    // once it has deactivated the sampler, so that none is left behind
+    std::atomic<quint32> m_pending { 0 };
+    float** m_voice_buffer  = nullptr;
+    quint64 m_voice_age     = 0;
+    float m_steal_inc       = 0.f;
 
-    quint64 m_phase         = 0;
-    float m_attack_phase    = 0.f;
-    float m_release_phase   = 0.f;
-    float m_xfade_phase     = 0.f;
     quint64 m_attack_end    = 0;
     quint64 m_release_end   = 0;
     quint64 m_xfade_point   = 0;
@@ -186,19 +301,133 @@ class Sampler : public StreamNode
     float m_release_inc     = 0.f;
     float m_xfade_inc       = 0.f;
 
-    float m_attack_env  [ ENV_RESOLUTION ];
-    float m_release_env [ ENV_RESOLUTION ];
+    const float* m_attack_env   = nullptr;
+    const float* m_release_env  = nullptr;
+    const float* m_xfade_env    = nullptr;
 
     // properties
     QString m_path;
-    bool m_loop         = false;
-    quint32 m_xfade     = 0;
-    quint32 m_attack    = 0;
-    quint32 m_release   = 0;
-    qreal m_start       = 0.f;
-    qreal m_end         = 0.f;
-    qreal m_length      = 0.f;
-    qreal m_rate        = 1.f;
+    bool m_loop             = false;
+    quint32 m_xfade         = 0;
+    quint32 m_attack        = 0;
+    quint32 m_release       = 0;
+    Curve::Values m_attack_curve    = Curve::Sine;
+    Curve::Values m_release_curve   = Curve::Sine;
+    qreal m_start           = 0.f;
+    qreal m_end             = 0.f;
+    qreal m_length          = 0.f;
+    qreal m_rate            = 1.f;
+    int m_polyphony         = 1;
+    Stealing m_stealing     = Stealing::Oldest;
+    Interpolation::Values m_quality = Interpolation::Medium;
+    SampleFormat::Values m_storage  = SampleFormat::Float32;
+};
+
+// picks, at load time, between keeping the file resident (Sampler)
+// or streaming it from disk (StreamSampler), depending on
+// the room left in the global MemoryBudget.
+// streamed files keep their head resident, so both start instantly
+
+class AutoSampler : public StreamNode
+{
+    Q_OBJECT
+
+    Q_PROPERTY  ( QString path READ path WRITE setPath )
+    Q_PROPERTY  ( Mode mode READ mode WRITE setMode )
+    Q_PROPERTY  ( bool resident READ resident NOTIFY residentChanged )
+    Q_PROPERTY  ( bool loop READ loop WRITE setLoop )
+    Q_PROPERTY  ( int xfade READ xfade WRITE setXfade )
+    Q_PROPERTY  ( int attack READ attack WRITE setAttack )
+    Q_PROPERTY  ( int release READ release WRITE setRelease )
+    Q_PROPERTY  ( Curve::Values attackCurve READ attackCurve WRITE setAttackCurve )
+    Q_PROPERTY  ( Curve::Values releaseCurve READ releaseCurve WRITE setReleaseCurve )
+    Q_PROPERTY  ( qreal start READ start WRITE setStart )
+    Q_PROPERTY  ( qreal end READ end WRITE setEnd )
+    Q_PROPERTY  ( qreal length READ length WRITE setLength )
+    Q_PROPERTY  ( qreal rate READ rate WRITE setRate )
+    Q_PROPERTY  ( Interpolation::Values quality READ quality WRITE setQuality )
+    Q_PROPERTY  ( SampleFormat::Values storage READ storage WRITE setStorage )
+
+    public:
+    AutoSampler();
+    ~AutoSampler() override;
+
+    enum class Mode
+    {
+        Auto        = 0,
+        Resident    = 1,
+        Streamed    = 2
+    };
+
+    Q_ENUM ( Mode )
+
+    virtual void componentComplete() override;
+    virtual void expose(WPNNode* root) override;
+
+    virtual float** process ( float**, qint64 le ) override;
+    virtual void initialize ( qint64 ) override;
+
+    QString path        ( ) const { return m_path; }
+    Mode mode           ( ) const { return m_mode; }
+    bool resident       ( ) const { return m_sampler; }
+    bool loop           ( ) const { return m_loop; }
+    quint32 xfade       ( ) const { return m_xfade; }
+    quint32 attack      ( ) const { return m_attack; }
+    quint32 release     ( ) const { return m_release; }
+    Curve::Values attackCurve  ( ) const { return m_attack_curve; }
+    Curve::Values releaseCurve ( ) const { return m_release_curve; }
+    qreal start         ( ) const { return m_start; }
+    qreal end           ( ) const { return m_end; }
+    qreal length        ( ) const { return m_length; }
+    qreal rate          ( ) const { return m_rate; }
+    Interpolation::Values quality ( ) const { return m_quality; }
+    SampleFormat::Values storage  ( ) const { return m_storage; }
+
+    void setPath        ( QString path );
+    void setMode        ( Mode mode );
+    void setLoop        ( bool loop );
+    void setXfade       ( quint32 xfade );
+    void setAttack      ( quint32 attack );
+    void setRelease     ( quint32 release );
+    void setAttackCurve ( Curve::Values curve );
+    void setReleaseCurve( Curve::Values curve );
+    void setStart       ( qreal start );
+    void setEnd         ( qreal end );
+    void setLength      ( qreal length );
+    void setRate        ( qreal rate );
+    void setQuality     ( Interpolation::Values quality );
+    void setStorage     ( SampleFormat::Values storage );
+
+    public slots:
+    Q_INVOKABLE void play   ( );
+    Q_INVOKABLE void stop   ( );
+
+    signals:
+    void residentChanged ( );
+
+    private:
+    quint64 residentSize ( ) const;
+
+    // only one of them is created
+    Sampler* m_sampler          = nullptr;
+    StreamSampler* m_streamer   = nullptr;
+    StreamNode* m_player        = nullptr;
+
+    // properties
+    QString m_path;
+    Mode m_mode             = Mode::Auto;
+    bool m_loop             = false;
+    quint32 m_xfade         = 0;
+    quint32 m_attack        = 0;
+    quint32 m_release       = 0;
+    Curve::Values m_attack_curve    = Curve::Sine;
+    Curve::Values m_release_curve   = Curve::Sine;
+    qreal m_start           = 0;
+    qreal m_end             = 0;
+    qreal m_length          = 0;
+    qreal m_rate            = 1;
+    Interpolation::Values m_quality = Interpolation::Medium;
+    SampleFormat::Values m_storage  = SampleFormat::Float32;
 };
 
 #endif // SAMPLER_HPP
@@ -1,14 +1,12 @@
 #include "sine.hpp"
 #include <math.h>
 
-SinOsc::SinOsc() : StreamNode(), m_frequency(440.f), m_pos(0)
+SinOsc::SinOsc() : StreamNode(), m_frequency(440.f), m_pos(0),
+    m_wavetable(Tables::sine())
 {
     SETN_IN     ( 0 );
     SETN_OUT    ( 1 );
     SETTYPE     ( StreamType::Generator );
-
-    for( quint16 i = 0; i < WT_SIZE; ++i )
-        m_wavetable[i] = sin ((float) i/WT_SIZE*M_PI*2 );
 }
 
 float** SinOsc::process(float** buf, qint64 nsamples)
@@ -3,8 +3,7 @@
 
 #include <QObject>
 #include <source/audio/audio.hpp>
-
-#define WT_SIZE 16384
+#include <source/audio/tables.hpp>
 
 class SinOsc : public StreamNode
 {
@@ -25,7 +24,7 @@ class SinOsc : public StreamNode
     private:
     quint16 m_pos;
     qreal m_frequency;
-    float m_wavetable[WT_SIZE];
+    const float* m_wavetable;
 };
 
 #endif // QSINE_H
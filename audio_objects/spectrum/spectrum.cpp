@@ -0,0 +1,312 @@
+#include "spectrum.hpp"
+#include <source/audio/simd.hpp>
+#include <QMutexLocker>
+#include <math.h>
+#include <cstring>
+
+// WORKER --------------------------------------------------------------------------------------------
+
+SpectrumWorker::SpectrumWorker(Spectrum& spectrum) : m_spectrum(spectrum)
+{
+    m_queue.allocate( 2*SPECTRUM_MAX_SIZE );
+}
+
+SpectrumWorker::~SpectrumWorker()
+{
+    stop();
+}
+
+void SpectrumWorker::stop()
+{
+    if ( !isRunning() ) return;
+
+    m_quit.store( true );
+    m_wake.release();
+    wait();
+}
+
+void SpectrumWorker::push(const float* samples, quint32 nsamples)
+{
+    // dropped if the worker fell too far behind
+    if ( !m_queue.push(samples, nsamples) ) return;
+
+    // woken once there's enough for the next analysis
+    m_queued += nsamples;
+    if ( m_queued < m_hop.load(std::memory_order_relaxed) ) return;
+
+    m_queued = 0;
+    m_wake.release();
+}
+
+void SpectrumWorker::run()
+{
+    forever
+    {
+        m_wake.acquire();
+        if ( m_quit.load() ) return;
+
+        if ( m_spectrum.m_dirty.exchange(false) )
+             configure();
+
+        quint32 size    = m_frame.size();
+        quint32 hop     = m_hop.load();
+        bool analyzed   = false;
+
+        if ( !hop ) continue;
+
+        while ( m_queue.readAvailable() >= hop )
+        {
+            memmove( m_frame.data(), m_frame.constData()+hop, (size-hop)*sizeof(float) );
+            m_queue.pop( m_frame.data()+size-hop, hop );
+
+            analyze();
+            analyzed = true;
+        }
+
+        if ( analyzed ) publish();
+    }
+}
+
+void SpectrumWorker::configure()
+{
+    {
+        QMutexLocker lock ( &m_spectrum.m_mutex );
+        m_settings = m_spectrum.m_settings;
+    }
+
+    if ( !m_settings.rate ) return;
+
+    quint32 size = 64;
+    while ( size < qMin<quint32>(m_settings.size, SPECTRUM_MAX_SIZE) ) size <<= 1;
+
+    quint32 nbins   = audiofft::AudioFFT::ComplexSize( size );
+    qreal overlap   = qBound( 0.0, m_settings.overlap, 0.95 );
+    qreal rate      = m_settings.rate;
+
+    m_fft.init( size );
+
+    m_frame.fill    ( 0.f, size );
+    m_windowed.fill ( 0.f, size );
+    m_window.resize ( size );
+    m_re.fill       ( 0.f, nbins );
+    m_im.fill       ( 0.f, nbins );
+    m_smoothed.fill ( 0.f, nbins );
+
+    // hann window, scaled so that a full-scale sine reads 0dB
+    float sum = 0;
+
+    for ( quint32 i = 0; i < size; ++i )
+    {
+        m_window[i] = 0.5f*(1-cos(2*M_PI*i/size));
+        sum += m_window[i];
+    }
+
+    m_scale = 2/sum;
+
+    m_first.clear();
+    m_last.clear();
+    m_position.clear();
+    m_centers.clear();
+
+    if ( !m_settings.bands )
+    {
+        for ( quint32 k = 0; k < nbins; ++k )
+        {
+            m_first     << k;
+            m_last      << k;
+            m_position  << k;
+            m_centers   << k*rate/size;
+        }
+    }
+    else
+    {
+        qreal lo    = qMax( m_settings.min_frequency, 1.0 );
+        qreal hi    = qBound( lo, m_settings.max_frequency, rate/2 );
+        qreal ratio = hi/lo;
+
+        for ( quint16 b = 0; b < m_settings.bands; ++b )
+        {
+            qreal flo   = lo*pow( ratio, (qreal) b/m_settings.bands );
+            qreal fhi   = lo*pow( ratio, (qreal) (b+1)/m_settings.bands );
+            qreal fc    = sqrt( flo*fhi );
+
+            // bins within [flo, fhi[, if any
+            m_first     << (quint32) ceil( flo*size/rate );
+            m_last      << (quint32) qMax<qreal>( ceil(fhi*size/rate)-1, 0 );
+            m_position  << fc*size/rate;
+            m_centers   << fc;
+        }
+    }
+
+    m_hop.store( qMax<quint32>(1, size*(1-overlap)) );
+}
+
+void SpectrumWorker::analyze()
+{
+    quint32 size    = m_frame.size();
+    quint32 nbins   = m_smoothed.size();
+    float smoothing = qBound( 0.0, m_settings.smoothing, 0.99 );
+
+    for ( quint32 i = 0; i < size; ++i )
+        m_windowed[i] = m_frame[i]*m_window[i];
+
+    m_fft.fft( m_windowed.constData(), m_re.data(), m_im.data() );
+
+    for ( quint32 k = 0; k < nbins; ++k )
+    {
+        float magnitude = sqrt( m_re[k]*m_re[k]+m_im[k]*m_im[k] )*m_scale;
+        m_smoothed[k] = smoothing*m_smoothed[k]+(1-smoothing)*magnitude;
+    }
+}
+
+void SpectrumWorker::publish()
+{
+    // the previous frame wasn't taken yet, skip this one
+    if ( m_spectrum.m_ready.load(std::memory_order_acquire) )
+         return;
+
+    auto& frame     = m_spectrum.m_back;
+    quint32 nbins   = m_smoothed.size();
+    int nbands      = m_centers.size();
+
+    frame.magnitudes.resize( nbands );
+    frame.frequencies = m_centers;
+
+    for ( int b = 0; b < nbands; ++b )
+    {
+        float value = 0;
+
+        if ( m_first[b] <= m_last[b] && m_first[b] < nbins )
+        {
+            for ( quint32 k = m_first[b]; k <= qMin(m_last[b], nbins-1); ++k )
+                value = qMax( value, m_smoothed[k] );
+        }
+        else
+        {
+            // narrower than a bin, interpolated at its center
+            float pos   = qBound( 0.f, m_position[b], (float) nbins-1 );
+            quint32 k   = qMin<quint32>( pos, nbins-2 );
+            float frac  = pos-k;
+
+            value = m_smoothed[k]+frac*(m_smoothed[k+1]-m_smoothed[k]);
+        }
+
+        frame.magnitudes[b] = value > 0 ? qMax<float>( 20*log10(value), SPECTRUM_FLOOR ) : SPECTRUM_FLOOR;
+    }
+
+    m_spectrum.m_ready.store( true, std::memory_order_release );
+    QMetaObject::invokeMethod( &m_spectrum, "onFrame", Qt::QueuedConnection );
+}
+
+// SPECTRUM ------------------------------------------------------------------------------------------
+
+Spectrum::Spectrum() : m_worker(*this)
+{
+    SETTYPE ( StreamType::Effect );
+}
+
+Spectrum::~Spectrum()
+{
+    m_worker.stop();
+}
+
+void Spectrum::setSize(quint32 size)
+{
+    QMutexLocker lock ( &m_mutex );
+    m_settings.size = size;
+    m_dirty.store( true );
+}
+
+void Spectrum::setOverlap(qreal overlap)
+{
+    QMutexLocker lock ( &m_mutex );
+    m_settings.overlap = overlap;
+    m_dirty.store( true );
+}
+
+void Spectrum::setSmoothing(qreal smoothing)
+{
+    QMutexLocker lock ( &m_mutex );
+    m_settings.smoothing = smoothing;
+    m_dirty.store( true );
+}
+
+void Spectrum::setBands(quint16 bands)
+{
+    QMutexLocker lock ( &m_mutex );
+    m_settings.bands = bands;
+    m_dirty.store( true );
+}
+
+void Spectrum::setMinFrequency(qreal frequency)
+{
+    QMutexLocker lock ( &m_mutex );
+    m_settings.min_frequency = frequency;
+    m_dirty.store( true );
+}
+
+void Spectrum::setMaxFrequency(qreal frequency)
+{
+    QMutexLocker lock ( &m_mutex );
+    m_settings.max_frequency = frequency;
+    m_dirty.store( true );
+}
+
+qreal Spectrum::magnitude(int index) const
+{
+    if ( index < 0 || index >= m_front.magnitudes.size() )
+         return SPECTRUM_FLOOR;
+
+    return m_front.magnitudes[index];
+}
+
+qreal Spectrum::frequency(int index) const
+{
+    if ( index < 0 || index >= m_front.frequencies.size() )
+         return 0;
+
+    return m_front.frequencies[index];
+}
+
+void Spectrum::onFrame()
+{
+    if ( !m_ready.load(std::memory_order_acquire) )
+         return;
+
+    m_front.magnitudes.swap     ( m_back.magnitudes );
+    m_front.frequencies.swap    ( m_back.frequencies );
+
+    m_ready.store( false, std::memory_order_release );
+    emit frameChanged();
+}
+
+void Spectrum::componentComplete()
+{
+    m_worker.start( QThread::LowPriority );
+}
+
+void Spectrum::initialize(qint64 nsamples)
+{
+    m_mix.fill( 0.f, nsamples );
+
+    QMutexLocker lock ( &m_mutex );
+    m_settings.rate = SAMPLERATE;
+    m_dirty.store( true );
+}
+
+float** Spectrum::process(float** in, qint64 nsamples)
+{
+    auto nch = m_num_outputs;
+    if ( !nch ) return in;
+
+    auto mix = m_mix.data();
+    memcpy( mix, in[0], nsamples*sizeof(float) );
+
+    for ( quint16 ch = 1; ch < nch; ++ch )
+        simd::add( mix, in[ch], nsamples );
+
+    if ( nch > 1 ) simd::mul( mix, 1.f/nch, nsamples );
+
+    m_worker.push( mix, nsamples );
+    return in;
+}
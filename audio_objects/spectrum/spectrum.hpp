@@ -0,0 +1,154 @@
+#ifndef SPECTRUM_HPP
+#define SPECTRUM_HPP
+
+#include <source/audio/audio.hpp>
+#include <source/audio/ringbuffer.hpp>
+#include <external/fftconvolver/AudioFFT.h>
+#include <QThread>
+#include <QSemaphore>
+#include <QMutex>
+#include <atomic>
+
+#define SPECTRUM_FLOOR -120
+// in dB, reported for silence
+
+#define SPECTRUM_MAX_SIZE 16384
+// in samples, largest fft
+
+class Spectrum;
+
+struct SpectrumSettings
+{
+    quint32 size        = 2048;
+    qreal overlap       = 0.5;
+    qreal smoothing     = 0.5;
+    quint16 bands       = 0;
+    qreal min_frequency = 20;
+    qreal max_frequency = 20000;
+    quint32 rate        = 0;
+};
+
+// magnitudes (dB) and center frequencies (Hz) of one analysis
+struct SpectrumFrame
+{
+    QVector<float> magnitudes;
+    QVector<float> frequencies;
+};
+
+class SpectrumWorker : public QThread
+{
+    public:
+    SpectrumWorker ( Spectrum& spectrum );
+    ~SpectrumWorker ( ) override;
+
+    void stop ( );
+
+    // audio thread, mono samples
+    void push ( const float* samples, quint32 nsamples );
+
+    protected:
+    void run ( ) override;
+
+    private:
+    void configure  ( );
+    void analyze    ( );
+    void publish    ( );
+
+    Spectrum& m_spectrum;
+    SpectrumSettings m_settings;
+
+    Ringbuffer<float> m_queue;
+    quint32 m_queued = 0;
+    QSemaphore m_wake;
+    std::atomic<bool> m_quit { false };
+
+    audiofft::AudioFFT m_fft;
+    std::atomic<quint32> m_hop { 0 };
+    QVector<float> m_frame;
+    QVector<float> m_window;
+    QVector<float> m_windowed;
+    QVector<float> m_re;
+    QVector<float> m_im;
+    QVector<float> m_smoothed;
+    float m_scale = 1;
+
+    // per band: first and last bin, or a fractional bin
+    // to interpolate when the band is narrower than a bin
+    QVector<quint32> m_first;
+    QVector<quint32> m_last;
+    QVector<float> m_position;
+    QVector<float> m_centers;
+};
+
+// spectrum of the sum of the node's inputs (passed through), analyzed
+// on a worker thread: Hann-windowed ffts of 'size' samples overlapping
+// by 'overlap', averaged over time by 'smoothing' (0-1), and grouped
+// in 'bands' log-spaced bands between 'minFrequency' and 'maxFrequency'
+// (0 for plain fft bins). frames are double-buffered: 'frameChanged'
+// is emitted once a new one can be read with magnitude() and frequency()
+
+class Spectrum : public StreamNode
+{
+    Q_OBJECT
+
+    Q_PROPERTY  ( int size READ size WRITE setSize )
+    Q_PROPERTY  ( qreal overlap READ overlap WRITE setOverlap )
+    Q_PROPERTY  ( qreal smoothing READ smoothing WRITE setSmoothing )
+    Q_PROPERTY  ( int bands READ bands WRITE setBands )
+    Q_PROPERTY  ( qreal minFrequency READ minFrequency WRITE setMinFrequency )
+    Q_PROPERTY  ( qreal maxFrequency READ maxFrequency WRITE setMaxFrequency )
+    Q_PROPERTY  ( int count READ count NOTIFY frameChanged )
+
+    friend class SpectrumWorker;
+
+    public:
+    Spectrum();
+    ~Spectrum();
+
+    virtual void componentComplete() override;
+    virtual void initialize(qint64) override;
+    virtual float** process(float**, qint64) override;
+
+    quint32 size            ( ) const { return m_settings.size; }
+    qreal overlap           ( ) const { return m_settings.overlap; }
+    qreal smoothing         ( ) const { return m_settings.smoothing; }
+    quint16 bands           ( ) const { return m_settings.bands; }
+    qreal minFrequency      ( ) const { return m_settings.min_frequency; }
+    qreal maxFrequency      ( ) const { return m_settings.max_frequency; }
+
+    void setSize            ( quint32 size );
+    void setOverlap         ( qreal overlap );
+    void setSmoothing       ( qreal smoothing );
+    void setBands           ( quint16 bands );
+    void setMinFrequency    ( qreal frequency );
+    void setMaxFrequency    ( qreal frequency );
+
+    // current frame, object's thread
+    int count ( ) const { return m_front.magnitudes.size(); }
+    Q_INVOKABLE qreal magnitude ( int index ) const;
+    Q_INVOKABLE qreal frequency ( int index ) const;
+    SpectrumFrame const& frame  ( ) const { return m_front; }
+
+    signals:
+    void frameChanged ( );
+
+    protected slots:
+    void onFrame ( );
+
+    private:
+    SpectrumWorker m_worker;
+    QVector<float> m_mix;
+
+    // read by the worker when 'm_dirty' is set
+    QMutex m_mutex;
+    SpectrumSettings m_settings;
+    std::atomic<bool> m_dirty { true };
+
+    // written by the worker while 'm_ready' is false,
+    // swapped with the front frame once it's set
+    SpectrumFrame m_front;
+    SpectrumFrame m_back;
+    std::atomic<bool> m_ready { false };
+};
+
+#endif // SPECTRUM_HPP
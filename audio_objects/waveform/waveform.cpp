@@ -0,0 +1,63 @@
+#include "waveform.hpp"
+#include <QtConcurrent>
+
+Waveform::Waveform()
+{
+    QObject::connect(&m_watcher, SIGNAL(finished()), this, SLOT(onLoaded()));
+}
+
+Waveform::~Waveform()
+{
+    m_watcher.waitForFinished();
+}
+
+qreal Waveform::duration() const
+{
+    if ( !ready() || !m_pyramid->sampleRate() ) return 0;
+    return (qreal) m_pyramid->nframes()/m_pyramid->sampleRate();
+}
+
+void Waveform::setPath(QString path)
+{
+    if ( path == m_path ) return;
+
+    m_path = path;
+    emit pathChanged();
+
+    if ( !m_pyramid.isNull() )
+    {
+        m_pyramid.clear();
+        emit readyChanged();
+    }
+
+    if ( !path.isEmpty() )
+         m_watcher.setFuture( QtConcurrent::run(&PeakPyramid::get, path) );
+}
+
+void Waveform::onLoaded()
+{
+    // path was cleared while loading
+    if ( m_path.isEmpty() ) return;
+
+    m_pyramid = m_watcher.result();
+    emit readyChanged();
+}
+
+QVariantList Waveform::peaks(int channel, qreal start, qreal end, int pixels) const
+{
+    QVariantList list;
+    if ( !ready() || pixels <= 0 || channel < 0 ) return list;
+
+    quint32 rate = m_pyramid->sampleRate();
+    QVector<Peak> peaks ( pixels );
+
+    m_pyramid->query( channel, qMax(0.0, start)*rate, qMax(0.0, end)*rate,
+                      pixels, peaks.data() );
+
+    list.reserve( pixels*3 );
+
+    for ( const auto& peak : peaks )
+        list << peak.min << peak.max << peak.rms;
+
+    return list;
+}
@@ -0,0 +1,52 @@
+#ifndef WAVEFORM_HPP
+#define WAVEFORM_HPP
+
+#include <QObject>
+#include <QFutureWatcher>
+#include <QVariant>
+#include <source/audio/peaks.hpp>
+
+// gives QML front-ends the min/max/rms peaks of a soundfile,
+// the file's PeakPyramid is loaded or built in the background,
+// 'ready' is notified when it can be queried
+
+class Waveform : public QObject
+{
+    Q_OBJECT
+
+    Q_PROPERTY  ( QString path READ path WRITE setPath NOTIFY pathChanged )
+    Q_PROPERTY  ( bool ready READ ready NOTIFY readyChanged )
+    Q_PROPERTY  ( int nchannels READ nchannels NOTIFY readyChanged )
+    Q_PROPERTY  ( int sampleRate READ sampleRate NOTIFY readyChanged )
+    Q_PROPERTY  ( qreal duration READ duration NOTIFY readyChanged )
+
+    public:
+    Waveform();
+    ~Waveform() override;
+
+    QString path        ( ) const { return m_path; }
+    bool ready          ( ) const { return !m_pyramid.isNull(); }
+    quint16 nchannels   ( ) const { return ready() ? m_pyramid->nchannels() : 0; }
+    quint32 sampleRate  ( ) const { return ready() ? m_pyramid->sampleRate() : 0; }
+    qreal duration      ( ) const;
+
+    void setPath ( QString path );
+
+    // [min, max, rms] triplets, flattened, for each of the 'pixels'
+    // divisions of [start, end[ (in seconds) of 'channel'
+    Q_INVOKABLE QVariantList peaks ( int channel, qreal start, qreal end, int pixels ) const;
+
+    signals:
+    void pathChanged    ( );
+    void readyChanged   ( );
+
+    protected slots:
+    void onLoaded ( );
+
+    private:
+    QString m_path;
+    PeakPyramidPtr m_pyramid;
+    QFutureWatcher<PeakPyramidPtr> m_watcher;
+};
+
+#endif // WAVEFORM_HPP
@@ -11,6 +11,11 @@
 
 #ifdef WPN114_AUDIO
 #include <source/audio/audio.hpp>
+#include <source/audio/resampler.hpp>
+#include <source/audio/samplebuffer.hpp>
+#include <source/audio/tables.hpp>
+#include <source/audio/memorybudget.hpp>
+#include <source/audio/samplecache.hpp>
 #include <audio_objects/sine/sine.hpp>
 #include <audio_objects/stpanner/stereopanner.hpp>
 #include <audio_objects/sampler/sampler.hpp>
@@ -18,10 +23,14 @@
 #include <audio_objects/mangler/mangler.hpp>
 #include <audio_objects/sharpen/sharpen.hpp>
 #include <audio_objects/multisampler/multisampler.hpp>
+#include <audio_objects/waveform/waveform.hpp>
 #include <audio_objects/fork/fork.hpp>
 #include <audio_objects/peakrms/peakrms.hpp>
 #include <audio_objects/convolver/convolver.hpp>
 #include <audio_objects/limiter/masterlimiter.hpp>
+#include <audio_objects/loudness/loudness.hpp>
+#include <audio_objects/spectrum/spectrum.hpp>
+#include <audio_objects/recorder/recorder.hpp>
 #include <audio_objects/clock/audioclock.hpp>
 #include <audio_objects/ashes/ashes.hpp>
 #include <audio_objects/downmix/downmix.hpp>
@@ -50,6 +59,9 @@ void qml_plugin::registerTypes(const char *uri)
     qmlRegisterUncreatableType<StreamNode, 1>   ( "WPN114", 1, 0, "StreamNode","Coucou");
     qmlRegisterUncreatableType<RoomNode, 1>     ( "WPN114", 1, 0, "RoomNode", "Coucou" );
     qmlRegisterUncreatableType<RoomSource, 1>   ( "WPN114", 1, 0, "RoomSource", "Coucou");
+    qmlRegisterUncreatableType<Interpolation, 1>( "WPN114", 1, 0, "Interpolation", "Coucou" );
+    qmlRegisterUncreatableType<Curve, 1>        ( "WPN114", 1, 0, "Curve", "Coucou" );
+    qmlRegisterUncreatableType<SampleFormat, 1> ( "WPN114", 1, 0, "SampleFormat", "Coucou" );
     qmlRegisterType<Speaker, 1>                 ( "WPN114", 1, 0, "Speaker" );
     qmlRegisterType<SpeakerArea, 1>             ( "WPN114", 1, 0, "SpeakerArea" );
 
@@ -58,7 +70,11 @@ void qml_plugin::registerTypes(const char *uri)
     qmlRegisterType<StereoPanner, 1>      ( "WPN114", 1, 0, "StereoPanner" );
     qmlRegisterType<Sampler, 1>           ( "WPN114", 1, 0, "Sampler" );
     qmlRegisterType<StreamSampler, 1>     ( "WPN114", 1, 0, "StreamSampler" );
+    qmlRegisterType<AutoSampler, 1>       ( "WPN114", 1, 0, "AutoSampler" );
+    qmlRegisterSingletonType<MemoryBudget>( "WPN114", 1, 0, "MemoryBudget", &MemoryBudget::qmlInstance );
+    qmlRegisterSingletonType<SampleCache>( "WPN114", 1, 0, "SampleCache", &SampleCache::qmlInstance );
     qmlRegisterType<MultiSampler, 1>      ( "WPN114", 1, 0, "MultiSampler" );
+    qmlRegisterType<Waveform>             ( "WPN114", 1, 0, "Waveform" );
     qmlRegisterType<RoomSetup, 1>         ( "WPN114", 1, 0, "RoomSetup" );
     qmlRegisterType<MonoSource, 1>        ( "WPN114", 1, 0, "MonoSource" );
     qmlRegisterType<StereoSource, 1>      ( "WPN114", 1, 0, "StereoSource" );
@@ -74,6 +90,9 @@ void qml_plugin::registerTypes(const char *uri)
     qmlRegisterType<Loop, 1>              ( "WPN114", 1, 0, "Loop" );
     qmlRegisterType<Automation, 1>        ( "WPN114", 1, 0, "Automation" );
     qmlRegisterType<MasterLimiter, 1>     ( "WPN114", 1, 0, "MasterLimiter" );
+    qmlRegisterType<LoudnessMeter, 1>     ( "WPN114", 1, 0, "LoudnessMeter" );
+    qmlRegisterType<Spectrum, 1>          ( "WPN114", 1, 0, "Spectrum" );
+    qmlRegisterType<Recorder, 1>          ( "WPN114", 1, 0, "Recorder" );
     qmlRegisterType<Ashes, 1>             ( "WPN114", 1, 0, "Ashes" );
     qmlRegisterType<Downmix, 1>           ( "WPN114", 1, 0, "Downmix" );
     qmlRegisterType<ChannelMapper, 1>     ( "WPN114", 1, 0, "ChannelMapper" );
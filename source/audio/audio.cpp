@@ -9,7 +9,7 @@
 static const QStringList g_ignore =
 {
     "parentStream", "subnodes", "exposeDevice", "objectName", "exposePath",
-    "numInputs", "numOutputs", "parentChannels"
+    "numInputs", "numOutputs", "parentChannels", "latency"
 };
 
 static const QStringList g_stream =
@@ -93,6 +93,15 @@ void StreamNode::setMute(bool mute)
     }
 }
 
+void StreamNode::setLatency(quint32 nsamples)
+{
+    if ( nsamples != m_latency )
+    {
+        m_latency = nsamples;
+        emit latencyChanged();
+    }
+}
+
 void StreamNode::setActive(bool active)
 {
     if ( active != m_active )
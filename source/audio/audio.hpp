@@ -38,6 +38,7 @@ class StreamNode : public QObject, public QQmlParserStatus
     Q_PROPERTY  ( QVariant parentChannels READ parentChannels WRITE setParentChannels )
     Q_PROPERTY  ( qreal level READ level WRITE setLevel NOTIFY levelChanged )
     Q_PROPERTY  ( qreal dBlevel READ dBlevel WRITE setDBlevel NOTIFY dBlevelChanged )
+    Q_PROPERTY  ( int latency READ latency NOTIFY latencyChanged )
     Q_PROPERTY  ( QQmlListProperty<StreamNode> subnodes READ subnodes )
     Q_PROPERTY  ( StreamNode* parentStream READ parentStream WRITE setParentStream )
 
@@ -95,6 +96,10 @@ class StreamNode : public QObject, public QQmlParserStatus
     qreal dBlevel        ( ) const { return m_db_level; }    
     bool qml             ( ) const { return m_qml; }
 
+    // delay (in samples) the node adds to its signal path, known once
+    // initialized. informational: the graph doesn't compensate for it
+    quint32 latency      ( ) const { return m_latency; }
+
     QString exposePath          ( ) const { return m_exp_path; }
     WPNDevice* exposeDevice     ( ) const { return m_exp_device; }
     StreamNode* parentStream    ( ) const { return m_parent_stream; }
@@ -124,6 +129,7 @@ class StreamNode : public QObject, public QQmlParserStatus
     void levelChanged       ( );
     void exposePathChanged  ( );
     void dBlevelChanged     ( );
+    void latencyChanged     ( );
 
     protected:
     static void appendSubnode     ( QQmlListProperty<StreamNode>*, StreamNode* );
@@ -132,6 +138,7 @@ class StreamNode : public QObject, public QQmlParserStatus
     static void clearSubnodes     ( QQmlListProperty<StreamNode>* );
 
     float** mergeInputs(float**, qint64);
+    void setLatency(quint32 nsamples);
 
     StreamProperties m_stream_properties;
     qreal m_level;
@@ -142,6 +149,7 @@ class StreamNode : public QObject, public QQmlParserStatus
     bool m_mute;
     bool m_active;
     bool m_qml = false;
+    quint32 m_latency = 0;
 
     float** m_in;
     float** m_out;
@@ -0,0 +1,97 @@
+#include "memorybudget.hpp"
+#include <QMutexLocker>
+#include <QQmlEngine>
+
+#define MEGABYTE 1048576.0
+
+MemoryBudget::MemoryBudget() : m_budget( MEMORYBUDGET_DEFAULT*MEGABYTE )
+{
+
+}
+
+MemoryBudget& MemoryBudget::instance()
+{
+    static MemoryBudget budget;
+    return budget;
+}
+
+QObject* MemoryBudget::qmlInstance(QQmlEngine*, QJSEngine*)
+{
+    // the engine must not take ownership of a static
+    QQmlEngine::setObjectOwnership( &instance(), QQmlEngine::CppOwnership );
+    return &instance();
+}
+
+qreal MemoryBudget::budget() const
+{
+    QMutexLocker lock ( &m_mutex );
+    return m_budget/MEGABYTE;
+}
+
+qreal MemoryBudget::used() const
+{
+    QMutexLocker lock ( &m_mutex );
+    return m_used/MEGABYTE;
+}
+
+void MemoryBudget::setBudget(qreal budget)
+{
+    {
+        QMutexLocker lock ( &m_mutex );
+        m_budget = qMax( 0.0, budget )*MEGABYTE;
+    }
+
+    emit budgetChanged();
+}
+
+QVariantList MemoryBudget::placements() const
+{
+    QMutexLocker lock ( &m_mutex );
+    QVariantList list;
+
+    for ( const auto& entry : m_entries )
+    {
+        QVariantMap map;
+        map.insert( "path", entry.path );
+        map.insert( "placement", entry.placement == Resident ? "resident" : "streamed" );
+        map.insert( "size", entry.bytes/MEGABYTE );
+        list << map;
+    }
+
+    return list;
+}
+
+bool MemoryBudget::fits(quint64 bytes) const
+{
+    QMutexLocker lock ( &m_mutex );
+    return m_used+bytes <= m_budget;
+}
+
+void MemoryBudget::book(const QObject* owner, QString path, quint64 bytes, Placement placement)
+{
+    {
+        QMutexLocker lock ( &m_mutex );
+
+        if ( m_entries.contains(owner) )
+             m_used -= m_entries[owner].bytes;
+
+        m_entries.insert( owner, Entry{ path, bytes, placement } );
+        m_used += bytes;
+    }
+
+    emit usedChanged();
+    emit placementsChanged();
+}
+
+void MemoryBudget::release(const QObject* owner)
+{
+    {
+        QMutexLocker lock ( &m_mutex );
+        if ( !m_entries.contains(owner) ) return;
+
+        m_used -= m_entries.take(owner).bytes;
+    }
+
+    emit usedChanged();
+    emit placementsChanged();
+}
@@ -0,0 +1,72 @@
+#ifndef MEMORYBUDGET_HPP
+#define MEMORYBUDGET_HPP
+
+#include <QObject>
+#include <QHash>
+#include <QMutex>
+#include <QVariant>
+
+class QQmlEngine;
+class QJSEngine;
+
+#define MEMORYBUDGET_DEFAULT 2048
+// in megabytes
+
+// process-wide account of the memory used by sample data,
+// samplers book what they hold, front-ends such as AutoSampler
+// ask whether a file still fits before keeping it resident
+
+class MemoryBudget : public QObject
+{
+    Q_OBJECT
+
+    Q_PROPERTY  ( qreal budget READ budget WRITE setBudget NOTIFY budgetChanged )
+    Q_PROPERTY  ( qreal used READ used NOTIFY usedChanged )
+    Q_PROPERTY  ( QVariantList placements READ placements NOTIFY placementsChanged )
+
+    public:
+    enum Placement
+    {
+        Resident    = 0,
+        Streamed    = 1
+    };
+
+    Q_ENUM ( Placement )
+
+    static MemoryBudget& instance();
+    static QObject* qmlInstance ( QQmlEngine*, QJSEngine* );
+
+    // in megabytes
+    qreal budget    ( ) const;
+    qreal used      ( ) const;
+    void setBudget  ( qreal budget );
+
+    // one entry per owner: path, placement and size (in megabytes)
+    QVariantList placements ( ) const;
+
+    bool fits       ( quint64 bytes ) const;
+    void book       ( const QObject* owner, QString path, quint64 bytes, Placement placement );
+    void release    ( const QObject* owner );
+
+    signals:
+    void budgetChanged      ( );
+    void usedChanged        ( );
+    void placementsChanged  ( );
+
+    private:
+    MemoryBudget();
+
+    struct Entry
+    {
+        QString path;
+        quint64 bytes;
+        Placement placement;
+    };
+
+    mutable QMutex m_mutex;
+    QHash<const QObject*, Entry> m_entries;
+    quint64 m_budget;
+    quint64 m_used = 0;
+};
+
+#endif // MEMORYBUDGET_HPP
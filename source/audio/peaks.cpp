@@ -0,0 +1,308 @@
+#include "peaks.hpp"
+#include <source/audio/soundfile.hpp>
+#include <source/audio/samplecache.hpp>
+#include <QDir>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QSet>
+#include <QWaitCondition>
+#include <QtDebug>
+#include <qendian.h>
+#include <cfloat>
+#include <cstring>
+#include <cmath>
+
+#define PEAKS_HEADER_SIZE 32
+
+static QMutex g_mutex;
+static QHash<QString, QWeakPointer<PeakPyramid>> g_pyramids;
+
+// sources being loaded or built, others asking for them wait
+static QSet<QString> g_building;
+static QWaitCondition g_built;
+
+PeakPyramidPtr PeakPyramid::get(QString path)
+{
+    QString source = SampleCache::source(path);
+
+    {
+        QMutexLocker lock ( &g_mutex );
+
+        forever
+        {
+            PeakPyramidPtr pyramid = g_pyramids.value(source).toStrongRef();
+            if ( !pyramid.isNull() ) return pyramid;
+
+            if ( !g_building.contains(source) ) break;
+            g_built.wait( &g_mutex );
+        }
+
+        g_building.insert( source );
+    }
+
+    auto pyramid        = PeakPyramidPtr( new PeakPyramid );
+    QString directory   = SampleCache::instance().path();
+    QString file        = directory.isEmpty() ? QString() :
+                          QDir(directory).filePath(source+PEAKS_SUFFIX);
+
+    if ( file.isEmpty() || !pyramid->load(file) )
+    {
+        Soundfile soundfile ( path );
+        pyramid->build( soundfile );
+
+        if ( !file.isEmpty() )
+        {
+            pyramid->save( file );
+            SampleCache::prune( directory, source, PEAKS_SUFFIX );
+        }
+    }
+
+    QMutexLocker lock ( &g_mutex );
+    g_pyramids.insert( source, pyramid.toWeakRef() );
+    g_building.remove( source );
+    g_built.wakeAll();
+
+    return pyramid;
+}
+
+inline void merge(Peak& dst, const Peak& src, double& sum, double weight)
+{
+    dst.min  = qMin( dst.min, src.min );
+    dst.max  = qMax( dst.max, src.max );
+    sum     += (double) src.rms*src.rms*weight;
+}
+
+void PeakPyramid::build(Soundfile& soundfile)
+{
+    m_nchannels     = soundfile.nchannels();
+    m_sample_rate   = soundfile.sampleRate();
+    m_nframes       = soundfile.nsamples(); // per channel
+    m_levels.clear();
+
+    if ( !m_nchannels || !m_nframes ) return;
+
+    quint16 nch     = m_nchannels;
+    quint64 base    = binFrames(0);
+    QVector<Peak> bins ( (m_nframes+base-1)/base*nch );
+    QVector<float> block ( PEAKS_READ_BLOCK*nch );
+
+    for ( quint64 f = 0; f < m_nframes; f += PEAKS_READ_BLOCK )
+    {
+        quint64 n = qMin<quint64>( PEAKS_READ_BLOCK, m_nframes-f );
+        soundfile.buffer( block.data(), f, n );
+
+        for ( quint64 b = 0; b < n; b += base )
+        {
+            quint64 len = qMin( base, n-b );
+            Peak* dst   = bins.data()+(f+b)/base*nch;
+
+            for ( quint16 ch = 0; ch < nch; ++ch )
+            {
+                const float* x  = block.constData()+b*nch+ch;
+                float min       = FLT_MAX, max = -FLT_MAX;
+                double sum      = 0;
+
+                for ( quint64 i = 0; i < len; ++i, x += nch )
+                {
+                    min  = qMin( min, *x );
+                    max  = qMax( max, *x );
+                    sum += (double) *x**x;
+                }
+
+                dst[ch] = Peak { min, max, (float) std::sqrt(sum/len) };
+            }
+        }
+    }
+
+    m_levels << bins;
+
+    // coarser levels, down to a single bin
+    const quint64 group = 1 << PEAKS_LEVEL_SHIFT;
+
+    while ( m_levels.last().size() > nch )
+    {
+        QVector<Peak> fine      = m_levels.last();
+        quint64 fine_frames     = binFrames( m_levels.size()-1 );
+        quint64 nfine           = fine.size()/nch;
+        quint64 ncoarse         = (nfine+group-1)/group;
+        QVector<Peak> coarse ( ncoarse*nch );
+
+        for ( quint64 c = 0; c < ncoarse; ++c )
+        {
+            quint64 end = qMin( (c+1)*group, nfine );
+
+            for ( quint16 ch = 0; ch < nch; ++ch )
+            {
+                Peak p { FLT_MAX, -FLT_MAX, 0 };
+                double sum = 0, frames = 0;
+
+                for ( quint64 i = c*group; i < end; ++i )
+                {
+                    // last bin of a level may be partial
+                    double weight = qMin( fine_frames, m_nframes-i*fine_frames );
+                    merge( p, fine[i*nch+ch], sum, weight );
+                    frames += weight;
+                }
+
+                p.rms = std::sqrt( sum/frames );
+                coarse[c*nch+ch] = p;
+            }
+        }
+
+        m_levels << coarse;
+    }
+}
+
+void PeakPyramid::query(quint16 channel, quint64 first, quint64 last,
+                        quint32 npixels, Peak* out) const
+{
+    if ( !npixels ) return;
+    last = qMin( last, m_nframes );
+
+    if ( m_levels.isEmpty() || channel >= m_nchannels || first >= last )
+    {
+        for ( quint32 p = 0; p < npixels; ++p )
+            out[p] = Peak { 0, 0, 0 };
+        return;
+    }
+
+    double fpp      = (double) (last-first)/npixels;
+    quint16 level   = 0;
+
+    while ( level+1 < m_levels.size() && binFrames(level+1) <= fpp )
+          ++level;
+
+    // each pixel merges at most 2^PEAKS_LEVEL_SHIFT+1 bins
+    const Peak* bins    = m_levels[level].constData()+channel;
+    quint64 nbins       = m_levels[level].size()/m_nchannels;
+    quint16 shift       = PEAKS_BASE_SHIFT+level*PEAKS_LEVEL_SHIFT;
+    quint16 nch         = m_nchannels;
+
+    for ( quint32 p = 0; p < npixels; ++p )
+    {
+        quint64 a   = first+(quint64)(p*fpp);
+        quint64 b   = first+(quint64)((p+1)*fpp);
+        quint64 ba  = qMin( a >> shift, nbins-1 );
+        quint64 bb  = qMin( qMax(ba+1, (b+(Q_UINT64_C(1) << shift)-1) >> shift), nbins );
+
+        Peak peak { FLT_MAX, -FLT_MAX, 0 };
+        double sum = 0;
+
+        for ( quint64 i = ba; i < bb; ++i )
+            merge( peak, bins[i*nch], sum, 1 );
+
+        peak.rms    = std::sqrt( sum/(bb-ba) );
+        out[p]      = peak;
+    }
+}
+
+// bins are stored as three little-endian floats
+#define PEAKS_BIN_SIZE 12
+
+inline float get_float(const uchar* src)
+{
+    quint32 bits = qFromLittleEndian<quint32>(src);
+    float value;
+    memcpy( &value, &bits, sizeof(float) );
+    return value;
+}
+
+inline void put_float(float value, uchar* dst)
+{
+    quint32 bits;
+    memcpy( &bits, &value, sizeof(float) );
+    qToLittleEndian<quint32>( bits, dst );
+}
+
+bool PeakPyramid::load(QString path)
+{
+    QFile file ( path );
+    if ( !file.open(QIODevice::ReadOnly) ) return false;
+
+    QByteArray header   = file.read( PEAKS_HEADER_SIZE );
+    auto h              = (const uchar*) header.constData();
+
+    if ( header.size() != PEAKS_HEADER_SIZE || memcmp(h, "WPNP", 4) ||
+         qFromLittleEndian<quint32>(h+4) != PEAKS_VERSION )
+         return false;
+
+    m_nchannels     = qFromLittleEndian<quint16>(h+8);
+    m_sample_rate   = qFromLittleEndian<quint32>(h+12);
+    m_nframes       = qFromLittleEndian<quint64>(h+16);
+    quint32 nlevels = qFromLittleEndian<quint32>(h+24);
+
+    m_levels.clear();
+
+    for ( quint32 l = 0; l < nlevels; ++l )
+    {
+        QByteArray count    = file.read( sizeof(quint64) );
+        quint64 nbins       = count.size() == sizeof(quint64) ?
+                              qFromLittleEndian<quint64>((const uchar*) count.constData()) : 0;
+
+        if ( !m_nchannels || !nbins || nbins % m_nchannels ||
+             nbins > (quint64) (file.size()-file.pos())/PEAKS_BIN_SIZE )
+        {
+            qDebug() << "[PEAKS] discarding invalid entry" << path;
+            m_levels.clear();
+            return false;
+        }
+
+        QByteArray data = file.read( nbins*PEAKS_BIN_SIZE );
+        auto d          = (const uchar*) data.constData();
+        QVector<Peak> bins ( nbins );
+
+        for ( auto& bin : bins )
+        {
+            bin.min = get_float( d );
+            bin.max = get_float( d+4 );
+            bin.rms = get_float( d+8 );
+            d += PEAKS_BIN_SIZE;
+        }
+
+        m_levels << bins;
+    }
+
+    return true;
+}
+
+void PeakPyramid::save(QString path) const
+{
+    QByteArray header ( PEAKS_HEADER_SIZE, 0 );
+    auto h = (uchar*) header.data();
+
+    memcpy ( h, "WPNP", 4 );
+    qToLittleEndian<quint32> ( PEAKS_VERSION, h+4 );
+    qToLittleEndian<quint16> ( m_nchannels, h+8 );
+    qToLittleEndian<quint32> ( m_sample_rate, h+12 );
+    qToLittleEndian<quint64> ( m_nframes, h+16 );
+    qToLittleEndian<quint32> ( m_levels.size(), h+24 );
+
+    QSaveFile file ( path );
+    if ( !file.open(QIODevice::WriteOnly) ) return;
+
+    file.write( header );
+
+    for ( const auto& bins : m_levels )
+    {
+        QByteArray data ( sizeof(quint64)+bins.size()*PEAKS_BIN_SIZE, 0 );
+        auto d = (uchar*) data.data();
+
+        qToLittleEndian<quint64> ( bins.size(), d );
+        d += sizeof(quint64);
+
+        for ( const auto& bin : bins )
+        {
+            put_float ( bin.min, d );
+            put_float ( bin.max, d+4 );
+            put_float ( bin.rms, d+8 );
+            d += PEAKS_BIN_SIZE;
+        }
+
+        file.write( data );
+    }
+
+    if ( !file.commit() )
+         qDebug() << "[PEAKS] could not write" << path << file.errorString();
+}
@@ -0,0 +1,67 @@
+#ifndef PEAKS_HPP
+#define PEAKS_HPP
+
+#include <QVector>
+#include <QSharedPointer>
+
+class Soundfile;
+
+#define PEAKS_BASE_SHIFT 8
+// level 0 bins summarize 256 frames
+#define PEAKS_LEVEL_SHIFT 2
+// each level groups 4 bins of the previous one
+#define PEAKS_READ_BLOCK 65536
+// in frames, must be a multiple of the level 0 bin size
+#define PEAKS_VERSION 1
+#define PEAKS_SUFFIX ".wpp"
+
+struct Peak
+{
+    float min;
+    float max;
+    float rms;
+};
+
+// multi-resolution min/max/rms summary of a soundfile, for display.
+// built once by reading the file, then kept next to the SampleCache
+// entries (<source>-<fingerprint>.wpp) when the cache is enabled.
+// any range can be queried in O(pixels), from the level whose
+// bins are the closest to (and not larger than) a pixel
+
+class PeakPyramid
+{
+    public:
+    // shared by everyone displaying the same file, loaded from
+    // the cache or built from the file: blocking, call it from a worker
+    static QSharedPointer<PeakPyramid> get ( QString path );
+
+    quint16 nchannels   ( ) const { return m_nchannels; }
+    quint32 sampleRate  ( ) const { return m_sample_rate; }
+    quint64 nframes     ( ) const { return m_nframes; }
+    quint16 nlevels     ( ) const { return m_levels.size(); }
+
+    static quint64 binFrames ( quint16 level )
+    {
+        return Q_UINT64_C(1) << (PEAKS_BASE_SHIFT+level*PEAKS_LEVEL_SHIFT);
+    }
+
+    // summarizes frames [first, last[ of 'channel' into npixels peaks
+    void query ( quint16 channel, quint64 first, quint64 last,
+                 quint32 npixels, Peak* out ) const;
+
+    private:
+    void build  ( Soundfile& soundfile );
+    bool load   ( QString file );
+    void save   ( QString file ) const;
+
+    quint16 m_nchannels     = 0;
+    quint32 m_sample_rate   = 0;
+    quint64 m_nframes       = 0;
+
+    // [level][bin*nchannels+channel]
+    QVector<QVector<Peak>> m_levels;
+};
+
+typedef QSharedPointer<PeakPyramid> PeakPyramidPtr;
+
+#endif // PEAKS_HPP
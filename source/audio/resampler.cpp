@@ -0,0 +1,313 @@
+#include "resampler.hpp"
+#include <source/audio/simd.hpp>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <cmath>
+#include <cstring>
+
+struct QualitySettings
+{
+    quint16 ntaps;
+    quint16 nphases;
+    bool interpolate;
+    double beta;
+    double rolloff;
+};
+
+static const QualitySettings g_qualities[ 3 ] =
+{
+    {  8, 128, false, 5.0, 0.85 },
+    { 16, 256, true,  7.0, 0.90 },
+    { 32, 512, true,  9.0, 0.95 }
+};
+
+static QMutex g_kernel_mutex;
+static QHash<quint64, ResamplerKernel*> g_kernels;
+
+static QMutex g_cache_mutex;
+static QHash<QString, QWeakPointer<SampleBuffer>> g_cache;
+
+inline double bessel_i0(double x)
+{
+    double sum = 1.0, term = 1.0, y = x*x/4.0;
+
+    for ( quint16 k = 1; k < 64 && term > sum*1e-12; ++k )
+    {
+        term *= y/((double)k*k);
+        sum  += term;
+    }
+
+    return sum;
+}
+
+inline quint16 cutoff_level(double ratio)
+{
+    if ( ratio <= 1.0 ) return 0;
+    quint16 level = std::ceil( 2.0*std::log2(ratio) );
+    return qMin<quint16>( level, RESAMPLER_NLEVELS-1 );
+}
+
+const ResamplerKernel* Resampler::kernel(Interpolation::Values quality, float cutoff)
+{
+    quint64 key = ((quint64) quality << 32) | (quint32) std::lround(cutoff*1e6);
+    QMutexLocker lock ( &g_kernel_mutex );
+
+    if ( auto k = g_kernels.value(key, nullptr) )
+         return k;
+
+    const QualitySettings& q = g_qualities[ quality ];
+    auto k = new ResamplerKernel;
+
+    k->ntaps        = q.ntaps;
+    k->nphases      = q.nphases;
+    k->interpolate  = q.interpolate;
+    k->coeffs.resize( (q.nphases+1)*q.ntaps );
+
+    double fc   = cutoff*q.rolloff;
+    double half = q.ntaps/2.0;
+    double i0b  = bessel_i0(q.beta);
+
+    for ( quint32 p = 0; p <= q.nphases; ++p )
+    {
+        double frac = (double) p/q.nphases;
+        float* row  = k->coeffs.data()+p*q.ntaps;
+        double sum  = 0;
+
+        for ( quint16 t = 0; t < q.ntaps; ++t )
+        {
+            // distance from tap to the interpolated position
+            double x    = t-(half-1)-frac;
+            double sinc = x == 0 ? 1.0 : std::sin(M_PI*fc*x)/(M_PI*fc*x);
+            double w    = x/half;
+            double win  = std::fabs(w) >= 1 ? 0 : bessel_i0(q.beta*std::sqrt(1-w*w))/i0b;
+
+            row[t] = sinc*win;
+            sum   += row[t];
+        }
+
+        for ( quint16 t = 0; t < q.ntaps; ++t )
+            row[t] /= sum;
+    }
+
+    g_kernels.insert(key, k);
+    return k;
+}
+
+inline float interpolate(const ResamplerKernel& k, const float* x, double frac)
+{
+    double phase    = frac*k.nphases;
+    quint32 p       = phase;
+
+    if ( !k.interpolate )
+         return simd::dot( x, k.row(std::lround(phase)), k.ntaps );
+
+    float a = phase-p;
+    float y = simd::dot( x, k.row(p), k.ntaps );
+
+    if ( a == 0.f ) return y;
+    return y+a*(simd::dot(x, k.row(p+1), k.ntaps)-y);
+}
+
+SampleBufferPtr Resampler::convert(SampleBufferPtr source, quint32 rate,
+                                   Interpolation::Values quality, QString key)
+{
+    if ( source.isNull() || source->sampleRate() == rate )
+         return source;
+
+    if ( !key.isEmpty() )
+    {
+        key.append(QString("|%1|%2|%3|%4").arg(source->sampleRate()).arg(rate)
+                   .arg(quality).arg(source->format()));
+
+        QMutexLocker lock ( &g_cache_mutex );
+        SampleBufferPtr cached = g_cache.value(key).toStrongRef();
+        if ( !cached.isNull() ) return cached;
+    }
+
+    double ratio    = (double) source->sampleRate()/rate;
+    auto k          = kernel( quality, qMin(1.0, 1.0/ratio) );
+    quint16 nch     = source->nchannels();
+    quint64 nin     = source->nframes();
+    quint64 nout    = nin ? (quint64)((nin-1)/ratio)+1 : 0;
+    quint16 half    = k->ntaps/2;
+
+    // result is stored in the same format as the source
+    auto result     = SampleBufferPtr( new SampleBuffer(nch, nout, rate, source->format()) );
+
+    // converted in blocks of output frames, each reading a window
+    // of about SAMPLEBUFFER_CHUNK input frames plus the kernel's taps
+    quint64 block   = qMax<quint64>( 1, SAMPLEBUFFER_CHUNK/qMax(1.0, ratio) );
+    quint64 span    = (quint64)((block-1)*ratio)+k->ntaps+1;
+
+    QVector<float> chunk ( qMax(span, block)*nch );
+    QVector<QVector<float>> x ( nch, QVector<float>(span, 0.f) );
+
+    for ( quint64 f = 0; f < nout; f += block )
+    {
+        quint64 n       = qMin<quint64>( block, nout-f );
+        quint64 first   = (quint64)(f*ratio);
+        quint64 last    = (quint64)((f+n-1)*ratio)+k->ntaps-1;
+
+        // window [first, last] of the input padded by half a kernel of
+        // silence, so that the first output is centered on the first frame
+        qint64 from     = (qint64) first-(half-1);
+        qint64 to       = qMin<qint64>( (qint64) last-(half-1), (qint64) nin-1 );
+        quint64 lead    = from < 0 ? -from : 0;
+        quint64 ndec    = to >= from+(qint64) lead ? to-from-lead+1 : 0;
+        quint64 nwin    = last-first+1;
+
+        if ( ndec ) source->decode( from+lead, ndec, chunk.data() );
+
+        for ( quint16 ch = 0; ch < nch; ++ch )
+        {
+            auto data = x[ch].data();
+
+            for ( quint64 i = 0; i < nwin; ++i )
+                data[i] = i >= lead && i < lead+ndec ? chunk[(i-lead)*nch+ch] : 0.f;
+        }
+
+        for ( quint16 ch = 0; ch < nch; ++ch )
+        {
+            auto data = x[ch].constData();
+
+            for ( quint64 i = 0; i < n; ++i )
+            {
+                double pos  = (f+i)*ratio;
+                quint64 j   = pos;
+                chunk[i*nch+ch] = interpolate( *k, data+j-first, pos-j );
+            }
+        }
+
+        result->encode( f, n, chunk.constData() );
+    }
+
+    if ( !key.isEmpty() )
+    {
+        QMutexLocker lock ( &g_cache_mutex );
+        g_cache.insert(key, result.toWeakRef());
+    }
+
+    return result;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+Resampler::Resampler(quint16 nchannels, quint32 max_block, Interpolation::Values quality) :
+    m_nchannels(nchannels)
+{
+    for ( quint16 l = 0; l < RESAMPLER_NLEVELS; ++l )
+        m_kernels[l] = kernel( quality, std::pow(2.0, -l/2.0) );
+
+    m_ntaps     = m_kernels[0]->ntaps;
+    m_capacity  = max_block*RESAMPLER_MAX_RATIO+m_ntaps*2+4;
+    m_history   = new float* [ nchannels ];
+    m_input     = new float* [ nchannels ];
+
+    for ( quint16 ch = 0; ch < nchannels; ++ch )
+        m_history[ch] = new float [ m_capacity ]();
+
+    reset();
+}
+
+Resampler::~Resampler()
+{
+    for ( quint16 ch = 0; ch < m_nchannels; ++ch )
+        delete [ ] m_history[ch];
+
+    delete [ ] m_history;
+    delete [ ] m_input;
+}
+
+void Resampler::reset()
+{
+    // start with half a kernel of silence,
+    // so that the first output is centered on the first input frame
+    quint16 half = m_ntaps/2;
+
+    for ( quint16 ch = 0; ch < m_nchannels; ++ch )
+        memset( m_history[ch], 0, sizeof(float)*m_capacity );
+
+    m_avail = half-1;
+    m_pos   = half-1;
+}
+
+quint32 Resampler::required(quint32 nframes, double ratio) const
+{
+    if ( !nframes ) return 0;
+
+    double last     = m_pos+(nframes-1)*ratio;
+    quint32 needed  = (quint32) last+m_ntaps/2+1;
+
+    if ( needed <= m_avail ) return 0;
+    return qMin( needed-m_avail, m_capacity-m_avail );
+}
+
+float** Resampler::input()
+{
+    for ( quint16 ch = 0; ch < m_nchannels; ++ch )
+        m_input[ch] = m_history[ch]+m_avail;
+
+    return m_input;
+}
+
+void Resampler::commit(quint32 nframes)
+{
+    m_avail = qMin( m_avail+nframes, m_capacity );
+}
+
+void Resampler::process(float** out, quint32 nframes, double ratio)
+{
+    const ResamplerKernel& k = *m_kernels[ cutoff_level(ratio) ];
+    quint16 half = m_ntaps/2;
+    double pos   = m_pos;
+
+    // unity rate on a whole frame: frames are copied as they are,
+    // with the same (half kernel) latency as when interpolating
+    bool copy = ratio == 1.0 && pos == std::floor(pos) &&
+                (quint32) pos+nframes-1+half < m_avail;
+
+    if ( copy )
+    {
+        for ( quint16 ch = 0; ch < m_nchannels; ++ch )
+            memcpy( out[ch], m_history[ch]+(quint32) pos, sizeof(float)*nframes );
+
+        pos += nframes;
+    }
+
+    else for ( quint32 s = 0; s < nframes; ++s )
+    {
+        quint32 i       = pos;
+        quint32 base    = i-half+1;
+        double frac     = pos-i;
+
+        if ( i+half >= m_avail )
+        {
+            // input ran short (voice ended), output silence
+            for ( quint16 ch = 0; ch < m_nchannels; ++ch )
+                out[ch][s] = 0.f;
+        }
+        else
+        {
+            for ( quint16 ch = 0; ch < m_nchannels; ++ch )
+                out[ch][s] = interpolate( k, m_history[ch]+base, frac );
+        }
+
+        pos += ratio;
+    }
+
+    // drop the frames that won't be needed anymore
+    quint32 keep = (quint32) pos;
+    quint32 drop = keep+1 > half ? qMin<quint32>( keep+1-half, m_avail ) : 0;
+
+    if ( drop )
+    {
+        for ( quint16 ch = 0; ch < m_nchannels; ++ch )
+            memmove( m_history[ch], m_history[ch]+drop, sizeof(float)*(m_avail-drop) );
+
+        m_avail -= drop;
+        pos     -= drop;
+    }
+
+    m_pos = pos;
+}
@@ -0,0 +1,77 @@
+#ifndef RESAMPLER_HPP
+#define RESAMPLER_HPP
+
+#include <QObject>
+#include <QVector>
+#include <source/audio/samplebuffer.hpp>
+
+#define RESAMPLER_MAX_RATIO 16
+#define RESAMPLER_NLEVELS 9
+// anti-aliasing levels: cutoff is lowered by half an octave per level
+
+class Interpolation : public QObject
+{
+    Q_OBJECT
+    public:
+    enum Values
+    {
+        Fast    = 0,    // 8 taps, nearest phase
+        Medium  = 1,    // 16 taps, interpolated phases
+        Best    = 2     // 32 taps, interpolated phases
+    };
+
+    Q_ENUM ( Values )
+};
+
+// polyphase table of a kaiser-windowed sinc,
+// (nphases+1) rows of ntaps coefficients, each row normalized to unity gain
+struct ResamplerKernel
+{
+    quint16 ntaps;
+    quint16 nphases;
+    bool interpolate;
+    QVector<float> coeffs;
+
+    const float* row(quint32 phase) const { return coeffs.constData()+phase*ntaps; }
+};
+
+class Resampler
+{
+    public:
+    Resampler  ( quint16 nchannels, quint32 max_block, Interpolation::Values quality );
+    ~Resampler ( );
+
+    Resampler ( Resampler const& ) = delete;
+    Resampler& operator= ( Resampler const& ) = delete;
+
+    // kernels are built once and shared process-wide,
+    // cutoff is relative to the input nyquist frequency
+    static const ResamplerKernel* kernel ( Interpolation::Values quality, float cutoff );
+
+    // load-time conversion of a whole buffer to 'rate'
+    // results are cached by key (if any) as long as someone holds them
+    static SampleBufferPtr convert ( SampleBufferPtr source, quint32 rate,
+                                     Interpolation::Values quality, QString key = QString() );
+
+    // streaming interface, used for real-time rate changes:
+    // ask how many input frames are 'required' to output nframes,
+    // write them at 'input()', 'commit' them and 'process'
+    void reset          ( );
+    quint32 required    ( quint32 nframes, double ratio ) const;
+    float** input       ( );
+    void commit         ( quint32 nframes );
+    void process        ( float** out, quint32 nframes, double ratio );
+
+    private:
+    quint16 m_nchannels;
+    quint16 m_ntaps;
+    quint32 m_capacity;
+    quint32 m_avail = 0;
+    double m_pos    = 0;
+
+    float** m_history   = nullptr;
+    float** m_input     = nullptr;
+    const ResamplerKernel* m_kernels [ RESAMPLER_NLEVELS ];
+};
+
+#endif // RESAMPLER_HPP
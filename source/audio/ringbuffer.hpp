@@ -0,0 +1,112 @@
+#ifndef RINGBUFFER_HPP
+#define RINGBUFFER_HPP
+
+#include <QtGlobal>
+#include <atomic>
+
+// single-producer/single-consumer lock-free ringbuffer,
+// used to pass commands or audio data to/from the audio thread
+// without locking. capacity is rounded up to a power of two,
+// storage is allocated once and never touched again
+// from the audio thread
+
+template<typename T> class Ringbuffer
+{
+    public:
+    Ringbuffer ( quint64 capacity = 0 ) { allocate(capacity); }
+    ~Ringbuffer ( ) { delete [ ] m_data; }
+
+    Ringbuffer ( Ringbuffer const& ) = delete;
+    Ringbuffer& operator= ( Ringbuffer const& ) = delete;
+
+    void allocate ( quint64 capacity )
+    {
+        delete [ ] m_data;
+        m_data = nullptr;
+        m_size = 0;
+        m_mask = 0;
+
+        m_read.store  ( 0 );
+        m_write.store ( 0 );
+
+        if ( !capacity ) return;
+
+        quint64 sz = 1;
+        while ( sz < capacity ) sz <<= 1;
+
+        m_data = new T[ sz ]();
+        m_size = sz;
+        m_mask = sz-1;
+    }
+
+    quint64 capacity ( ) const { return m_size; }
+
+    quint64 readAvailable ( ) const
+    {
+        return m_write.load(std::memory_order_acquire)-
+               m_read.load(std::memory_order_relaxed);
+    }
+
+    quint64 writeAvailable ( ) const
+    {
+        return m_size-( m_write.load(std::memory_order_relaxed)-
+                        m_read.load(std::memory_order_acquire));
+    }
+
+    // producer side
+    bool push ( T const& value )
+    {
+        if ( !writeAvailable() ) return false;
+
+        auto w = m_write.load(std::memory_order_relaxed);
+        m_data[ w & m_mask ] = value;
+        m_write.store( w+1, std::memory_order_release );
+        return true;
+    }
+
+    // pushes all or nothing
+    bool push ( T const* values, quint64 n )
+    {
+        if ( writeAvailable() < n ) return false;
+
+        auto w = m_write.load(std::memory_order_relaxed);
+        for ( quint64 i = 0; i < n; ++i )
+            m_data[ (w+i) & m_mask ] = values[i];
+
+        m_write.store( w+n, std::memory_order_release );
+        return true;
+    }
+
+    // consumer side
+    bool pop ( T& value )
+    {
+        if ( !readAvailable() ) return false;
+
+        auto r = m_read.load(std::memory_order_relaxed);
+        value = m_data[ r & m_mask ];
+        m_read.store( r+1, std::memory_order_release );
+        return true;
+    }
+
+    quint64 pop ( T* values, quint64 n )
+    {
+        n = qMin( n, readAvailable() );
+
+        auto r = m_read.load(std::memory_order_relaxed);
+        for ( quint64 i = 0; i < n; ++i )
+            values[i] = m_data[ (r+i) & m_mask ];
+
+        m_read.store( r+n, std::memory_order_release );
+        return n;
+    }
+
+    private:
+    T* m_data       = nullptr;
+    quint64 m_size  = 0;
+    quint64 m_mask  = 0;
+
+    std::atomic<quint64> m_read  { 0 };
+    std::atomic<quint64> m_write { 0 };
+};
+
+#endif // RINGBUFFER_HPP
@@ -0,0 +1,137 @@
+#include "samplebuffer.hpp"
+#include <source/audio/simd.hpp>
+#include <QVector>
+#include <QFile>
+
+SampleBuffer::SampleBuffer(quint16 nchannels, quint64 nframes, quint32 sample_rate,
+                           SampleFormat::Values format) :
+    m_data(new quint8[nframes*nchannels*bytesPerSample(format)]()),
+    m_nchannels(nchannels), m_nframes(nframes),
+    m_sample_rate(sample_rate), m_format(format)
+{
+
+}
+
+SampleBuffer::SampleBuffer(QFile* mapping, quint8* data, quint16 nchannels, quint64 nframes,
+                           quint32 sample_rate, SampleFormat::Values format) :
+    m_data(data), m_mapping(mapping),
+    m_nchannels(nchannels), m_nframes(nframes),
+    m_sample_rate(sample_rate), m_format(format)
+{
+
+}
+
+SampleBuffer::~SampleBuffer()
+{
+    if ( m_mapping )
+    {
+        m_mapping->unmap(m_data);
+        delete m_mapping;
+    }
+    else delete [ ] m_data;
+}
+
+quint16 SampleBuffer::bytesPerSample(SampleFormat::Values format)
+{
+    switch ( format )
+    {
+    case SampleFormat::Float32: return 4;
+    case SampleFormat::Int16:   return 2;
+    case SampleFormat::Int24:   return 3;
+    case SampleFormat::Half:    return 2;
+    }
+
+    return 4;
+}
+
+SampleBufferPtr SampleBuffer::convert(SampleBufferPtr source, SampleFormat::Values format)
+{
+    if ( source.isNull() || source->format() == format )
+         return source;
+
+    auto result = SampleBufferPtr( new SampleBuffer(source->nchannels(), source->nframes(),
+                                                    source->sampleRate(), format) );
+
+    QVector<float> chunk ( SAMPLEBUFFER_CHUNK*source->nchannels() );
+
+    for ( quint64 f = 0; f < source->nframes(); f += SAMPLEBUFFER_CHUNK )
+    {
+        quint64 n = qMin<quint64>( SAMPLEBUFFER_CHUNK, source->nframes()-f );
+        source->decode( f, n, chunk.data() );
+        result->encode( f, n, chunk.constData() );
+    }
+
+    return result;
+}
+
+void SampleBuffer::encode(quint64 first, quint64 nframes, const float* src)
+{
+    quint64 n       = nframes*m_nchannels;
+    quint64 offset  = first*m_nchannels*bytesPerSample(m_format);
+    quint8* dst     = m_data+offset;
+
+    switch ( m_format )
+    {
+    case SampleFormat::Float32: memcpy( dst, src, n*sizeof(float) ); break;
+    case SampleFormat::Int16:   simd::to_int16( (qint16*) dst, src, n ); break;
+    case SampleFormat::Int24:   simd::to_int24( dst, src, n ); break;
+    case SampleFormat::Half:    simd::to_half( (quint16*) dst, src, n ); break;
+    }
+}
+
+void SampleBuffer::decode(quint64 first, quint64 nframes, float* dst) const
+{
+    quint64 n           = nframes*m_nchannels;
+    quint64 offset      = first*m_nchannels*bytesPerSample(m_format);
+    const quint8* src   = m_data+offset;
+
+    switch ( m_format )
+    {
+    case SampleFormat::Float32: memcpy( dst, src, n*sizeof(float) ); break;
+    case SampleFormat::Int16:   simd::from_int16( dst, (const qint16*) src, n ); break;
+    case SampleFormat::Int24:   simd::from_int24( dst, src, n ); break;
+    case SampleFormat::Half:    simd::from_half( dst, (const quint16*) src, n ); break;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+SampleReader::SampleReader(SampleBufferPtr buffer) :
+    m_buffer(buffer), m_nchannels(buffer->nchannels())
+{
+    m_direct = buffer->data();
+
+    for ( quint16 s = 0; s < SAMPLEREADER_NSLOTS; ++s )
+    {
+        m_slots[s]  = m_direct ? nullptr : new float[ SAMPLEBUFFER_CHUNK*m_nchannels ]();
+        m_chunks[s] = Q_UINT64_C(0xffffffffffffffff);
+        m_used[s]   = 0;
+    }
+}
+
+SampleReader::~SampleReader()
+{
+    for ( quint16 s = 0; s < SAMPLEREADER_NSLOTS; ++s )
+        delete [ ] m_slots[s];
+}
+
+float* SampleReader::load(quint64 chunk)
+{
+    // recycle the least recently used slot,
+    // the two chunks touched last (i.e. a crossfade's both ends) stay decoded
+    quint16 slot = 0;
+
+    for ( quint16 s = 1; s < SAMPLEREADER_NSLOTS; ++s )
+        if ( m_used[s] < m_used[slot] ) slot = s;
+
+    quint64 first   = chunk << SAMPLEBUFFER_CHUNK_SHIFT;
+    quint64 nframes = first < m_buffer->nframes() ?
+                qMin<quint64>( SAMPLEBUFFER_CHUNK, m_buffer->nframes()-first ) : 0;
+
+    m_buffer->decode( first, nframes, m_slots[slot] );
+
+    m_chunks[slot]  = chunk;
+    m_used[slot]    = ++m_clock;
+
+    return m_slots[slot];
+}
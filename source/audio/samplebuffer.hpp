@@ -0,0 +1,128 @@
+#ifndef SAMPLEBUFFER_HPP
+#define SAMPLEBUFFER_HPP
+
+#include <QObject>
+#include <QSharedPointer>
+
+class QFile;
+
+#define SAMPLEBUFFER_CHUNK_SHIFT 10
+#define SAMPLEBUFFER_CHUNK (1 << SAMPLEBUFFER_CHUNK_SHIFT)
+#define SAMPLEREADER_NSLOTS 3
+
+class SampleFormat : public QObject
+{
+    Q_OBJECT
+    public:
+    enum Values
+    {
+        Float32 = 0,
+        Int16   = 1,
+        Int24   = 2,    // packed, 3 bytes per sample
+        Half    = 3     // ieee 754 binary16
+    };
+
+    Q_ENUM ( Values )
+};
+
+// block of interleaved sample frames, decoded once
+// and shared by every sampler/voice reading the same data.
+// samples are kept either as floats, or in a compact format
+// that is converted back to float when read
+
+class SampleBuffer
+{
+    public:
+    SampleBuffer  ( quint16 nchannels, quint64 nframes, quint32 sample_rate,
+                    SampleFormat::Values format = SampleFormat::Float32 );
+
+    // read-only view of a mapped file region (see SampleCache),
+    // the buffer takes ownership of the file and unmaps it when destroyed
+    SampleBuffer  ( QFile* mapping, quint8* data, quint16 nchannels, quint64 nframes,
+                    quint32 sample_rate, SampleFormat::Values format );
+
+    ~SampleBuffer ( );
+
+    SampleBuffer ( SampleBuffer const& ) = delete;
+    SampleBuffer& operator= ( SampleBuffer const& ) = delete;
+
+    // returns a copy of 'source' stored in 'format' (or source itself if already in that format)
+    static QSharedPointer<SampleBuffer> convert ( QSharedPointer<SampleBuffer> source,
+                                                  SampleFormat::Values format );
+
+    static quint16 bytesPerSample ( SampleFormat::Values format );
+
+    // float access, only valid with Float32 storage
+    float* data         ( ) { return m_format == SampleFormat::Float32 ? (float*) m_data : nullptr; }
+    const float* data   ( ) const { return m_format == SampleFormat::Float32 ? (const float*) m_data : nullptr; }
+
+    const quint8* raw   ( ) const { return m_data; }
+    quint16 nchannels   ( ) const { return m_nchannels; }
+    quint64 nframes     ( ) const { return m_nframes; }
+    quint32 sampleRate  ( ) const { return m_sample_rate; }
+    quint64 bytes       ( ) const { return m_nframes*m_nchannels*bytesPerSample(m_format); }
+    SampleFormat::Values format ( ) const { return m_format; }
+
+    // interleaved float frames <-> storage
+    void encode ( quint64 first, quint64 nframes, const float* src );
+    void decode ( quint64 first, quint64 nframes, float* dst ) const;
+
+    private:
+    quint8* m_data;
+    QFile* m_mapping = nullptr;
+    quint16 m_nchannels;
+    quint64 m_nframes;
+    quint32 m_sample_rate;
+    SampleFormat::Values m_format;
+};
+
+typedef QSharedPointer<SampleBuffer> SampleBufferPtr;
+
+// per-voice random access to a SampleBuffer's frames.
+// with compact storage, frames are decoded by chunks
+// into a few float slots, least recently used slot is recycled
+
+class SampleReader
+{
+    public:
+    SampleReader  ( SampleBufferPtr buffer );
+    ~SampleReader ( );
+
+    SampleReader ( SampleReader const& ) = delete;
+    SampleReader& operator= ( SampleReader const& ) = delete;
+
+    // pointer to the nchannels samples of frame 'index',
+    // valid until the next two calls
+    inline const float* frame ( quint64 index )
+    {
+        if ( m_direct ) return m_direct+index*m_nchannels;
+
+        quint64 chunk = index >> SAMPLEBUFFER_CHUNK_SHIFT;
+        quint64 offset = (index & (SAMPLEBUFFER_CHUNK-1))*m_nchannels;
+
+        for ( quint16 s = 0; s < SAMPLEREADER_NSLOTS; ++s )
+        {
+            if ( m_chunks[s] == chunk )
+            {
+                m_used[s] = ++m_clock;
+                return m_slots[s]+offset;
+            }
+        }
+
+        return load( chunk )+offset;
+    }
+
+    private:
+    float* load ( quint64 chunk );
+
+    SampleBufferPtr m_buffer;
+    const float* m_direct = nullptr;
+    quint16 m_nchannels;
+    quint64 m_clock = 0;
+
+    float* m_slots      [ SAMPLEREADER_NSLOTS ];
+    quint64 m_chunks    [ SAMPLEREADER_NSLOTS ];
+    quint64 m_used      [ SAMPLEREADER_NSLOTS ];
+};
+
+#endif // SAMPLEBUFFER_HPP
@@ -0,0 +1,244 @@
+#include "samplecache.hpp"
+#include <source/audio/peaks.hpp>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QQmlEngine>
+#include <QSaveFile>
+#include <QtConcurrent>
+#include <QtDebug>
+#include <qendian.h>
+
+SampleCache::SampleCache()
+{
+
+}
+
+SampleCache& SampleCache::instance()
+{
+    static SampleCache cache;
+    return cache;
+}
+
+QObject* SampleCache::qmlInstance(QQmlEngine*, QJSEngine*)
+{
+    QQmlEngine::setObjectOwnership( &instance(), QQmlEngine::CppOwnership );
+    return &instance();
+}
+
+QString SampleCache::path() const
+{
+    QMutexLocker lock ( &m_mutex );
+    return m_path;
+}
+
+bool SampleCache::enabled() const
+{
+    QMutexLocker lock ( &m_mutex );
+    return !m_path.isEmpty();
+}
+
+void SampleCache::setPath(QString path)
+{
+    if ( !path.isEmpty() && !QDir().mkpath(path) )
+    {
+        qDebug() << "[SAMPLECACHE] could not create" << path;
+        path.clear();
+    }
+
+    // oldest first, so that each key ends up with its most recent entry
+    QHash<QString, QString> latest;
+
+    if ( !path.isEmpty() )
+    {
+        for ( const auto& entry : QDir(path).entryList(QStringList("*" SAMPLECACHE_SUFFIX),
+                                                       QDir::Files, QDir::Time | QDir::Reversed) )
+            latest.insert( entry.section('-', 0, 2), entry );
+    }
+
+    {
+        QMutexLocker lock ( &m_mutex );
+        m_path   = path;
+        m_latest = latest;
+    }
+
+    emit pathChanged();
+}
+
+inline QString short_hash(QString str)
+{
+    return QCryptographicHash::hash( str.toUtf8(), QCryptographicHash::Sha1 ).toHex().left(16);
+}
+
+QString SampleCache::source(QString path)
+{
+    QFileInfo info ( path );
+
+    QString fingerprint = QString("%1|%2|%3").arg(info.size())
+            .arg(info.lastModified().toMSecsSinceEpoch()).arg(SAMPLECACHE_VERSION);
+
+    return QString("%1-%2").arg(short_hash(info.canonicalFilePath()))
+            .arg(short_hash(fingerprint));
+}
+
+QString SampleCache::key(QString source, quint64 start, quint64 nframes, int format, int quality)
+{
+    QString settings = QString("%1|%2|%3|%4").arg(start).arg(nframes)
+            .arg(format).arg(quality);
+
+    return QString("%1-%2").arg(SampleCache::source(source)).arg(short_hash(settings));
+}
+
+SampleBufferPtr SampleCache::fetch(QString key, quint32 rate) const
+{
+    QString directory, name;
+
+    {
+        QMutexLocker lock ( &m_mutex );
+        directory = m_path;
+
+        if ( rate ) name = QString("%1-%2%3").arg(key).arg(rate).arg(SAMPLECACHE_SUFFIX);
+        else name = m_latest.value(key);
+    }
+
+    if ( directory.isEmpty() || key.isEmpty() || name.isEmpty() )
+         return SampleBufferPtr();
+
+    QDir dir ( directory );
+    auto file = new QFile( dir.filePath(name) );
+
+    if ( !file->open(QIODevice::ReadOnly) )
+    {
+        // removed behind our back
+        QMutexLocker lock ( &m_mutex );
+        if ( m_latest.value(key) == name ) m_latest.remove(key);
+
+        delete file;
+        return SampleBufferPtr();
+    }
+
+    QByteArray header   = file->read( SAMPLECACHE_HEADER_SIZE );
+    auto h              = (const uchar*) header.constData();
+    bool valid          = header.size() == SAMPLECACHE_HEADER_SIZE && !memcmp(h, "WPNC", 4) &&
+                          qFromLittleEndian<quint32>(h+4) == SAMPLECACHE_VERSION;
+
+    quint16 nchannels   = valid ? qFromLittleEndian<quint16>(h+8) : 0;
+    quint16 format      = valid ? qFromLittleEndian<quint16>(h+10) : 0;
+    quint32 sample_rate = valid ? qFromLittleEndian<quint32>(h+12) : 0;
+    quint64 nframes     = valid ? qFromLittleEndian<quint64>(h+16) : 0;
+    quint64 nbytes      = valid ? qFromLittleEndian<quint64>(h+24) : 0;
+
+    valid = valid && nchannels && nframes && format <= SampleFormat::Half &&
+            nbytes == nframes*nchannels*SampleBuffer::bytesPerSample((SampleFormat::Values) format) &&
+            (quint64) file->size() == SAMPLECACHE_HEADER_SIZE+nbytes;
+
+    quint8* data = valid ? file->map( SAMPLECACHE_HEADER_SIZE, nbytes ) : nullptr;
+
+    if ( !data )
+    {
+        // truncated or written by another version, it will be rebuilt
+        qDebug() << "[SAMPLECACHE] discarding invalid entry" << name;
+        file->close();
+        file->remove();
+        delete file;
+
+        QMutexLocker lock ( &m_mutex );
+        if ( m_latest.value(key) == name ) m_latest.remove(key);
+        return SampleBufferPtr();
+    }
+
+    return SampleBufferPtr( new SampleBuffer(file, data, nchannels, nframes,
+                                             sample_rate, (SampleFormat::Values) format) );
+}
+
+void SampleCache::store(QString key, SampleBufferPtr buffer)
+{
+    QString directory = path();
+    if ( directory.isEmpty() || key.isEmpty() || buffer.isNull() ) return;
+
+    m_pending.ref();
+    emit pendingChanged();
+
+    QtConcurrent::run( this, &SampleCache::write, directory, key, buffer );
+}
+
+void SampleCache::write(QString directory, QString key, SampleBufferPtr buffer)
+{
+    QDir dir ( directory );
+    QString name = QString("%1-%2%3").arg(key).arg(buffer->sampleRate()).arg(SAMPLECACHE_SUFFIX);
+
+    QByteArray header ( SAMPLECACHE_HEADER_SIZE, 0 );
+    auto h = (uchar*) header.data();
+
+    memcpy ( h, "WPNC", 4 );
+    qToLittleEndian<quint32> ( SAMPLECACHE_VERSION, h+4 );
+    qToLittleEndian<quint16> ( buffer->nchannels(), h+8 );
+    qToLittleEndian<quint16> ( buffer->format(), h+10 );
+    qToLittleEndian<quint32> ( buffer->sampleRate(), h+12 );
+    qToLittleEndian<quint64> ( buffer->nframes(), h+16 );
+    qToLittleEndian<quint64> ( buffer->bytes(), h+24 );
+
+    // written to a temporary file and renamed when complete,
+    // readers never see a partial entry
+    QSaveFile file ( dir.filePath(name) );
+
+    bool written = file.open(QIODevice::WriteOnly) &&
+                   file.write(header) == header.size() &&
+                   file.write((const char*) buffer->raw(), buffer->bytes()) == (qint64) buffer->bytes() &&
+                   file.commit();
+
+    if ( !written )
+         qDebug() << "[SAMPLECACHE] could not write" << name << file.errorString();
+
+    prune( directory, key, SAMPLECACHE_SUFFIX );
+
+    {
+        QMutexLocker lock ( &m_mutex );
+        QString source      = key.section('-', 0, 0);
+        QString fingerprint = key.section('-', 1, 1);
+
+        // the path may have changed meanwhile
+        if ( m_path == directory )
+        {
+            for ( auto it = m_latest.begin(); it != m_latest.end(); )
+            {
+                if ( it.key().section('-', 0, 0) == source &&
+                     it.key().section('-', 1, 1) != fingerprint )
+                     it = m_latest.erase(it);
+                else ++it;
+            }
+
+            if ( written ) m_latest.insert( key, name );
+        }
+    }
+
+    m_pending.deref();
+    emit pendingChanged();
+}
+
+void SampleCache::prune(QString directory, QString key, QString suffix)
+{
+    QDir dir ( directory );
+    QString source      = key.section('-', 0, 0);
+    QString fingerprint = key.section('-', 1, 1);
+
+    for ( const auto& entry : dir.entryList(QStringList(source+"-*"+suffix), QDir::Files) )
+        if ( entry.section('-', 1, 1).section('.', 0, 0) != fingerprint )
+             dir.remove(entry);
+}
+
+void SampleCache::clear()
+{
+    QString directory = path();
+    if ( directory.isEmpty() ) return;
+
+    QDir dir ( directory );
+
+    for ( const auto& entry : dir.entryList(QStringList{"*" SAMPLECACHE_SUFFIX, "*" PEAKS_SUFFIX}, QDir::Files) )
+        dir.remove(entry);
+
+    QMutexLocker lock ( &m_mutex );
+    m_latest.clear();
+}
@@ -0,0 +1,83 @@
+#ifndef SAMPLECACHE_HPP
+#define SAMPLECACHE_HPP
+
+#include <QObject>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QHash>
+#include <source/audio/samplebuffer.hpp>
+
+class QQmlEngine;
+class QJSEngine;
+
+#define SAMPLECACHE_VERSION 1
+#define SAMPLECACHE_HEADER_SIZE 4096
+// in bytes, sample data starts on a page boundary
+// so that it can be mapped and read as is
+#define SAMPLECACHE_SUFFIX ".wpc"
+
+// optional on-disk store of decoded (and converted) sample data.
+// entries are named <source>-<fingerprint>-<settings>-<rate>.wpc:
+// the fingerprint changes with the source's size and modification time,
+// so that edited files miss the cache, are decoded again and their
+// stale entries replaced in the background.
+// waveform peaks (see PeakPyramid) are kept in the same directory
+
+class SampleCache : public QObject
+{
+    Q_OBJECT
+
+    Q_PROPERTY  ( QString path READ path WRITE setPath NOTIFY pathChanged )
+    Q_PROPERTY  ( bool enabled READ enabled NOTIFY pathChanged )
+    Q_PROPERTY  ( int pending READ pending NOTIFY pendingChanged )
+
+    public:
+    static SampleCache& instance();
+    static QObject* qmlInstance ( QQmlEngine*, QJSEngine* );
+
+    QString path    ( ) const;
+    bool enabled    ( ) const;
+    int pending     ( ) const { return m_pending.load(); }
+
+    // cache directory, created if needed, empty disables the cache
+    void setPath    ( QString path );
+
+    // identifies a version of the file at 'path': <source>-<fingerprint>
+    static QString source ( QString path );
+
+    // removes the entries with this suffix left by
+    // previous versions of the same source as 'key'
+    static void prune ( QString directory, QString key, QString suffix );
+
+    // identifies a decoded region of 'source' with the given settings,
+    // independently of the rate it is converted to
+    static QString key ( QString source, quint64 start, quint64 nframes,
+                         int format, int quality );
+
+    // maps the entry for 'key' at 'rate' (0: most recent entry at any rate),
+    // returns null on a miss or if the entry doesn't validate
+    SampleBufferPtr fetch ( QString key, quint32 rate = 0 ) const;
+
+    // writes 'buffer' in the background, removes entries
+    // left by previous versions of the same source
+    void store ( QString key, SampleBufferPtr buffer );
+
+    Q_INVOKABLE void clear ( );
+
+    signals:
+    void pathChanged    ( );
+    void pendingChanged ( );
+
+    private:
+    SampleCache();
+    void write ( QString directory, QString key, SampleBufferPtr buffer );
+
+    mutable QMutex m_mutex;
+    QString m_path;
+
+    // key -> most recent entry at any rate, scanned when the path is set
+    mutable QHash<QString, QString> m_latest;
+    QAtomicInt m_pending { 0 };
+};
+
+#endif // SAMPLECACHE_HPP
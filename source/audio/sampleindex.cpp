@@ -0,0 +1,231 @@
+#include "sampleindex.hpp"
+#include <source/audio/soundfile.hpp>
+#include <source/audio/peaks.hpp>
+#include <source/audio/samplecache.hpp>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QSharedPointer>
+#include <QtDebug>
+#include <cmath>
+
+#define SAMPLEINDEX_MAGIC 0x57504e58 // 'WPNX'
+
+#define SAMPLEINDEX_STREAM QDataStream::Qt_5_0
+// fixed, so that indexes don't depend on the Qt version writing them
+
+static QMutex g_mutex;
+static QHash<QString, QSharedPointer<QMutex>> g_locks;
+
+QVariantMap SampleInfo::toMap() const
+{
+    QVariantMap map;
+
+    map.insert( "name", name );
+    map.insert( "nchannels", nchannels );
+    map.insert( "sampleRate", sample_rate );
+    map.insert( "nframes", (double) nframes );
+    map.insert( "duration", duration() );
+    map.insert( "bits", bits_per_sample );
+    map.insert( "float", is_float );
+
+    if ( analyzed )
+    {
+        map.insert( "peak", peak );
+        map.insert( "loudness", loudness );
+    }
+
+    return map;
+}
+
+QDataStream& operator<<(QDataStream& stream, const SampleInfo& info)
+{
+    return stream << info.name << info.size << info.mtime << info.nchannels
+                  << info.sample_rate << info.nframes << info.bits_per_sample
+                  << info.is_float << info.container << info.analyzed
+                  << info.peak << info.loudness;
+}
+
+QDataStream& operator>>(QDataStream& stream, SampleInfo& info)
+{
+    return stream >> info.name >> info.size >> info.mtime >> info.nchannels
+                  >> info.sample_rate >> info.nframes >> info.bits_per_sample
+                  >> info.is_float >> info.container >> info.analyzed
+                  >> info.peak >> info.loudness;
+}
+
+inline float to_db(double value)
+{
+    return 20.0*std::log10( qMax(value, 1e-9) );
+}
+
+inline void analyze_file(SampleInfo& info, QString path)
+{
+    // the pyramid's coarsest level summarizes the whole file,
+    // and is cached for waveform display as well
+    auto pyramid    = PeakPyramid::get( path );
+    double peak     = 0, power = 0;
+
+    for ( quint16 ch = 0; ch < pyramid->nchannels(); ++ch )
+    {
+        Peak summary;
+        pyramid->query( ch, 0, pyramid->nframes(), 1, &summary );
+
+        peak   = qMax<double>( peak, qMax(-summary.min, summary.max) );
+        power += (double) summary.rms*summary.rms;
+    }
+
+    if ( pyramid->nchannels() )
+         power /= pyramid->nchannels();
+
+    info.peak       = to_db( peak );
+    info.loudness   = to_db( std::sqrt(power) );
+    info.analyzed   = true;
+}
+
+// SAMPLEINDEX_FILE in the directory itself, or when it isn't writable,
+// <hash of its canonical path>.wpnindex in the cache directory (if any)
+inline QString index_path(QDir const& dir)
+{
+    if ( QFileInfo(dir.path()).isWritable() )
+         return dir.filePath( SAMPLEINDEX_FILE );
+
+    QString cache = SampleCache::instance().path();
+    if ( cache.isEmpty() ) return QString();
+
+    QString hash = QCryptographicHash::hash( dir.canonicalPath().toUtf8(),
+                                             QCryptographicHash::Sha1 ).toHex().left(16);
+
+    return QDir(cache).filePath( hash+SAMPLEINDEX_SUFFIX );
+}
+
+// scans of the same directory are serialized, others run concurrently
+inline QSharedPointer<QMutex> directory_lock(QDir const& dir)
+{
+    QMutexLocker lock ( &g_mutex );
+    auto& mutex = g_locks[ dir.canonicalPath() ];
+
+    if ( mutex.isNull() ) mutex.reset( new QMutex );
+    return mutex;
+}
+
+QStringList SampleIndex::filters()
+{
+    QStringList filters { "*.wav", "*.w64", "*.rf64" };
+#ifdef WPN114_SNDFILE
+    filters << "*.flac" << "*.ogg" << "*.oga" << "*.aif" << "*.aiff";
+#endif
+    return filters;
+}
+
+QVector<SampleInfo> SampleIndex::scan(QString directory, QStringList filters, bool analyze)
+{
+    QDir dir ( directory );
+    dir.setNameFilters  ( filters );
+    dir.setFilter       ( QDir::Files );
+    dir.setSorting      ( QDir::Name );
+
+    auto mutex = directory_lock( dir );
+    QMutexLocker lock ( mutex.data() );
+
+    QHash<QString, SampleInfo> known;
+    QString path = index_path( dir );
+    QFile file ( path );
+
+    if ( !path.isEmpty() && file.open(QIODevice::ReadOnly) )
+    {
+        QDataStream stream ( &file );
+        stream.setVersion( SAMPLEINDEX_STREAM );
+        stream.setFloatingPointPrecision( QDataStream::SinglePrecision );
+
+        quint32 magic = 0, version = 0, count = 0;
+        stream >> magic >> version >> count;
+
+        if ( magic == SAMPLEINDEX_MAGIC && version == SAMPLEINDEX_VERSION )
+        {
+            for ( quint32 n = 0; n < count && stream.status() == QDataStream::Ok; ++n )
+            {
+                SampleInfo info;
+                stream >> info;
+                if ( stream.status() == QDataStream::Ok )
+                     known.insert( info.name, info );
+            }
+        }
+
+        file.close();
+    }
+
+    QVector<SampleInfo> entries;
+    bool changed = false;
+
+    for ( const auto& fi : dir.entryInfoList() )
+    {
+        qint64 mtime    = fi.lastModified().toMSecsSinceEpoch();
+        SampleInfo info = known.value( fi.fileName() );
+
+        if ( info.name.isEmpty() || info.size != fi.size() || info.mtime != mtime )
+        {
+            // new or modified: header only
+            Soundfile soundfile ( fi.filePath() );
+
+            info                    = SampleInfo();
+            info.name               = fi.fileName();
+            info.size               = fi.size();
+            info.mtime              = mtime;
+            info.nchannels          = soundfile.nchannels();
+            info.sample_rate        = soundfile.sampleRate();
+            info.nframes            = soundfile.nsamples();
+            info.bits_per_sample    = soundfile.bitsPerSample();
+            info.is_float           = soundfile.isFloat();
+            info.container          = (quint8) soundfile.container();
+            changed = true;
+        }
+
+        if ( analyze && !info.analyzed && info.nchannels )
+        {
+            analyze_file( info, fi.filePath() );
+            changed = true;
+        }
+
+        entries << info;
+        known.insert( info.name, info );
+    }
+
+    // entries outside of 'filters' are kept, as long as their file exists
+    for ( auto it = known.begin(); it != known.end(); )
+    {
+        if ( dir.exists(it.key()) ) ++it;
+        else
+        {
+            it = known.erase(it);
+            changed = true;
+        }
+    }
+
+    if ( !changed || path.isEmpty() ) return entries;
+
+    QSaveFile output ( path );
+
+    if ( output.open(QIODevice::WriteOnly) )
+    {
+        QDataStream stream ( &output );
+        stream.setVersion( SAMPLEINDEX_STREAM );
+        stream.setFloatingPointPrecision( QDataStream::SinglePrecision );
+        stream << (quint32) SAMPLEINDEX_MAGIC << (quint32) SAMPLEINDEX_VERSION
+               << (quint32) known.size();
+
+        for ( const auto& info : known )
+            stream << info;
+    }
+
+    if ( !output.commit() )
+         qDebug() << "[SAMPLEINDEX] could not write index for" << directory;
+
+    return entries;
+}
@@ -0,0 +1,52 @@
+#ifndef SAMPLEINDEX_HPP
+#define SAMPLEINDEX_HPP
+
+#include <QStringList>
+#include <QVector>
+#include <QVariant>
+
+#define SAMPLEINDEX_VERSION 1
+#define SAMPLEINDEX_FILE ".wpnindex"
+#define SAMPLEINDEX_SUFFIX ".wpnindex"
+
+struct SampleInfo
+{
+    QString name;
+    qint64 size             = 0;
+    qint64 mtime            = 0;
+    quint16 nchannels       = 0;
+    quint32 sample_rate     = 0;
+    quint64 nframes         = 0;
+    quint16 bits_per_sample = 0;
+    bool is_float           = false;
+    quint8 container        = 0;
+
+    // filled when the file has been analyzed, in dBFS
+    bool analyzed           = false;
+    float peak              = 0;
+    float loudness          = 0;
+
+    qreal duration ( ) const { return sample_rate ? (qreal) nframes/sample_rate : 0; }
+    QVariantMap toMap ( ) const;
+};
+
+// compact per-directory index of soundfile metadata, stored as
+// SAMPLEINDEX_FILE in the directory itself, or in the SampleCache
+// directory when it isn't writable (not kept if the cache is disabled).
+// entries are kept current by comparing size and modification time,
+// only new or modified files are opened
+
+class SampleIndex
+{
+    public:
+    // name filters of the formats Soundfile can read
+    static QStringList filters ( );
+
+    // entries for the files of 'directory' matching 'filters', sorted by name.
+    // with 'analyze', peak and loudness (rms level) are also computed,
+    // which reads the whole file, the first time only
+    static QVector<SampleInfo> scan ( QString directory, QStringList filters,
+                                      bool analyze = false );
+};
+
+#endif // SAMPLEINDEX_HPP
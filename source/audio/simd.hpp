@@ -0,0 +1,314 @@
+#ifndef SIMD_HPP
+#define SIMD_HPP
+
+#include <QtGlobal>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define WPN114_SSE
+#include <xmmintrin.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define WPN114_SSE2
+#include <emmintrin.h>
+#endif
+
+// vectorized buffer kernels used in the audio callbacks,
+// falls back to plain loops (left to the compiler's auto-vectorizer)
+// when SSE is not available
+
+namespace simd
+{
+
+// dst[i] += src[i]
+inline void add(float* dst, const float* src, quint64 n)
+{
+    quint64 i = 0;
+#ifdef WPN114_SSE
+    for ( ; i+4 <= n; i += 4 )
+        _mm_storeu_ps(dst+i, _mm_add_ps(_mm_loadu_ps(dst+i), _mm_loadu_ps(src+i)));
+#endif
+    for ( ; i < n; ++i ) dst[i] += src[i];
+}
+
+// dst[i] *= gain
+inline void mul(float* dst, float gain, quint64 n)
+{
+    quint64 i = 0;
+#ifdef WPN114_SSE
+    __m128 g = _mm_set1_ps(gain);
+    for ( ; i+4 <= n; i += 4 )
+        _mm_storeu_ps(dst+i, _mm_mul_ps(_mm_loadu_ps(dst+i), g));
+#endif
+    for ( ; i < n; ++i ) dst[i] *= gain;
+}
+
+// dst[i] += src[i]*gain
+inline void madd(float* dst, const float* src, float gain, quint64 n)
+{
+    quint64 i = 0;
+#ifdef WPN114_SSE
+    __m128 g = _mm_set1_ps(gain);
+    for ( ; i+4 <= n; i += 4 )
+        _mm_storeu_ps(dst+i, _mm_add_ps(_mm_loadu_ps(dst+i),
+                             _mm_mul_ps(_mm_loadu_ps(src+i), g)));
+#endif
+    for ( ; i < n; ++i ) dst[i] += src[i]*gain;
+}
+
+// dst[i] += src[i]*(gain+i*inc), linear gain ramp
+inline void madd_ramp(float* dst, const float* src, float gain, float inc, quint64 n)
+{
+    quint64 i = 0;
+#ifdef WPN114_SSE
+    __m128 g    = _mm_setr_ps(gain, gain+inc, gain+2*inc, gain+3*inc);
+    __m128 step = _mm_set1_ps(4*inc);
+
+    for ( ; i+4 <= n; i += 4 )
+    {
+        _mm_storeu_ps(dst+i, _mm_add_ps(_mm_loadu_ps(dst+i),
+                             _mm_mul_ps(_mm_loadu_ps(src+i), g)));
+        g = _mm_add_ps(g, step);
+    }
+#endif
+    for ( ; i < n; ++i ) dst[i] += src[i]*(gain+i*inc);
+}
+
+// sum(a[i]*b[i])
+inline float dot(const float* a, const float* b, quint64 n)
+{
+    quint64 i = 0;
+    float sum = 0.f;
+#ifdef WPN114_SSE
+    __m128 acc = _mm_setzero_ps();
+    for ( ; i+4 <= n; i += 4 )
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a+i), _mm_loadu_ps(b+i)));
+
+    float lanes[4];
+    _mm_storeu_ps(lanes, acc);
+    sum = (lanes[0]+lanes[1])+(lanes[2]+lanes[3]);
+#endif
+    for ( ; i < n; ++i ) sum += a[i]*b[i];
+    return sum;
+}
+
+// max(|src[i]|)
+inline float peak(const float* src, quint64 n)
+{
+    quint64 i = 0;
+    float pk = 0.f;
+#ifdef WPN114_SSE
+    __m128 sign = _mm_set1_ps(-0.f);
+    __m128 vpk  = _mm_setzero_ps();
+
+    for ( ; i+4 <= n; i += 4 )
+        vpk = _mm_max_ps(vpk, _mm_andnot_ps(sign, _mm_loadu_ps(src+i)));
+
+    float lanes[4];
+    _mm_storeu_ps(lanes, vpk);
+    pk = qMax(qMax(lanes[0], lanes[1]), qMax(lanes[2], lanes[3]));
+#endif
+    for ( ; i < n; ++i ) pk = qMax(pk, std::fabs(src[i]));
+    return pk;
+}
+
+// dst[i] = max(dst[i], |src[i]|)
+inline void max_abs(float* dst, const float* src, quint64 n)
+{
+    quint64 i = 0;
+#ifdef WPN114_SSE
+    __m128 sign = _mm_set1_ps(-0.f);
+    for ( ; i+4 <= n; i += 4 )
+        _mm_storeu_ps(dst+i, _mm_max_ps(_mm_loadu_ps(dst+i),
+                             _mm_andnot_ps(sign, _mm_loadu_ps(src+i))));
+#endif
+    for ( ; i < n; ++i ) dst[i] = qMax(dst[i], std::fabs(src[i]));
+}
+
+// dst[i] = src[i]*gains[i]
+inline void mul(float* dst, const float* src, const float* gains, quint64 n)
+{
+    quint64 i = 0;
+#ifdef WPN114_SSE
+    for ( ; i+4 <= n; i += 4 )
+        _mm_storeu_ps(dst+i, _mm_mul_ps(_mm_loadu_ps(src+i), _mm_loadu_ps(gains+i)));
+#endif
+    for ( ; i < n; ++i ) dst[i] = src[i]*gains[i];
+}
+
+//-------------------------------------------------------------------------------------------------
+// sample format conversions, used by compact sample storage
+// ints are scaled to/from [-1, 1] (full scale is 2^(bits-1)-1, as in Soundfile)
+// and clipped when encoded
+
+// int16 -> float
+inline void from_int16(float* dst, const qint16* src, quint64 n)
+{
+    const float scale = 1.f/32767.f;
+    quint64 i = 0;
+#ifdef WPN114_SSE2
+    __m128 s = _mm_set1_ps(scale);
+    for ( ; i+8 <= n; i += 8 )
+    {
+        __m128i v  = _mm_loadu_si128((const __m128i*)(src+i));
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(dst+i,   _mm_mul_ps(_mm_cvtepi32_ps(lo), s));
+        _mm_storeu_ps(dst+i+4, _mm_mul_ps(_mm_cvtepi32_ps(hi), s));
+    }
+#endif
+    for ( ; i < n; ++i ) dst[i] = src[i]*scale;
+}
+
+// float -> int16
+inline void to_int16(qint16* dst, const float* src, quint64 n)
+{
+    quint64 i = 0;
+#ifdef WPN114_SSE2
+    __m128 s = _mm_set1_ps(32767.f);
+    for ( ; i+8 <= n; i += 8 )
+    {
+        __m128i lo = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src+i), s));
+        __m128i hi = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src+i+4), s));
+        _mm_storeu_si128((__m128i*)(dst+i), _mm_packs_epi32(lo, hi));
+    }
+#endif
+    for ( ; i < n; ++i )
+        dst[i] = std::lround(qBound(-1.f, src[i], 1.f)*32767.f);
+}
+
+// packed little-endian int24 -> float
+// sse2 has no byte shuffle: each sample is brought to the lowest lane
+// by shifting the register by 3 bytes, lanes are then gathered together
+inline void from_int24(float* dst, const quint8* src, quint64 n)
+{
+    const float scale = 1.f/8388607.f;
+    quint64 i = 0;
+#ifdef WPN114_SSE2
+    __m128 s = _mm_set1_ps(scale);
+    // 16 bytes are loaded for 4 samples (12 bytes)
+    for ( ; i+6 <= n; i += 4, src += 12 )
+    {
+        __m128i v  = _mm_loadu_si128((const __m128i*) src);
+        __m128i a  = _mm_unpacklo_epi32(v, _mm_srli_si128(v, 3));
+        __m128i b  = _mm_unpacklo_epi32(_mm_srli_si128(v, 6), _mm_srli_si128(v, 9));
+        __m128i x  = _mm_srai_epi32(_mm_slli_epi32(_mm_unpacklo_epi64(a, b), 8), 8);
+        _mm_storeu_ps(dst+i, _mm_mul_ps(_mm_cvtepi32_ps(x), s));
+    }
+#endif
+    for ( ; i < n; ++i, src += 3 )
+    {
+        qint32 v = (qint32) ((quint32) src[0] << 8 | (quint32) src[1] << 16 | (quint32) src[2] << 24);
+        dst[i] = (v >> 8)*scale;
+    }
+}
+
+// float -> packed little-endian int24
+// lanes are masked to 24 bits, packed by pairs into 6 bytes
+// of each 64-bit half, then both halves are joined into 12 bytes
+inline void to_int24(quint8* dst, const float* src, quint64 n)
+{
+    quint64 i = 0;
+#ifdef WPN114_SSE2
+    __m128 s        = _mm_set1_ps(8388607.f);
+    __m128 lo       = _mm_set1_ps(-1.f);
+    __m128 hi       = _mm_set1_ps(1.f);
+    __m128i m24     = _mm_set1_epi32(0x00ffffff);
+    __m128i m32     = _mm_set_epi32(0, -1, 0, -1);
+    __m128i m64     = _mm_set_epi32(0, 0, -1, -1);
+
+    for ( ; i+4 <= n; i += 4, dst += 12 )
+    {
+        __m128 f    = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src+i), lo), hi);
+        __m128i x   = _mm_and_si128(_mm_cvtps_epi32(_mm_mul_ps(f, s)), m24);
+        __m128i y   = _mm_or_si128(_mm_and_si128(x, m32),
+                                   _mm_srli_epi64(_mm_andnot_si128(m32, x), 8));
+        __m128i z   = _mm_or_si128(_mm_and_si128(y, m64),
+                                   _mm_srli_si128(_mm_andnot_si128(m64, y), 2));
+
+        qint32 tail = _mm_cvtsi128_si32(_mm_srli_si128(z, 8));
+        _mm_storel_epi64((__m128i*) dst, z);
+        memcpy(dst+8, &tail, 4);
+    }
+#endif
+    for ( ; i < n; ++i, dst += 3 )
+    {
+        qint32 v = std::lround(qBound(-1.f, src[i], 1.f)*8388607.f);
+        dst[0] = v;
+        dst[1] = v >> 8;
+        dst[2] = v >> 16;
+    }
+}
+
+// ieee binary16 -> float,
+// exponent is rebiased with a multiply, which also handles denormals
+inline void from_half(float* dst, const quint16* src, quint64 n)
+{
+    const float magic = 5.192296858534828e+33f; // 2^112
+    quint64 i = 0;
+#ifdef WPN114_SSE2
+    __m128i zero  = _mm_setzero_si128();
+    __m128i smask = _mm_set1_epi32(0x8000);
+    __m128i emask = _mm_set1_epi32(0x7fff);
+    __m128 m      = _mm_set1_ps(magic);
+
+    for ( ; i+4 <= n; i += 4 )
+    {
+        __m128i h  = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)(src+i)), zero);
+        __m128i sg = _mm_slli_epi32(_mm_and_si128(h, smask), 16);
+        __m128i em = _mm_slli_epi32(_mm_and_si128(h, emask), 13);
+        __m128 f   = _mm_mul_ps(_mm_castsi128_ps(em), m);
+        _mm_storeu_ps(dst+i, _mm_or_ps(f, _mm_castsi128_ps(sg)));
+    }
+#endif
+    for ( ; i < n; ++i )
+    {
+        quint32 sg = (quint32)(src[i] & 0x8000) << 16;
+        quint32 em = (quint32)(src[i] & 0x7fff) << 13;
+        float f;
+        memcpy(&f, &em, 4);
+        f *= magic;
+        memcpy(&em, &f, 4);
+        em |= sg;
+        memcpy(&dst[i], &em, 4);
+    }
+}
+
+// float -> ieee binary16, rounded to nearest even
+inline void to_half(quint16* dst, const float* src, quint64 n)
+{
+    for ( quint64 i = 0; i < n; ++i )
+    {
+        quint32 x;
+        memcpy(&x, &src[i], 4);
+
+        quint32 sign = (x >> 16) & 0x8000;
+        quint32 ax   = x & 0x7fffffff;
+
+        if ( ax >= 0x477ff000 )
+        {
+            // overflow -> inf, nan stays nan
+            dst[i] = sign | (ax > 0x7f800000 ? 0x7e00 : 0x7c00);
+        }
+        else if ( ax < 0x38800000 )
+        {
+            // denormal half, let the fpu do the rounding
+            float f;
+            memcpy(&f, &ax, 4);
+            f += 0.5f;
+            memcpy(&ax, &f, 4);
+            dst[i] = sign | (ax-0x3f000000);
+        }
+        else
+        {
+            ax += 0xc8000fff+((ax >> 13) & 1);
+            dst[i] = sign | (ax >> 13);
+        }
+    }
+}
+
+}
+
+#endif // SIMD_HPP
@@ -1,59 +1,98 @@
 #include "soundfile.hpp"
+#include <source/audio/simd.hpp>
 #include <QtDebug>
 #include <qendian.h>
+#include <QVector>
+#include <cstring>
+
+#ifdef WPN114_SNDFILE
+#include <sndfile.h>
+#endif
 
 SoundfileStreamer::SoundfileStreamer(Soundfile* file) : m_soundfile(file)
 {
     m_file = new QFile(m_soundfile->path());
     m_file->open(QIODevice::ReadOnly);
+
+#ifdef WPN114_SNDFILE
+    // decoding happens on the streamer's thread, with its own handle
+    if ( m_soundfile->compressed() )
+    {
+        SF_INFO info;
+        memset( &info, 0, sizeof(SF_INFO) );
+        m_sndfile = sf_open( m_soundfile->path().toLocal8Bit().constData(), SFM_READ, &info );
+    }
+#endif
 }
 
 SoundfileStreamer::~SoundfileStreamer()
 {
+#ifdef WPN114_SNDFILE
+    if ( m_sndfile ) sf_close( m_sndfile );
+#endif
     delete m_file;
     delete m_soundfile;
 }
 
 void SoundfileStreamer::setStartSample(quint64 index)
 {
-    quint64 bytes_per_sample = m_soundfile->m_bits_per_sample/8;
-
-    m_start_byte = index*m_soundfile->m_nchannels*bytes_per_sample+m_soundfile->m_metadata_size;
+    m_start_byte = index*m_soundfile->m_block_align+m_soundfile->m_metadata_size;
     m_position_byte = m_start_byte;
 }
 
 void SoundfileStreamer::setEndSample(quint64 index)
 {
-    quint64 bytes_per_sample = m_soundfile->m_bits_per_sample/8;
-    m_end_byte = index*m_soundfile->m_nchannels*bytes_per_sample+m_soundfile->m_metadata_size;
+    m_end_byte = index*m_soundfile->m_block_align+m_soundfile->m_metadata_size;
 }
 
 void SoundfileStreamer::setBufferSize(quint64 nsamples)
 {
-    m_bufsize_byte = nsamples*m_soundfile->m_nchannels*(m_soundfile->m_bits_per_sample/8);
+    m_bufsize_byte = nsamples*m_soundfile->m_block_align;
+    m_raw.resize( m_bufsize_byte );
 }
 
 void SoundfileStreamer::reset(float* target)
 {
-    m_file->reset();
     m_position_byte = m_start_byte;
     next(target);
 }
 
+void SoundfileStreamer::read(quint64 offset, quint64 nbytes, float* target)
+{
+#ifdef WPN114_SNDFILE
+    if ( m_sndfile )
+    {
+        quint64 align = m_soundfile->m_block_align;
+        m_soundfile->readSndfile( m_sndfile, target, offset/align, nbytes/align );
+        return;
+    }
+#endif
+
+    // never read past the data chunk,
+    // what lies beyond is filled with zeroes
+    quint64 byps    = m_soundfile->m_block_align/m_soundfile->m_nchannels;
+    quint64 end     = m_soundfile->m_metadata_size+m_soundfile->m_nbytes;
+    quint64 avail   = offset < end ? qMin( nbytes, end-offset ) : 0;
+    qint64 nread    = 0;
+
+    if ( (quint64) m_raw.size() < avail )
+         m_raw.resize( avail );
+
+    if ( avail && m_file->seek(offset) )
+         nread = qMax<qint64>( 0, m_file->read(m_raw.data(), avail) );
+
+    quint64 n = nread/byps;
+    m_soundfile->decode( m_raw.constData(), target, n );
+    memset( target+n, 0, (nbytes/byps-n)*sizeof(float) );
+}
+
 void SoundfileStreamer::next(float* target)
 {
-    quint16 bps         = m_soundfile->m_bits_per_sample;
-    quint16 byps        = bps/8;
+    quint64 byps        = m_soundfile->m_block_align/m_soundfile->m_nchannels;
     quint64 nbytes      = m_bufsize_byte;
     quint64 position    = m_position_byte;
     quint64 endframe    = position+nbytes;
     quint64 endbyte     = m_end_byte;
-    quint32 div         = ((2<<(bps-1))-1)/2;
-
-    QDataStream stream(m_file);
-
-    stream.setByteOrder(QDataStream::LittleEndian);
-    stream.skipRawData(position);
 
     if ( m_wrap && endframe > endbyte )
     {
@@ -62,41 +101,17 @@ void SoundfileStreamer::next(float* target)
         quint64 chunk1  = endbyte-position;
         quint64 chunk2  = nbytes-chunk1;
 
-        quint64 ch1_nframes = chunk1/byps;
-        quint64 ch2_nframes = chunk2/byps;
-
-        for ( quint64 i = 0; i < ch1_nframes; ++i )
-        {
-            qint16 si16; stream >> si16;
-            target[i] = si16/(float)div;
-        }
-
-        m_file->reset();
-        stream.skipRawData(m_start_byte);
-
-        for ( quint64 i = 0; i < ch2_nframes; ++i )
-        {
-            qint16 si16; stream >> si16;
-            target[ch1_nframes+i] = si16/(float)div;
-        }
+        read( position, chunk1, target );
+        read( m_start_byte, chunk2, target+chunk1/byps );
 
         m_position_byte = m_start_byte+chunk2;
     }
     else
     {
-        // if endframe goes beyond end of file,
-        // qdatastream will fill the rest with zeroes,
-        // which is what we want
-        for ( quint64 i = 0; i < (nbytes/byps); ++i )
-        {
-            qint16 si16; stream >> si16;
-            target[i] = si16/(float)div;
-        }
-
+        read( position, nbytes, target );
         m_position_byte += nbytes;
     }
 
-    m_file->reset();
     emit bufferLoaded();
 }
 
@@ -109,10 +124,13 @@ Soundfile::Soundfile() : m_file(nullptr)
 
 Soundfile::~Soundfile()
 {
+#ifdef WPN114_SNDFILE
+    if ( m_sndfile ) sf_close( m_sndfile );
+#endif
     delete m_file;
 }
 
-Soundfile::Soundfile(QString path) : m_file(new QFile(path))
+Soundfile::Soundfile(QString path) : m_file(nullptr)
 {
     setPath(path);
 }
@@ -120,6 +138,10 @@ Soundfile::Soundfile(QString path) : m_file(new QFile(path))
 void Soundfile::setPath(QString path)
 {
     m_path = path;
+
+    delete m_file;
+    m_file = new QFile(path);
+
     if ( !m_file->open(QIODevice::ReadOnly) )
     {
         qDebug() << m_file->errorString();
@@ -127,106 +149,319 @@ void Soundfile::setPath(QString path)
     }
 
     qDebug() << "[SOUNDFILE]" << m_path << "successfully opened";
-    if ( m_path.endsWith(".wav") ) metadataWav();
+    metadataWav();
+
+#ifdef WPN114_SNDFILE
+    if ( m_container == SoundfileContainer::Unknown )
+         metadataSndfile();
+#endif
+
+    if ( m_container == SoundfileContainer::Unknown )
+         qDebug() << "[SOUNDFILE]" << m_path << "unsupported file format";
+}
+
+// little-endian readers over a header buffer
+inline quint16 le16(const char* p) { return qFromLittleEndian<quint16>((const uchar*) p); }
+inline quint32 le32(const char* p) { return qFromLittleEndian<quint32>((const uchar*) p); }
+inline quint64 le64(const char* p) { return qFromLittleEndian<quint64>((const uchar*) p); }
+
+// wave64 GUIDs: the four first bytes are the riff-style id,
+// all but 'riff' share the same trailing 12 bytes
+static const char w64_riff[16] = { 'r','i','f','f', '\x2E','\x91','\xCF','\x11',
+                                   '\xA5','\xD6','\x28','\xDB','\x04','\xC1','\x00','\x00' };
+static const char w64_tail[12] = { '\xF3','\xAC','\xD3','\x11','\x8C','\xD1',
+                                   '\x00','\xC0','\x4F','\x8E','\xDB','\x8A' };
+
+// the 'riff' GUID is followed by the file size and the 'wave' GUID
+inline bool w64_is_wave(QFile* file)
+{
+    char header[24];
+    if ( file->read(header, 24) != 24 ) return false;
+
+    return !memcmp(header+8, "wave", 4) && !memcmp(header+12, w64_tail, 12);
 }
 
+#define WAVE_FORMAT_PCM         0x0001
+#define WAVE_FORMAT_IEEE_FLOAT  0x0003
+#define WAVE_FORMAT_EXTENSIBLE  0xFFFE
+
 void Soundfile::metadataWav()
 {
-    WavMetadata data;
-    QDataStream stream(m_file);
+    m_file_size = m_file->size();
 
-    stream.setByteOrder(QDataStream::BigEndian);
-    stream >> data.chunk_id;
+    char header[16];
+    if ( m_file->read(header, 16) != 16 )
+    {
+        qDebug() << "[SOUNDFILE]" << m_path << "file too short";
+        return;
+    }
 
-    stream.setByteOrder(QDataStream::LittleEndian);
-    stream >> data.chunk_size;
+    quint64 position;
+    quint16 hdsz, align;
 
-    stream.setByteOrder(QDataStream::BigEndian);
-    stream >> data.format;    
-    stream >> data.subchunk1_id;
+    if ( !memcmp(header, "RIFF", 4) && !memcmp(header+8, "WAVE", 4) )
+    {
+        m_container = SoundfileContainer::Riff;
+        position = 12; hdsz = 8; align = 2;
+    }
+    else if ( !memcmp(header, "RF64", 4) && !memcmp(header+8, "WAVE", 4) )
+    {
+        m_container = SoundfileContainer::RF64;
+        position = 12; hdsz = 8; align = 2;
+    }
+    else if ( !memcmp(header, w64_riff, 16) && w64_is_wave(m_file) )
+    {
+        m_container = SoundfileContainer::Wave64;
+        position = 40; hdsz = 24; align = 8;
+    }
+    else
+    {
+        m_file->reset();
+        return;
+    }
 
-    stream.setByteOrder(QDataStream::LittleEndian);
-    stream >> data.subchunk1_size;
-    stream >> data.audio_format;
-    stream >> data.nchannels;
-    stream >> data.sample_rate;
-    stream >> data.byte_rate;
-    stream >> data.block_align;
-    stream >> data.bits_per_sample;
+    // walk the chunks, only their headers are read
+    // the rest is skipped by seeking
+    quint64 ds64_data = 0;
+    bool has_fmt = false, has_data = false, supported = true;
+    char chunk[64];
 
-    // there might be an extension chunk, if so, ignore it for the moment
-    stream.setByteOrder(QDataStream::BigEndian);
+    while ( position+hdsz <= m_file_size && !(has_fmt && has_data) )
+    {
+        m_file->seek(position);
+        if ( m_file->read(chunk, hdsz) != hdsz ) break;
 
-    QByteArray chunk2(4, Qt::Uninitialized);
-    stream.readRawData(chunk2.data(), 4);
+        QByteArray id;
+        quint64 size, body = position+hdsz;
 
-    stream.setByteOrder(QDataStream::LittleEndian);
-    qint32 chunk2_sz; stream >> chunk2_sz;
+        if ( m_container == SoundfileContainer::Wave64 )
+        {
+            // sizes include the 24 bytes of the chunk header
+            size = le64(chunk+16);
+            size = size >= hdsz ? size-hdsz : 0;
+            id   = memcmp(chunk+4, w64_tail, 12) ? QByteArray() : QByteArray(chunk, 4);
+        }
+        else
+        {
+            size = le32(chunk+4);
+            id   = QByteArray(chunk, 4);
+        }
 
-    if ( chunk2 != "data" )
+        if ( id == "ds64" )
+        {
+            // riff size, data size, sample count, table...
+            if ( m_file->read(chunk, 24) == 24 )
+                 ds64_data = le64(chunk+8);
+        }
+        else if ( id == "fmt " )
+        {
+            quint64 n = m_file->read(chunk, qMin<quint64>(size, 40));
+            if ( n < 16 ) break;
+
+            quint16 format      = le16(chunk);
+            m_nchannels         = le16(chunk+2);
+            m_sample_rate       = le32(chunk+4);
+            m_block_align       = le16(chunk+12);
+            m_bits_per_sample   = le16(chunk+14);
+
+            // extensible: actual format is held by the first bytes of the subformat GUID
+            if ( format == WAVE_FORMAT_EXTENSIBLE && n >= 26 )
+                 format = le16(chunk+24);
+
+            m_float = format == WAVE_FORMAT_IEEE_FLOAT;
+
+            supported = format == WAVE_FORMAT_PCM || format == WAVE_FORMAT_IEEE_FLOAT;
+
+            has_fmt = true;
+        }
+        else if ( id == "data" )
+        {
+            if ( m_container == SoundfileContainer::RF64 && size == 0xffffffff )
+                 size = ds64_data;
+
+            m_metadata_size = body;
+            m_nbytes        = size;
+            has_data        = true;
+        }
+
+        // chunks are padded to 'align' bytes
+        position = body+size;
+        position = (position+align-1)/align*align;
+    }
+
+    if ( !has_fmt || !has_data || !m_nchannels || !m_block_align )
     {
-        m_metadata_size = WAVE_METADATA_SIZE+chunk2_sz+8;
-        stream.skipRawData(chunk2_sz);
+        qDebug() << "[SOUNDFILE]" << m_path << "missing 'fmt ' or 'data' chunk";
+        m_nbytes = 0;
     }
-    else m_metadata_size = WAVE_METADATA_SIZE;
 
-    stream.setByteOrder(QDataStream::BigEndian);
-    stream >> data.subchunk2_id;
+    // a file still being written (or truncated) may declare
+    // an empty or oversized data chunk: use what's actually there
+    if ( m_metadata_size+m_nbytes > m_file_size || (has_data && m_nbytes == 0) )
+         m_nbytes = m_file_size > m_metadata_size ? m_file_size-m_metadata_size : 0;
 
-    stream.setByteOrder(QDataStream::LittleEndian);
-    stream >> data.subchunk2_size;
+    if ( m_block_align )
+         m_nbytes -= m_nbytes % m_block_align;
 
-    m_file_size         = m_file->size();
-    m_nchannels         = data.nchannels;
-    m_sample_rate       = data.sample_rate;
-    m_bits_per_sample   = data.bits_per_sample;
-    m_nbytes            = data.subchunk2_size;
-    m_nframes           = m_nbytes/(m_bits_per_sample/8);
-    m_nsamples          = m_nframes/m_nchannels;    
+    m_nsamples  = m_block_align ? m_nbytes/m_block_align : 0;
+    m_nframes   = m_nsamples*m_nchannels;
+
+    // e.g. adpcm or a-law: left to libsndfile, if available
+    if ( !supported ) m_container = SoundfileContainer::Unknown;
 
     m_file->reset();
 }
 
-void Soundfile::buffer(float* buffer, quint64 start_sample, quint64 len )
+#ifdef WPN114_SNDFILE
+
+void Soundfile::metadataSndfile()
 {
-    quint64 start = start_sample*m_nchannels*(m_bits_per_sample/8)+m_metadata_size;
-    quint64 length_in_frames = len*m_nchannels;
+    SF_INFO info;
+    memset( &info, 0, sizeof(SF_INFO) );
+
+    m_sndfile = sf_open( m_path.toLocal8Bit().constData(), SFM_READ, &info );
+    if ( !m_sndfile ) return;
 
-    QDataStream stream  ( m_file );
-    stream.setByteOrder ( QDataStream::LittleEndian );
-    stream.skipRawData  ( start );
+    m_container         = SoundfileContainer::Sndfile;
+    m_nchannels         = info.channels;
+    m_sample_rate       = info.samplerate;
+    m_nsamples          = info.frames;
+    m_nframes           = m_nsamples*m_nchannels;
 
-    for ( quint32 f = 0; f < length_in_frames; ++f )
+    // decoded frames are floats
+    m_float             = true;
+    m_block_align       = m_nchannels*sizeof(float);
+    m_metadata_size     = 0;
+    m_nbytes            = m_nsamples*m_block_align;
+
+    switch ( info.format & SF_FORMAT_SUBMASK )
     {
-        // convert to float
-        qint16 si16; stream >> si16;
-        buffer[f] = si16/32767.f;
+    case SF_FORMAT_PCM_S8:
+    case SF_FORMAT_PCM_U8:  m_bits_per_sample = 8; break;
+    case SF_FORMAT_PCM_16:  m_bits_per_sample = 16; break;
+    case SF_FORMAT_PCM_24:  m_bits_per_sample = 24; break;
+    case SF_FORMAT_DOUBLE:  m_bits_per_sample = 64; break;
+    default:                m_bits_per_sample = 32;
     }
+}
 
-    m_file->reset();
+void Soundfile::readSndfile(SNDFILE_tag* sf, float* dst, quint64 start_sample, quint64 len) const
+{
+    sf_count_t got = 0;
+
+    if ( sf_seek(sf, start_sample, SEEK_SET) >= 0 )
+         got = qMax<sf_count_t>( 0, sf_readf_float(sf, dst, len) );
+
+    memset( dst+got*m_nchannels, 0, (len-got)*m_nchannels*sizeof(float) );
 }
 
-void Soundfile::buffer(float** buffer, quint64 start_sample, quint64 len )
+#endif
+
+void Soundfile::decode(const char* raw, float* dst, quint64 nsamples) const
 {
-    auto nch = m_nchannels;
-    quint64 start = start_sample*nch*(m_bits_per_sample/8)+m_metadata_size;
+    // container width, e.g. 20-bit samples are stored on 3 bytes
+    quint16 width = m_block_align/m_nchannels;
 
-    QDataStream stream  ( m_file );
-    stream.setByteOrder ( QDataStream::LittleEndian );
-    stream.skipRawData  ( start );
+    if ( m_float )
+    {
+        if ( width == 4 )
+             memcpy( dst, raw, nsamples*sizeof(float) );
 
-    // de-interleave file
+        else if ( width == 8 )
+        {
+            for ( quint64 i = 0; i < nsamples; ++i )
+            {
+                double d; memcpy(&d, raw+i*8, 8);
+                dst[i] = d;
+            }
+        }
+        else memset( dst, 0, nsamples*sizeof(float) );
+        return;
+    }
 
-    for ( quint32 s = 0; s < len; ++s )
+    switch ( width )
     {
-        for ( quint16 ch = 0; ch < nch; ++ch )
+    case 1:
+        // 8-bit wave is unsigned
+        for ( quint64 i = 0; i < nsamples; ++i )
+              dst[i] = ((quint8) raw[i]-128)/127.f;
+        break;
+
+    case 2: simd::from_int16( dst, (const qint16*) raw, nsamples ); break;
+    case 3: simd::from_int24( dst, (const quint8*) raw, nsamples ); break;
+
+    case 4:
+        for ( quint64 i = 0; i < nsamples; ++i )
+              dst[i] = (qint32) le32(raw+i*4)/2147483647.f;
+        break;
+
+    default: memset( dst, 0, nsamples*sizeof(float) );
+    }
+}
+
+void Soundfile::read(QFile* file, float* dst, quint64 start_sample, quint64 len) const
+{
+#ifdef WPN114_SNDFILE
+    if ( m_sndfile )
+    {
+        readSndfile( m_sndfile, dst, start_sample, len );
+        return;
+    }
+#endif
+
+    if ( !m_block_align ) return;
+
+    // read and convert by blocks of whole frames,
+    // zero-filling whatever lies past the end of the data
+    quint64 nch     = m_nchannels;
+    quint64 avail   = start_sample < m_nsamples ? qMin( len, m_nsamples-start_sample ) : 0;
+    quint64 block   = qMax<quint64>( 1, SOUNDFILE_READ_BLOCK/m_block_align );
+    QByteArray raw  ( qMin(block, qMax<quint64>(avail, 1))*m_block_align, Qt::Uninitialized );
+
+    file->seek( m_metadata_size+start_sample*m_block_align );
+
+    for ( quint64 f = 0; f < avail; )
+    {
+        quint64 n   = qMin( block, avail-f );
+        qint64 rd   = file->read( raw.data(), n*m_block_align );
+        quint64 got = rd > 0 ? rd/m_block_align : 0;
+
+        decode( raw.constData(), dst+f*nch, got*nch );
+        f += got;
+
+        if ( got < n )
         {
-            qint16 si16; stream >> si16;
-            buffer[ch][s] = si16/32767.f;
+            avail = f;
+            break;
         }
     }
 
+    memset( dst+avail*nch, 0, (len-avail)*nch*sizeof(float) );
+}
+
+void Soundfile::buffer(float* buffer, quint64 start_sample, quint64 len )
+{
+    read( m_file, buffer, start_sample, len );
     m_file->reset();
 }
 
+void Soundfile::buffer(float** buffer, quint64 start_sample, quint64 len )
+{
+    auto nch = m_nchannels;
+    quint64 block = qMax<quint64>( 1, SOUNDFILE_READ_BLOCK/qMax<quint16>(1, m_block_align) );
+    QVector<float> frames ( qMin(block, qMax<quint64>(len, 1))*nch );
 
+    // de-interleave file
+
+    for ( quint64 s = 0; s < len; s += block )
+    {
+        quint64 n = qMin( block, len-s );
+        read( m_file, frames.data(), start_sample+s, n );
+
+        for ( quint64 f = 0; f < n; ++f )
+            for ( quint16 ch = 0; ch < nch; ++ch )
+                 buffer[ch][s+f] = frames[f*nch+ch];
+    }
+
+    m_file->reset();
+}
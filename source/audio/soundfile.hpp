@@ -6,25 +6,20 @@
 #include <QDataStream>
 #include <QThread>
 
-#define WAVE_METADATA_SIZE 44
+#define SOUNDFILE_READ_BLOCK 1048576
+// in bytes, files are read and converted by blocks
 
-struct WavMetadata
+#ifdef WPN114_SNDFILE
+struct SNDFILE_tag;
+#endif
+
+enum class SoundfileContainer
 {
-    qint32 chunk_id;
-    qint32 chunk_size;
-    qint32 format;
-
-    qint32 subchunk1_id;
-    qint32 subchunk1_size;
-    qint16 audio_format;
-    qint16 nchannels;
-    qint32 sample_rate;
-    qint32 byte_rate;
-    qint16 block_align;
-    qint16 bits_per_sample;
-
-    qint32 subchunk2_id;
-    qint32 subchunk2_size;
+    Unknown = 0,
+    Riff    = 1,
+    RF64    = 2,    // EBU Tech 3306, 64-bit sizes in a 'ds64' chunk
+    Wave64  = 3,    // Sony Wave64, GUID chunk ids and 64-bit sizes
+    Sndfile = 4     // anything else libsndfile decodes (flac, ogg, aiff...)
 };
 
 class Soundfile;
@@ -50,14 +45,19 @@ class SoundfileStreamer : public QObject
     void bufferLoaded();
 
     private:
+    void read ( quint64 offset, quint64 nbytes, float* target );
+
     QFile* m_file;
     Soundfile* m_soundfile;
+    QByteArray m_raw;
+#ifdef WPN114_SNDFILE
+    SNDFILE_tag* m_sndfile = nullptr;
+#endif
     bool m_wrap;
     quint64 m_start_byte;
     quint64 m_end_byte;
     quint64 m_bufsize_byte;
     quint64 m_position_byte;
-
 };
 
 class Soundfile : public QObject
@@ -68,8 +68,8 @@ class Soundfile : public QObject
 
     Q_PROPERTY  ( QString path READ path WRITE setPath )
     Q_PROPERTY  ( int nchannels READ nchannels )
-    Q_PROPERTY  ( int nframes READ nframes )
-    Q_PROPERTY  ( int nsamples READ nsamples )
+    Q_PROPERTY  ( double nframes READ nframes )
+    Q_PROPERTY  ( double nsamples READ nsamples )
     Q_PROPERTY  ( int sampleRate READ sampleRate )
 
     public:
@@ -79,27 +79,50 @@ class Soundfile : public QObject
     ~Soundfile  ( );
 
     QString path        ( ) const { return m_path; }
-    quint8 nchannels    ( ) const { return m_nchannels; }
+    quint16 nchannels   ( ) const { return m_nchannels; }
     quint64 nframes     ( ) const { return m_nframes; }
     quint64 nsamples    ( ) const { return m_nsamples; }
     quint64 sampleRate  ( ) const { return m_sample_rate; }
+    quint16 bitsPerSample ( ) const { return m_bits_per_sample; }
+    bool isFloat        ( ) const { return m_float; }
+    SoundfileContainer container ( ) const { return m_container; }
+    bool compressed     ( ) const { return m_container == SoundfileContainer::Sndfile; }
+
+    // walks the file's chunks, reading headers only
     void metadataWav    ( );
 
     void setPath    ( QString path );
     void buffer     ( float* buffer, quint64 start_sample, quint64 len );
     void buffer     ( float** buffer, quint64 start_sample, quint64 len );
 
+    // converts nsamples raw samples (in the file's encoding) to floats
+    void decode     ( const char* raw, float* dst, quint64 nsamples ) const;
+
     protected:
+    void read       ( QFile* file, float* dst, quint64 start_sample, quint64 len ) const;
+
+#ifdef WPN114_SNDFILE
+    // compressed files are decoded by libsndfile, they are seen as
+    // a 'data' chunk of float frames starting at offset 0
+    void metadataSndfile ( );
+    void readSndfile     ( SNDFILE_tag* sf, float* dst, quint64 start_sample, quint64 len ) const;
+    SNDFILE_tag* m_sndfile = nullptr;
+#endif
+
     QFile* m_file;
-    quint64 m_file_size;
+    quint64 m_file_size         = 0;
     QString m_path;
-    quint16 m_nchannels;
-    quint32 m_sample_rate;
-    quint64 m_nframes;
-    quint64 m_nsamples;
-    quint32 m_nbytes;
-    quint16 m_bits_per_sample;
-    quint32 m_metadata_size;
+    SoundfileContainer m_container = SoundfileContainer::Unknown;
+    quint16 m_nchannels         = 0;
+    quint32 m_sample_rate       = 0;
+    quint64 m_nframes           = 0;
+    quint64 m_nsamples          = 0;
+    quint64 m_nbytes            = 0;
+    quint16 m_bits_per_sample   = 16;
+    quint16 m_block_align       = 0;
+    bool m_float                = false;
+    quint64 m_metadata_size     = 0;
+    // offset of the first sample in the file
 };
 
 #endif // SOUNDFILE_HPP
@@ -0,0 +1,69 @@
+#include "tables.hpp"
+#include <QMutex>
+#include <QMutexLocker>
+#include <cmath>
+
+static QMutex g_mutex;
+static float* g_attack  [ CURVE_COUNT ] = { };
+static float* g_release [ CURVE_COUNT ] = { };
+static float* g_sine = nullptr;
+
+inline double curve_value(Curve::Values curve, double x)
+{
+    switch ( curve )
+    {
+    case Curve::Sine:           return std::sin( x*M_PI_2 );
+    case Curve::Linear:         return x;
+    case Curve::Exponential:    return ( std::exp(5.0*x)-1.0 )/( std::exp(5.0)-1.0 );
+    case Curve::Logarithmic:    return std::log( 1.0+99.0*x )/std::log( 100.0 );
+    case Curve::SCurve:         return 0.5-0.5*std::cos( x*M_PI );
+    }
+
+    return x;
+}
+
+static void build_envelope(Curve::Values curve)
+{
+    auto attack     = new float [ ENV_RESOLUTION+1 ];
+    auto release    = new float [ ENV_RESOLUTION+1 ];
+
+    for ( quint32 i = 0; i <= ENV_RESOLUTION; ++i )
+    {
+        float value = curve_value( curve, (double) i/ENV_RESOLUTION );
+        attack  [ i ] = value;
+        release [ i ] = 1.f-value;
+    }
+
+    g_attack  [ curve ] = attack;
+    g_release [ curve ] = release;
+}
+
+const float* Tables::attack(Curve::Values curve)
+{
+    QMutexLocker lock ( &g_mutex );
+    if ( !g_attack[curve] ) build_envelope(curve);
+
+    return g_attack[curve];
+}
+
+const float* Tables::release(Curve::Values curve)
+{
+    QMutexLocker lock ( &g_mutex );
+    if ( !g_release[curve] ) build_envelope(curve);
+
+    return g_release[curve];
+}
+
+const float* Tables::sine()
+{
+    QMutexLocker lock ( &g_mutex );
+
+    if ( !g_sine )
+    {
+        g_sine = new float [ WT_SIZE+1 ];
+        for ( quint32 i = 0; i <= WT_SIZE; ++i )
+            g_sine[i] = std::sin( (double) i/WT_SIZE*M_PI*2 );
+    }
+
+    return g_sine;
+}
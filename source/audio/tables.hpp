@@ -0,0 +1,41 @@
+#ifndef TABLES_HPP
+#define TABLES_HPP
+
+#include <QObject>
+
+#define ENV_RESOLUTION 32768
+#define WT_SIZE 16384
+
+class Curve : public QObject
+{
+    Q_OBJECT
+    public:
+    enum Values
+    {
+        Sine        = 0,
+        Linear      = 1,
+        Exponential = 2,
+        Logarithmic = 3,
+        SCurve      = 4
+    };
+
+    Q_ENUM ( Values )
+};
+
+#define CURVE_COUNT 5
+
+// process-wide, read-only lookup tables, built on first request
+// and shared by every instance. envelope tables have ENV_RESOLUTION+1 points,
+// wavetables WT_SIZE+1, the extra point being a guard for interpolation
+class Tables
+{
+    public:
+    // rising curve, from 0 to 1
+    static const float* attack  ( Curve::Values curve );
+    // complement of the rising curve, from 1 to 0
+    static const float* release ( Curve::Values curve );
+    // one period of a sine
+    static const float* sine    ( );
+};
+
+#endif // TABLES_HPP
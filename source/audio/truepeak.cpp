@@ -0,0 +1,59 @@
+#include "truepeak.hpp"
+#include <source/audio/simd.hpp>
+#include <math.h>
+
+void TruePeak::allocate(quint16 nchannels, quint32 nsamples)
+{
+    // interpolation at 1/4, 1/2 and 3/4 of the way between
+    // the samples TRUEPEAK_DELAY+1 and TRUEPEAK_DELAY back
+    m_phases.resize( 3*TRUEPEAK_TAPS );
+
+    for ( quint16 p = 0; p < 3; ++p )
+    {
+        float frac  = (p+1)/4.f;
+        float sum   = 0.f;
+        float* h    = m_phases.data()+p*TRUEPEAK_TAPS;
+
+        for ( quint16 k = 0; k < TRUEPEAK_TAPS; ++k )
+        {
+            float u = k-(TRUEPEAK_DELAY+1-frac);
+            float w = 0.5f*(1+cos(M_PI*u/(TRUEPEAK_TAPS/2)));
+
+            h[k] = w*sin(M_PI*u)/(M_PI*u);
+            sum += h[k];
+        }
+
+        for ( quint16 k = 0; k < TRUEPEAK_TAPS; ++k )
+            h[k] /= sum;
+    }
+
+    m_lines.fill    ( QVector<float>(TRUEPEAK_TAPS-1+nsamples, 0.f), nchannels );
+    m_interp.fill   ( 0.f, nsamples );
+}
+
+void TruePeak::process(float** in, quint16 nchannels, float* peaks, quint32 nsamples)
+{
+    auto interp = m_interp.data();
+
+    for ( quint16 ch = 0; ch < nchannels; ++ch )
+    {
+        float* line = m_lines[ch].data();
+        float* head = line+TRUEPEAK_TAPS-1;
+
+        memcpy( head, in[ch], nsamples*sizeof(float) );
+        simd::max_abs( peaks, head-TRUEPEAK_DELAY, nsamples );
+
+        for ( quint16 p = 0; p < 3; ++p )
+        {
+            const float* h = m_phases.constData()+p*TRUEPEAK_TAPS;
+            memset( interp, 0, nsamples*sizeof(float) );
+
+            for ( quint16 k = 0; k < TRUEPEAK_TAPS; ++k )
+                simd::madd( interp, head-k, h[k], nsamples );
+
+            simd::max_abs( peaks, interp, nsamples );
+        }
+
+        memmove( line, line+nsamples, (TRUEPEAK_TAPS-1)*sizeof(float) );
+    }
+}
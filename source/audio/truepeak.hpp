@@ -0,0 +1,32 @@
+#ifndef TRUEPEAK_HPP
+#define TRUEPEAK_HPP
+
+#include <QVector>
+
+#define TRUEPEAK_TAPS 12
+// per phase, of the 4x windowed-sinc interpolator
+
+#define TRUEPEAK_DELAY 5
+// in samples, detection runs this far behind the input
+
+// 4x oversampled peak detection: each sample is checked along with
+// the three points interpolated between it and the previous one
+
+class TruePeak
+{
+    public:
+    void allocate ( quint16 nchannels, quint32 nsamples );
+
+    // peaks[s] = max(peaks[s], true peak of any channel at s-TRUEPEAK_DELAY)
+    void process ( float** in, quint16 nchannels, float* peaks, quint32 nsamples );
+
+    private:
+    // [phase*TRUEPEAK_TAPS+tap]
+    QVector<float> m_phases;
+
+    // per channel, history followed by the current block
+    QVector<QVector<float>> m_lines;
+    QVector<float> m_interp;
+};
+
+#endif // TRUEPEAK_HPP
@@ -0,0 +1,73 @@
+#include "workerpool.hpp"
+
+void WorkerPool::resize(quint16 nworkers)
+{
+    nworkers = qMax<quint16>( nworkers, 1 );
+    if ( nworkers == size() ) return;
+
+    if ( !m_threads.isEmpty() )
+    {
+        m_quit.store( true );
+        m_start.release( m_threads.size() );
+
+        for ( const auto& thread : m_threads )
+        {
+            thread->wait();
+            delete thread;
+        }
+
+        m_threads.clear();
+        m_quit.store( false );
+
+        // permits left by threads that quit before taking theirs
+        m_start.tryAcquire( m_start.available() );
+    }
+
+    for ( quint16 w = 1; w < nworkers; ++w )
+    {
+        auto thread = new Thread( *this, w );
+        m_threads << thread;
+        thread->start( QThread::TimeCriticalPriority );
+    }
+}
+
+void WorkerPool::run(Task task, void* context, quint32 ntasks)
+{
+    if ( m_threads.isEmpty() || ntasks < 2 )
+    {
+        for ( quint32 t = 0; t < ntasks; ++t )
+              task( context, t, 0 );
+        return;
+    }
+
+    m_task      = task;
+    m_context   = context;
+    m_ntasks    = ntasks;
+    m_next.store( 0, std::memory_order_release );
+
+    quint16 nhelpers = qMin<quint32>( m_threads.size(), ntasks-1 );
+
+    m_start.release( nhelpers );
+    work( 0 );
+    m_done.acquire( nhelpers );
+}
+
+void WorkerPool::work(quint16 worker)
+{
+    quint32 t;
+
+    while ( (t = m_next.fetch_add(1, std::memory_order_acq_rel)) < m_ntasks )
+        m_task( m_context, t, worker );
+}
+
+void WorkerPool::Thread::run()
+{
+    forever
+    {
+        m_pool.m_start.acquire();
+        if ( m_pool.m_quit.load() ) return;
+
+        m_pool.work( m_index );
+        m_pool.m_done.release();
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef WORKERPOOL_HPP
+#define WORKERPOOL_HPP
+
+#include <QThread>
+#include <QSemaphore>
+#include <QVector>
+#include <atomic>
+
+// fixed set of high-priority threads helping the audio thread
+// through a batch of independent tasks. the calling thread takes
+// part in the batch as worker 0, helper threads are workers 1 to n-1.
+// tasks are handed out through an atomic counter, a worker index
+// is never used by two threads at once, so that workers can each
+// own private buffers. threads sleep between batches
+
+class WorkerPool
+{
+    public:
+    typedef void (*Task) ( void* context, quint32 task, quint16 worker );
+
+    WorkerPool  ( ) {}
+    ~WorkerPool ( ) { resize(1); }
+
+    WorkerPool ( WorkerPool const& ) = delete;
+    WorkerPool& operator= ( WorkerPool const& ) = delete;
+
+    // total number of workers, including the calling thread,
+    // not to be called while a batch is running
+    void resize ( quint16 nworkers );
+    quint16 size ( ) const { return m_threads.size()+1; }
+
+    // runs task(context, t, worker) for t in [0, ntasks),
+    // returns once all of them are done
+    void run ( Task task, void* context, quint32 ntasks );
+
+    private:
+    class Thread : public QThread
+    {
+        public:
+        Thread ( WorkerPool& pool, quint16 index ) : m_pool(pool), m_index(index) {}
+
+        protected:
+        void run ( ) override;
+
+        private:
+        WorkerPool& m_pool;
+        quint16 m_index;
+    };
+
+    void work ( quint16 worker );
+
+    QVector<Thread*> m_threads;
+    QSemaphore m_start;
+    QSemaphore m_done;
+
+    Task m_task         = nullptr;
+    void* m_context     = nullptr;
+    quint32 m_ntasks    = 0;
+    std::atomic<quint32> m_next { 0 };
+    std::atomic<bool> m_quit { false };
+};
+
+#endif // WORKERPOOL_HPP
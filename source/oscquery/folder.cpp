@@ -5,11 +5,48 @@
 #include <source/oscquery/client.hpp>
 #include <QJsonArray>
 
+#ifdef WPN114_AUDIO
+#include <QtConcurrent>
+
+inline void add_property(WPNNode* node, QString name, Type::Values type, QVariant value)
+{
+    auto subnode = node->createSubnode(name);
+    subnode->setType        ( type );
+    subnode->setAccess      ( Access::READ );
+    subnode->setValueQuiet  ( value );
+}
+
+inline void describe(WPNNode* node, SampleInfo const& info)
+{
+    node->setExtendedType   ( "soundfile" );
+    add_property            ( node, "duration", Type::Float, info.duration() );
+    add_property            ( node, "channels", Type::Int, info.nchannels );
+    add_property            ( node, "sampleRate", Type::Int, info.sample_rate );
+
+    if ( info.analyzed )
+    {
+        add_property ( node, "peak", Type::Float, info.peak );
+        add_property ( node, "loudness", Type::Float, info.loudness );
+    }
+}
+#endif
+
 WPNFolderNode::WPNFolderNode() : m_recursive(true), WPNNode()
 {        
     m_attributes.type           = Type::List;
     m_attributes.access         = Access::READ;
     m_attributes.extended_type  = "folder";
+
+#ifdef WPN114_AUDIO
+    QObject::connect(&m_watcher, SIGNAL(finished()), this, SLOT(onIndexed()));
+#endif
+}
+
+WPNFolderNode::~WPNFolderNode()
+{
+#ifdef WPN114_AUDIO
+    m_watcher.waitForFinished();
+#endif
 }
 
 void WPNFolderNode::parseDirectory(QDir dir)
@@ -24,8 +61,18 @@ void WPNFolderNode::parseDirectory(QDir dir)
         node->setFilePath       ( dir.path()+"/"+file );
         node->setExtendedType   ( "file");
         addSubnode              ( node );
+
+#ifdef WPN114_AUDIO
+        m_soundfiles.insert( file, node );
+#endif
     }
 
+#ifdef WPN114_AUDIO
+    // headers of new or modified soundfiles are read off the object's thread
+    m_watcher.setFuture( QtConcurrent::run(&SampleIndex::scan, dir.path(),
+                                           SampleIndex::filters(), false) );
+#endif
+
     if ( m_recursive )
     {
         dir.setNameFilters  ( QStringList{} );
@@ -47,6 +94,20 @@ void WPNFolderNode::parseDirectory(QDir dir)
     }
 }
 
+#ifdef WPN114_AUDIO
+void WPNFolderNode::onIndexed()
+{
+    for ( const auto& info : m_watcher.result() )
+    {
+        // removed meanwhile, or not readable
+        WPNNode* node = m_soundfiles.value( info.name );
+        if ( node && info.nchannels && info.sample_rate ) describe( node, info );
+    }
+
+    m_soundfiles.clear();
+}
+#endif
+
 void WPNFolderNode::setFolderPath(QString path)
 {
     m_folder_path = path;
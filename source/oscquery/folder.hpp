@@ -8,6 +8,12 @@
 #include <QQueue>
 #include <QQmlParserStatus>
 
+#ifdef WPN114_AUDIO
+#include <QFutureWatcher>
+#include <QPointer>
+#include <source/audio/sampleindex.hpp>
+#endif
+
 class WPNFolderNode : public WPNNode
 {
     Q_OBJECT
@@ -18,6 +24,7 @@ class WPNFolderNode : public WPNNode
 
     public:
     WPNFolderNode();
+    ~WPNFolderNode();
 
     virtual void componentComplete() override;
     QString folderPath() const { return m_folder_path; }
@@ -30,8 +37,20 @@ class WPNFolderNode : public WPNNode
     void setRecursive(bool rec);
     void setFilters(QStringList filters);
 
+#ifdef WPN114_AUDIO
+    protected slots:
+    void onIndexed();
+#endif
+
     private:    
     void parseDirectory(QDir dir);
+
+#ifdef WPN114_AUDIO
+    // soundfiles are described once indexed in the background
+    QFutureWatcher<QVector<SampleInfo>> m_watcher;
+    QHash<QString, QPointer<WPNNode>> m_soundfiles;
+#endif
+
     QStringList m_filters;
     bool m_recursive;
     QString m_folder_path;
@@ -45,7 +45,16 @@ vst {
     SOURCES += audio_objects/audioplugin/audioplugin.mm
 }
 
+# optional, decodes flac/ogg/aiff through libsndfile
+packagesExist(sndfile): CONFIG += sndfile
+
+sndfile {
+    DEFINES += WPN114_SNDFILE
+    LIBS += -lsndfile
+}
+
 audio {
+    QT += concurrent
     DEFINES += WPN114_AUDIO
     SOURCES +=                                      \
         source/audio/audio.cpp                      \
@@ -53,14 +62,27 @@ audio {
         audio_objects/sine/sine.cpp                 \
         audio_objects/stpanner/stereopanner.cpp     \
         source/audio/soundfile.cpp                     \
+        source/audio/samplebuffer.cpp               \
+        source/audio/resampler.cpp                  \
+        source/audio/tables.cpp                     \
+        source/audio/memorybudget.cpp               \
+        source/audio/samplecache.cpp                \
+        source/audio/peaks.cpp                      \
+        source/audio/sampleindex.cpp                \
+        source/audio/workerpool.cpp                 \
+        source/audio/truepeak.cpp                   \
         audio_objects/sampler/sampler.cpp           \
         audio_objects/rooms/rooms.cpp               \
+        audio_objects/rooms/ambisonics.cpp          \
+        audio_objects/rooms/vbap.cpp                \
         audio_objects/mangler/mangler.cpp           \
         audio_objects/sharpen/sharpen.cpp           \
         audio_objects/multisampler/multisampler.cpp \
+        audio_objects/waveform/waveform.cpp         \
         audio_objects/fork/fork.cpp                 \
         audio_objects/peakrms/peakrms.cpp           \
         audio_objects/convolver/convolver.cpp       \
+        audio_objects/convolver/impulseresponse.cpp \
         external/fftconvolver/AudioFFT.cpp        \
         external/fftconvolver/FFTConvolver.cpp    \
         external/fftconvolver/TwoStageFFTConvolver.cpp \
@@ -68,6 +90,9 @@ audio {
         audio_objects/clock/audioclock.cpp          \
         audio_objects/bursts/bursts.cpp             \
         audio_objects/limiter/masterlimiter.cpp     \
+        audio_objects/loudness/loudness.cpp         \
+        audio_objects/spectrum/spectrum.cpp         \
+        audio_objects/recorder/recorder.cpp         \
         audio_objects/ashes/ashes.cpp               \
         audio_objects/downmix/downmix.cpp           \
         audio_objects/channelmapper/channelmapper.cpp \
@@ -76,17 +101,32 @@ audio {
     HEADERS +=                                      \
         source/audio/audio.hpp                      \
         source/audio/soundfile.hpp                  \
+        source/audio/ringbuffer.hpp                 \
+        source/audio/simd.hpp                       \
+        source/audio/samplebuffer.hpp               \
+        source/audio/resampler.hpp                  \
+        source/audio/tables.hpp                     \
+        source/audio/memorybudget.hpp               \
+        source/audio/samplecache.hpp                \
+        source/audio/peaks.hpp                      \
+        source/audio/sampleindex.hpp                \
+        source/audio/workerpool.hpp                 \
+        source/audio/truepeak.hpp                   \
         external/rtaudio/RtAudio.h                  \
         audio_objects/sine/sine.hpp                 \
         audio_objects/stpanner/stereopanner.hpp     \
         audio_objects/sampler/sampler.hpp           \
         audio_objects/rooms/rooms.hpp               \
+        audio_objects/rooms/ambisonics.hpp          \
+        audio_objects/rooms/vbap.hpp                \
         audio_objects/mangler/mangler.hpp           \
         audio_objects/sharpen/sharpen.hpp           \
         audio_objects/multisampler/multisampler.hpp \
+        audio_objects/waveform/waveform.hpp         \
         audio_objects/fork/fork.hpp                 \
         audio_objects/peakrms/peakrms.hpp           \
         audio_objects/convolver/convolver.hpp       \
+        audio_objects/convolver/impulseresponse.hpp \
         external/fftconvolver/AudioFFT.h          \
         external/fftconvolver/FFTConvolver.h      \
         external/fftconvolver/TwoStageFFTConvolver.h \
@@ -94,6 +134,9 @@ audio {
         audio_objects/clock/audioclock.hpp          \
         audio_objects/bursts/bursts.hpp             \
         audio_objects/limiter/masterlimiter.hpp     \
+        audio_objects/loudness/loudness.hpp         \
+        audio_objects/spectrum/spectrum.hpp         \
+        audio_objects/recorder/recorder.hpp         \
         audio_objects/ashes/ashes.hpp               \
         audio_objects/downmix/downmix.hpp           \
         audio_objects/channelmapper/channelmapper.hpp \